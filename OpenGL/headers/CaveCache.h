@@ -0,0 +1,102 @@
+#ifndef CAVECACHE_H
+#define CAVECACHE_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+// Versioned binary file of generated cave chunks: each chunk's voxel palette and packed indices,
+// ghost ring included, and its finished mesh. The file is memory-mapped when opened, and chunk data
+// is used straight from the mapped pages, so loading a chunk is a copy of its voxels and a GPU
+// upload from the mapping with no parsing in between.
+//
+// Layout: a Header, then Header::chunkCount ChunkRecords, then the data blocks they point to,
+// each aligned to DATA_ALIGNMENT bytes. All values are in the writing machine's byte order; the
+// key written by CaveGenerator covers everything that changes the contents, and the header the
+// layout itself, so a file from other parameters or another build is simply not used.
+class CaveCache {
+public:
+    static const uint32_t VERSION = 3;
+    static const size_t DATA_ALIGNMENT = 64;
+
+    struct Header {
+        char magic[8];          // "CAVECHNK"
+        uint32_t version;
+        uint32_t headerSize;    // sizeof(Header), checked along with the version
+        uint32_t recordSize;    // sizeof(ChunkRecord)
+        uint32_t chunkCount;
+        uint64_t key;           // Hash of the generation parameters the chunks were made with
+    };
+
+    struct ChunkRecord {
+        int32_t x, y, z;        // Chunk coordinates
+        uint32_t editCount;     // Recorded edits the noise grid and mesh include
+        uint32_t unitFaces;     // Exposed voxel faces before merging
+        uint32_t faceCount;     // Face records, when the chunk is pulled
+        uint32_t paletteSize;   // Voxel palette entries
+        uint32_t indexBits;     // Bits per voxel index, 0 for a chunk of a single material
+        uint64_t vertexBytes;   // Vertex data, when the chunk uses a vertex buffer
+        uint64_t voxelOffset;   // Byte offsets from the start of the file
+        uint64_t voxelBytes;    // Palette, padded to 8 bytes, then the index words
+        uint64_t meshOffset;    // Face records or vertex data, whichever the chunk has
+    };
+
+    // A chunk to write; the pointers only need to stay valid during write()
+    struct ChunkData {
+        glm::ivec3 coord;
+        uint32_t editCount;
+        uint32_t unitFaces;
+        const uint8_t* palette;
+        size_t paletteSize;
+        int indexBits;
+        const uint64_t* indices;
+        size_t indexWords;
+        const uint64_t* faces;
+        size_t faceCount;
+        const void* vertices;
+        size_t vertexBytes;
+    };
+
+    CaveCache();
+    ~CaveCache();
+    CaveCache(const CaveCache&) = delete;
+    CaveCache& operator=(const CaveCache&) = delete;
+
+    // Maps a cache file. Returns false, leaving the cache closed, if the file is missing,
+    // truncated, of another version or layout, or was written for another key.
+    bool open(const std::string& path, uint64_t key);
+    void close();
+    bool isOpen() const { return mappedData != nullptr; }
+
+    // The record for a chunk, or nullptr if the file doesn't have it.
+    const ChunkRecord* find(const glm::ivec3& coord) const;
+    const std::vector<const ChunkRecord*>& getRecords() const { return records; }
+
+    // Data of a record, pointing into the mapped file.
+    const uint8_t* palette(const ChunkRecord& record) const;
+    const uint64_t* indices(const ChunkRecord& record) const;
+    size_t indexWordCount(const ChunkRecord& record) const;
+    const uint64_t* faces(const ChunkRecord& record) const;
+    const void* vertices(const ChunkRecord& record) const;
+
+    // Writes a cache file from scratch. Chunk data may point into a mapped cache, as long as that
+    // was mapped from a different file; a file can't be replaced while it is mapped on Windows.
+    static bool write(const std::string& path, uint64_t key, const std::vector<ChunkData>& chunks);
+
+private:
+    const unsigned char* mappedData;
+    size_t mappedSize;
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#else
+    int fileDescriptor;
+#endif
+    std::vector<const ChunkRecord*> records;
+    std::unordered_map<int64_t, const ChunkRecord*> recordsByChunk;
+};
+
+#endif // CAVECACHE_H
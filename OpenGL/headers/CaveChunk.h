@@ -0,0 +1,92 @@
+#ifndef CAVECHUNK_H
+#define CAVECHUNK_H
+
+#include <vector>
+#include <list>
+#include <cstdint>
+#include <cstddef>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "PaletteGrid.h"
+#include "SolidityMask.h"
+#include "OccupancyPyramid.h"
+
+// Edge length, in voxels, of a cubic cave chunk.
+const int CHUNK_SIZE = 32;
+static_assert(CHUNK_SIZE == OccupancyPyramid::EDGE, "the occupancy pyramid covers exactly one chunk");
+static_assert(CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE <= 65536, "a chunk's voxel indices fit the 16 bits of CaveChunk::floorVoxels");
+
+// Floor division of a voxel coordinate by CHUNK_SIZE, giving the coordinate of its chunk.
+inline int chunkCoordOf(int voxel) {
+    return (voxel >= 0) ? voxel / CHUNK_SIZE : (voxel + 1) / CHUNK_SIZE - 1;
+}
+
+inline glm::ivec3 chunkCoordOf(const glm::ivec3& voxel) {
+    return glm::ivec3(chunkCoordOf(voxel.x), chunkCoordOf(voxel.y), chunkCoordOf(voxel.z));
+}
+
+// Materials stored in a chunk's voxel grid. Air must stay 0, which PaletteGrid and SolidityMask
+// treat as empty; everything else is solid.
+enum VoxelMaterial : uint8_t {
+    MATERIAL_AIR = 0,
+    MATERIAL_ROCK,          // Rock above the biome change level, and rock placed by edits
+    MATERIAL_DEEP_ROCK,     // Rock of the lower biome
+    MATERIAL_CRYSTAL_BED,   // Lower biome floors, where crystals grow
+    MATERIAL_ORE,           // Pockets deep inside the rock, furthest from any cave
+    MATERIAL_COUNT
+};
+
+// Highest level of the baked voxel light. Light loses one level per voxel it spreads through, and
+// levels are packed into 4 bits of every face record and vertex.
+const int MAX_LIGHT_LEVEL = 15;
+
+// Packs chunk coordinates into a single 64-bit key, 21 bits per axis.
+inline int64_t chunkKey(const glm::ivec3& coord) {
+    const int64_t mask = (int64_t(1) << 21) - 1;
+    return ((coord.x & mask) << 42) | ((coord.y & mask) << 21) | (coord.z & mask);
+}
+
+// A CHUNK_SIZE^3 block of the cave. The voxel grid's ghost ring holds the materials of the
+// neighbouring chunks' border voxels, so a chunk can be meshed on its own without seams.
+struct CaveChunk {
+    glm::ivec3 coord;               // Chunk coordinates; the chunk covers voxels coord * CHUNK_SIZE onwards
+    uint64_t id;                    // Unique per generated chunk, so stale remesh jobs can be recognised
+    PaletteGrid voxels;             // Materials of the chunk's voxels plus the surrounding ghost ring
+    SolidityMask solidMask;         // Rebuilt from voxels whenever the chunk is meshed
+    OccupancyPyramid occupancy;     // Rebuilt with solidMask; edits that add rock mark it straight away
+    GLuint vao, vbo;                // Vertex buffer path, created on first upload
+    GLuint faceBuffer, faceTexture; // Face pulling path: face records and the buffer texture over them
+    unsigned int quadCount;         // Quads in the uploaded mesh, whichever path it uses
+    unsigned int unitFaceCount;     // Exposed voxel faces in the mesh, before greedy merging
+    size_t gpuBytes;                // Allocated size of the vertex buffer or face record buffer
+    bool meshDirty;                 // Needs a background remesh, e.g. after a meshing mode change
+    bool editDirty;                 // Voxels were edited; remeshed on the GL thread by the next update()
+    bool remeshPending;             // A remesh job for this chunk is queued or waiting for upload
+    uint64_t meshRevision;          // Bumped for every remesh, so a job overtaken by a newer mesh is dropped
+    uint64_t lastUsedFrame;         // Last update() that wanted this chunk resident
+    std::list<int64_t>::iterator lruPosition;
+    std::vector<uint16_t> floorVoxels; // Air voxels resting on rock, as lightIndex(x, y, z) in ascending order; rebuilt with solidMask
+    std::vector<glm::vec3> crystalPositions;
+    bool crystalsSpawned;
+    std::vector<uint8_t> light;     // Light level of each voxel, ghost ring excluded; empty until light reaches the chunk
+    std::vector<uint8_t> bakedLight; // Path-traced light levels in the same layout; empty if the bake left the chunk dark
+    bool lightBaked;                // bakedLight holds a bake of the chunk as it is now
+
+    explicit CaveChunk(const glm::ivec3& coord)
+        : coord(coord), id(0), vao(0), vbo(0), faceBuffer(0), faceTexture(0), quadCount(0), unitFaceCount(0), gpuBytes(0), meshDirty(false),
+          editDirty(false), remeshPending(false), meshRevision(0), lastUsedFrame(0), crystalsSpawned(false), lightBaked(false) {}
+
+    glm::ivec3 origin() const { return coord * CHUNK_SIZE; }
+
+    static int lightIndex(int x, int y, int z) { return (z * CHUNK_SIZE + y) * CHUNK_SIZE + x; }
+    static glm::ivec3 lightVoxel(int index) { return glm::ivec3(index % CHUNK_SIZE, (index / CHUNK_SIZE) % CHUNK_SIZE, index / (CHUNK_SIZE * CHUNK_SIZE)); }
+    int lightAt(int x, int y, int z) const { return light.empty() ? 0 : light[lightIndex(x, y, z)]; }
+
+    // CPU and GPU memory held by this chunk
+    size_t memoryBytes() const {
+        return voxels.sizeInBytes() + solidMask.sizeInBytes() + occupancy.sizeInBytes() + gpuBytes
+            + floorVoxels.size() * sizeof(uint16_t) + crystalPositions.size() * sizeof(glm::vec3) + light.size() + bakedLight.size();
+    }
+};
+
+#endif // CAVECHUNK_H
@@ -2,47 +2,477 @@
 #define CAVEGENERATOR_H
 
 #include <vector>
+#include <memory>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <cstdint>
+#include <cstddef>
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include "crystal.h"
+#include "shader.h"
+#include "CaveChunk.h"
+#include "CaveCache.h"
+#include "ThreadPool.h"
+#include "SpatialHash.h"
 
 class CaveGenerator {
 public:
-    CaveGenerator(int depth, int width, int height, float threshold);
+    // Parameters for an unbounded, camera-centred cave
+    struct StreamingSettings {
+        int viewRadius;          // Radius, in chunks, kept generated around the camera
+        size_t memoryBudget;     // Bytes of chunk data kept resident before least recently used chunks are evicted
+        int maxChunksPerUpdate;  // Chunk generation jobs submitted per update() call
+        int maxPendingJobs;      // Jobs queued, running or waiting for upload before no more are submitted
+        size_t uploadBytesPerFrame;   // Vertex bytes uploaded per update() before the rest wait for the next frame
+        double uploadMillisPerFrame;  // Time spent uploading per update() before the rest wait for the next frame
+        int maxImmediateRemeshes;     // Edited chunks remeshed on the GL thread per update(); the rest go to the workers
+        StreamingSettings() : viewRadius(3), memoryBudget(size_t(256) << 20), maxChunksPerUpdate(8),
+            maxPendingJobs(32), uploadBytesPerFrame(size_t(4) << 20), uploadMillisPerFrame(2.0), maxImmediateRemeshes(8) {}
+    };
+
+    // Generation pipeline metrics, updated by update()
+    struct StreamingStats {
+        int jobsInFlight;          // Jobs queued or running on the workers
+        int uploadQueueDepth;      // Finished jobs waiting for the GL thread
+        int uploadsLastFrame;
+        size_t bytesUploadedLastFrame;
+        double lastUploadLatencyMs;  // Time from job submission to GL upload
+        double averageUploadLatencyMs;
+        double maxUploadLatencyMs;
+        uint64_t totalUploads;
+        uint64_t chunksGenerated;        // Chunks made from noise
+        uint64_t chunksFromCache;        // Chunks loaded from the cache file instead
+        uint64_t noiseOctavesEvaluated;  // Per-voxel octave evaluations, and those the early-out saved
+        uint64_t noiseOctavesSkipped;
+        int immediateRemeshesLastFrame;  // Edited chunks remeshed and uploaded within the last update()
+        double immediateRemeshMs;        // Time those remeshes took
+        int lightVoxelsLastUpdate;       // Voxels whose light the last light update changed
+        double lightUpdateMs;            // Time that update took
+        StreamingStats() : jobsInFlight(0), uploadQueueDepth(0), uploadsLastFrame(0), bytesUploadedLastFrame(0),
+            lastUploadLatencyMs(0.0), averageUploadLatencyMs(0.0), maxUploadLatencyMs(0.0), totalUploads(0),
+            chunksGenerated(0), chunksFromCache(0), noiseOctavesEvaluated(0), noiseOctavesSkipped(0),
+            immediateRemeshesLastFrame(0), immediateRemeshMs(0.0), lightVoxelsLastUpdate(0), lightUpdateMs(0.0) {}
+    };
+
+    // How chunk meshes are built
+    enum MeshingMode {
+        MESHING_NAIVE,  // Two triangles per exposed voxel face
+        MESHING_GREEDY  // Coplanar exposed faces merged into maximal rectangles
+    };
+
+    // How chunk meshes reach the GPU
+    enum RenderMode {
+        RENDER_VERTEX_BUFFER, // Four packed vertices per quad in a VBO, drawn through the shared index buffer
+        RENDER_FACE_PULLING   // One 8-byte record per quad in a buffer texture, expanded by the vertex shader
+    };
+
+    // Where the light baked into the cave meshes comes from
+    enum LightingMode {
+        LIGHTING_FLOOD_FILL,  // Light flooded through the voxels, kept up to date with every change
+        LIGHTING_PATH_TRACED  // Light from the last finished light bake, where there is one
+    };
+
+    // Quality and cost of a light bake
+    struct LightBakeSettings {
+        int samplesPerVoxel;     // Paths traced from every air voxel in front of a cave face
+        int maxBounces;          // Diffuse bounces followed per path; 0 bakes direct light only
+        float albedo;            // Fraction of the light reaching the rock that it reflects
+        double millisPerUpdate;  // Tracing time per update() call; the rest of the bake waits for later frames
+        double maxBakeMillis;    // Tracing time for the whole bake; it takes fewer samples rather than overrun it. 0 for no limit
+        LightBakeSettings() : samplesPerVoxel(64), maxBounces(2), albedo(0.5f), millisPerUpdate(4.0), maxBakeMillis(0.0) {}
+    };
+
+    // What a light bake has traced
+    struct LightBakeStats {
+        size_t chunks;        // Chunks within reach of a light, whose voxels are traced
+        size_t voxels;        // Air voxels in front of cave faces in those chunks
+        int samplesPerVoxel;  // Samples every voxel has had so far
+        uint64_t rays;        // Path and shadow rays traced
+        double milliseconds;  // Tracing time, summed over the update() calls it was spread across
+        LightBakeStats() : chunks(0), voxels(0), samplesPerVoxel(0), rays(0), milliseconds(0.0) {}
+    };
+
+    // Bounded cave covering [0, width) x [0, height) x [0, depth); everything outside is air.
+    CaveGenerator(int depth, int width, int height, float threshold, unsigned int threadCount = 0);
+    // Unbounded cave streamed in chunks around the camera.
+    CaveGenerator(float threshold, const StreamingSettings& streaming, unsigned int threadCount = 0);
     ~CaveGenerator();
 
+    // Blocks until every chunk currently wanted is generated and uploaded; meant for startup.
     void generateCave();
-    void render();
+    // Keeps generated chunks in a cache file. generateCave and update() load every chunk they can
+    // from it instead of generating it, and generateCave rewrites it whenever it had to generate
+    // chunks. The file is only used if it was written with the same generation parameters,
+    // meshing and render modes and recorded edits. Call before generateCave.
+    void setCacheFile(const std::string& path);
+    // Submits generation jobs and uploads finished ones within the per-frame budget; never blocks.
+    void update(const glm::vec3& cameraPosition, const glm::vec3& cameraFront);
+    // Draws pulled chunks with pullShader and vertex buffer chunks with vertexShader. Both must have
+    // their other uniforms set; each chunk's origin is set here.
+    void render(const Shader& vertexShader, const Shader& pullShader);
 
-    std::vector<std::vector<std::vector<float>>> noiseValues;
     std::vector<Crystal> crystals;
     const std::vector<glm::vec3>& getCrystalPositions() const { return crystalPositions; };
+    // Changes whenever getCrystalPositions() does, so whatever is built from the list can be kept until then.
+    unsigned int getCrystalListVersion() const { return crystalListVersion; }
+    // The same crystals hashed by position, for finding those near a point or in view without walking
+    // the whole list. Kept up to date as crystals spawn, are buried and unload with their chunks.
+    const SpatialHash& getCrystalIndex() const { return crystalIndex; }
     void generateCrystals();
+    // Seeds crystal placement: the same seed grows the same crystals on the same floors, whatever order
+    // chunks load in and however many threads place them. Chunks that already have crystals keep them.
+    void setSeed(uint64_t seed) { this->seed = seed; }
+    uint64_t getSeed() const { return seed; }
+    uint64_t volumeHash() const;
+
+    // Voxel access in world coordinates, as VoxelMaterial values. Voxels outside the bounds or in
+    // chunks that aren't resident read as air, and writes to them are dropped.
+    uint8_t getMaterial(int x, int y, int z) const;
+    void setMaterial(int x, int y, int z, uint8_t material);
+    bool isSolid(int x, int y, int z) const { return getMaterial(x, y, z) != MATERIAL_AIR; }
+
+    // Runtime edits, cheap enough to call every frame. Each one is written into the resident chunks
+    // it touches, which the next update() remeshes, and recorded so those chunks keep it when they
+    // are evicted and generated again. Spheres cover the voxels whose centres lie within radius.
+    void carveSphere(const glm::vec3& centre, float radius);
+    void fillSphere(const glm::vec3& centre, float radius);
+    // Boxes cover the voxels [min, max).
+    void carveBox(const glm::ivec3& min, const glm::ivec3& max);
+    void fillBox(const glm::ivec3& min, const glm::ivec3& max);
+
+    // Baked voxel light. Sources flood light through the air, one level less per voxel, and every
+    // cave face takes the level of the air voxel in front of it, baked into its face record or
+    // vertices, so lights cost nothing per fragment however many are placed. Crystals glow as
+    // sources too. Placed lights are kept while their chunk is evicted. Changes are propagated by
+    // the next update(), which remeshes only the chunks whose light changed.
+    void addLight(const glm::vec3& position, int level);
+    void removeLight(const glm::vec3& position);
+    // Light level of a voxel, 0 if it is dark or not resident
+    int getLight(int x, int y, int z) const;
+    // Starts path tracing the light of every placed light and crystal through the resident cave,
+    // with shadows and light bouncing off the rock, into per-voxel levels like the flood fill's.
+    // Those are 4-bit and colourless, so bounce light dimmer than a level step is lost and the
+    // torch colour is the shader's; the shader's directional lights aren't part of the bake.
+    // Returns at once: each update() traces a slice of the bake on every worker and the
+    // calling thread, and the last one installs the light and remeshes the baked chunks in the
+    // background. Drops a bake still in progress. The bake is a snapshot: chunks edited or streamed
+    // in after it starts keep flood-filled light, and lights placed since show once the cave is
+    // baked again.
+    void startLightBake(const LightBakeSettings& settings);
+    bool isBakingLight() const { return lightBake != nullptr; }
+    // What the bake in progress has traced so far, or else what the last finished bake traced
+    LightBakeStats getLightBakeStats() const { return lightBake ? lightBake->stats : lastLightBakeStats; }
+    // Chooses the light baked into the meshes and remeshes every resident chunk in the background.
+    void setLightingMode(LightingMode mode);
+    LightingMode getLightingMode() const { return lightingMode; }
+
+    // A ray to trace through the cave
+    struct RayQuery {
+        glm::vec3 origin;
+        glm::vec3 direction;  // Need not be normalized
+        float maxDistance;    // In voxels; the search gives up beyond this
+    };
+
+    // Result of tracing a RayQuery
+    struct RayHit {
+        bool hit;
+        float distance;              // Along the ray to where it enters the hit voxel, or maxDistance on a miss
+        glm::ivec3 voxel;            // First solid voxel along the ray
+        glm::ivec3 lastEmptyVoxel;   // Voxel the ray passed through just before it, where a block
+                                     // placed against the hit face would go
+    };
+
+    // Finds the first solid voxel along a ray within maxDistance. Returns false on a miss.
+    bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+                 glm::ivec3& hitVoxel, glm::ivec3& lastEmptyVoxel) const;
+    // Traces many rays at once across the worker threads and the calling thread. Must be called from
+    // the thread that calls update() and edits the cave, which it blocks until every ray is done.
+    void raycastBatch(const std::vector<RayQuery>& queries, std::vector<RayHit>& hits) const;
 
+    // Moves an axis-aligned box by 'motion', stopping it against solid voxels and letting it slide
+    // along whatever it hits. Only voxels the box sweeps through are read, so the cost depends on
+    // the box size and the distance moved, never on the size of the cave. A box that starts inside
+    // rock can still move out of it. Returns the box centre after the move.
+    glm::vec3 sweepBox(const glm::vec3& centre, const glm::vec3& halfExtents, const glm::vec3& motion) const;
+    // World-space centre of a voxel
+    static glm::vec3 voxelCentre(const glm::ivec3& voxel);
+
+    size_t getLoadedChunkCount() const { return chunks.size(); }
+    size_t getMemoryUsage() const;
+    // CPU bytes of the resident chunks' voxel grids, and how many of those chunks hold one material
+    size_t getVoxelBytes() const;
+    size_t getUniformChunkCount() const;
+    StreamingStats getStreamingStats() const;
+
+    // Switches the meshing mode and remeshes every resident chunk in the background.
+    void setMeshingMode(MeshingMode mode);
+    MeshingMode getMeshingMode() const { return meshingMode; }
+    // Switches between vertex buffers and face pulling and remeshes every resident chunk. Chunks with
+    // more faces than a buffer texture can hold always fall back to vertex buffers.
+    void setRenderMode(RenderMode mode);
+    RenderMode getRenderMode() const { return renderMode; }
+    // Turns baked ambient occlusion on or off and remeshes every resident chunk. Each quad corner is
+    // darkened by the rock around it in front of the face, so the shaders need no extra lookups.
+    void setAmbientOcclusion(bool enabled);
+    bool getAmbientOcclusion() const { return ambientOcclusion; }
+    // With exact noise, the default, every voxel sums all of its octaves. Otherwise a voxel stops as
+    // soon as the octaves left cannot move it into another material band, which gives the same
+    // materials from partial sums. That only pays off with more octaves than the default 3: at 3
+    // the first two never decide a voxel, and the early-out's bookkeeping costs a few percent.
+    void setExactNoise(bool exact) { exactNoise = exact; }
+    bool getExactNoise() const { return exactNoise; }
+    // Octaves of Perlin noise summed per voxel, 3 by default. Only chunks generated afterwards see
+    // it, so set it before generateCave.
+    void setNoiseOctaves(int octaves) { noiseOctaves = (octaves > 1) ? octaves : 1; }
+    int getNoiseOctaves() const { return noiseOctaves; }
+    // Vertices in the resident meshes (4 per quad), and how many the same faces take as unit quads
+    size_t getVertexCount() const;
+    size_t getUnitFaceVertexCount() const;
+    // GPU bytes of the resident chunk meshes
+    size_t getMeshBytes() const;
+
+    // Packed 8-byte face record, one per quad. Used directly by cave_pull_vertex_shader.vs, which
+    // reads it as one RG32UI texel, and expanded into four Vertex structs for the vertex buffer path:
+    //   bits 0-14 block x, y, z within the chunk, 5 bits each; bits 15-17 face (SolidityMask::Face);
+    //   bits 18-22 columns - 1 and bits 23-27 rows - 1 of the quad; bits 28-31 light level;
+    //   bits 32-39 ambient occlusion of the four corners, 2 bits each in Vertex corner order,
+    //   3 being unoccluded; the rest unused
+    static uint64_t packFace(int x, int y, int z, SolidityMask::Face face, int columns, int rows, int light, int occlusion);
+    // Decodes vertex (0-5) of a face record's quad the same way cave_pull_vertex_shader.vs does for
+    // gl_VertexID % 6, for checking the records on the CPU
+    static void unpackFace(uint64_t faceRecord, int vertex, const glm::ivec3& origin, glm::vec3& position, glm::vec3& normal,
+                           glm::vec2& texCoords, float& light, float& occlusion);
+
+    // Packed 8-byte cave vertex, decoded by cave_vertex_shader.vs. Cave corners sit on the voxel
+    // lattice and every face has one of six normals, so neither needs floats:
+    //   packedPosition:   corner x, y, z relative to the chunk origin, plus 1, 10 bits each
+    //   packedAttributes: bits 0-2 face (SolidityMask::Face), bits 3-4 corner (0 bottom left,
+    //                     1 top left, 2 top right, 3 bottom right), bits 5-10 columns - 1 and
+    //                     bits 11-16 rows - 1 of the quad, bits 17-20 light level, bits 21-22
+    //                     ambient occlusion of the corner; the rest are unused
     struct Vertex {
-        glm::vec3 position;
-        glm::vec3 normal;
-        glm::vec2 texCoords;
+        uint32_t packedPosition;
+        uint32_t packedAttributes;
+
+        static Vertex pack(const glm::ivec3& local, int face, int corner, int columns, int rows, int light, int occlusion);
+        // Same decoding as cave_vertex_shader.vs
+        void unpack(const glm::ivec3& origin, glm::vec3& position, glm::vec3& normal, glm::vec2& texCoords, float& light,
+                    float& occlusion) const;
     };
+    // Expands a face record into the four vertices the vertex buffer path draws it with
+    static void addFace(std::vector<Vertex>& vertexData, uint64_t faceRecord);
 
 private:
+    // Recorded edit: the voxels in [min, max), limited to those whose centres lie within radius of
+    // centre for a sphere, overwritten with a material
+    struct VoxelEdit {
+        glm::ivec3 min, max;
+        bool sphere;
+        glm::vec3 centre;
+        float radius;
+        uint8_t material;
+    };
+
+    // The edits recorded against one chunk. Once more than MAX_RECENT_EDITS pile up they are merged
+    // into a grid of the last material written to each voxel, so a chunk's record stays bounded
+    // however often it is edited. Edits only overwrite materials, so replaying the merged grid and
+    // then the recent edits gives the same voxels as replaying every edit in order.
+    struct ChunkEditLog {
+        PaletteGrid merged;              // Laid out like CaveChunk::voxels, EDIT_UNTOUCHED where no merged edit wrote; unsized until the first merge
+        std::vector<VoxelEdit> recent;   // Edits since the last merge, oldest first
+        size_t count;                    // Edits recorded in all, merged ones included
+        ChunkEditLog() : count(0) {}
+    };
+
+    // Output of a background job, waiting in the upload queue for the GL thread
+    struct MeshJob {
+        int64_t key;
+        std::unique_ptr<CaveChunk> chunk;  // Newly generated chunk, or null for a remesh
+        uint64_t chunkId;                  // Remesh target; dropped if that chunk was evicted meanwhile
+        uint64_t meshRevision;             // Target's meshRevision when submitted; dropped if it was remeshed since
+        size_t editCount;                  // Recorded edits the new chunk was generated with
+        unsigned int unitFaces;            // Exposed voxel faces, before any merging
+        SolidityMask solidMask;
+        std::vector<uint16_t> floorVoxels; // See CaveChunk::floorVoxels
+        std::vector<uint64_t> faceData;    // Face records when the chunk is pulled
+        std::vector<Vertex> vertexData;    // Vertices when the chunk uses a vertex buffer
+        std::chrono::high_resolution_clock::time_point submitted;
+        MeshJob() : key(0), chunkId(0), meshRevision(0), editCount(0), unitFaces(0) {}
+    };
+
+    bool bounded;
     int depth, width, height;
     float threshold;
-    unsigned int vertexCount;
+    MeshingMode meshingMode;
+    RenderMode renderMode;
+    bool ambientOcclusion;
+    LightingMode lightingMode;
+    GLint maxFaceRecords;      // Largest buffer texture, in texels; bigger chunks use vertex buffers
     const int biomeChangeYLevel = 20;
-    std::vector<GLfloat> vertices;
-    std::vector<float> normals;
+    StreamingSettings streaming;
+    std::unordered_map<int64_t, std::unique_ptr<CaveChunk>> chunks;
+    std::list<int64_t> lruOrder; // Most recently used chunk first
+    uint64_t frameCounter;
+    glm::vec3 streamingCentre;
+    glm::vec3 lastCameraPosition;
+    glm::vec3 travelDirection;
+    std::unordered_map<int64_t, ChunkEditLog> chunkEdits; // Edits touching each chunk, ghost ring included, replayed when it is generated
+    bool crystalsEnabled;
+    bool crystalListDirty;
+    unsigned int crystalListVersion; // Bumped by every rebuild of crystalPositions
+    uint64_t seed;                   // Keys the random numbers of crystal placement
     std::vector<glm::vec3> crystalPositions; // Member variable to store crystal positions
-    GLuint vao, vbo;
-
-    bool hasNeighbour(int x, int y, int z, glm::vec3 direction);
-    float perlinNoise(int x, int y, int z);
-    bool isSolid(int x, int y, int z);
-    void addFace(std::vector<Vertex>& vertexData, int x, int y, int z, glm::vec3 normal);
-    void generatePerlinWorm(int startX, int startY, int startZ, int length, float thickness);
-    void carveTunnel(float x, float y, float z, float radius);
+    SpatialHash crystalIndex;                // Resident crystals by position; item ids are unused
+    GLuint pullVao;            // Empty VAO bound while drawing pulled chunks
+    GLuint quadIndexBuffer;    // Element buffer shared by every chunk VAO
+    size_t quadIndexCapacity;  // Quads covered by quadIndexBuffer
+    std::unordered_set<int64_t> pendingChunks; // Chunks being generated in the background
+    int jobsInFlight;                          // Submitted jobs not yet uploaded
+    uint64_t nextChunkId;
+    mutable std::mutex uploadMutex;            // Guards uploadQueue
+    std::condition_variable jobFinished;
+    std::deque<MeshJob> uploadQueue;
+    std::atomic<bool> cancelJobs;
+    std::atomic<bool> exactNoise;
+    int noiseOctaves;
+    mutable std::atomic<uint64_t> noiseOctavesEvaluated;   // Counted by the workers as they generate chunks
+    mutable std::atomic<uint64_t> noiseOctavesSkipped;
+    StreamingStats stats;
+    std::string cachePath;                     // Empty when chunks aren't cached
+    CaveCache cache;                           // Mapped cachePath, if it matched the parameters
+    MeshingMode cacheMeshingMode;              // Modes the mapped cache's meshes were built with
+    RenderMode cacheRenderMode;
+    bool cacheAmbientOcclusion;
+    // Meshes of chunks generated by generateCave, kept until it writes them to the cache
+    struct CachedMesh {
+        std::vector<uint64_t> faceData;
+        std::vector<Vertex> vertexData;
+    };
+    std::unordered_map<int64_t, CachedMesh> meshesToCache;
+    bool collectingCacheMeshes;                // Inside generateCave with a cache file set
+    // A placed light
+    struct LightSource {
+        glm::ivec3 voxel;
+        uint8_t level;
+    };
+    std::unordered_map<int64_t, std::vector<LightSource>> chunkLights; // Placed lights by chunk key
+    std::vector<glm::ivec3> lightAddQueue;                             // Lit voxels whose light has yet to spread
+    std::vector<std::pair<glm::ivec3, uint8_t>> lightRemoveQueue;      // Darkened voxels and the level they lost
+    std::unordered_set<int64_t> relitChunks;   // Chunks whose faces see changed light, remeshed by updateLighting
+    bool lightEdited;                          // Light changes queued by edits or placed lights, remeshed at once
+    int lightVoxelsChanged;                    // Voxels relit since the last light update
+    // A chunk of a light bake. Its air voxels in front of a face, and the sources in reach of
+    // them, are gathered by the bake's first slices
+    struct LightBakeChunk {
+        glm::ivec3 coord;
+        uint64_t chunkId;                // Chunk the bake is for; dropped if it was evicted meanwhile
+        std::vector<int> voxels;         // CaveChunk::lightIndex of each voxel
+        std::vector<float> brightness;   // Sum of each voxel's samples
+        std::vector<glm::vec4> emitters;
+    };
+    // A light bake in progress, advanced a slice at a time by update()
+    struct LightBake {
+        LightBakeSettings settings;
+        std::vector<glm::vec4> emitters;                          // Every source when the bake started, as position and intensity
+        std::vector<std::pair<int64_t, uint64_t>> residentChunks; // Key and id of every chunk resident then, baked dark unless traced
+        std::vector<LightBakeChunk> traced;                       // The resident chunks that have faces
+        size_t gathered;                                          // Traced chunks gathered so far
+        std::vector<std::pair<int, int>> tasks;                   // Traced chunk and first voxel of each run of voxels
+        size_t nextTask;                                          // First task the current pass has yet to trace
+        double passStartMillis;                                   // stats.milliseconds when the current pass started
+        double lastPassMillis;                                    // Tracing time of the last whole pass
+        std::unordered_set<int64_t> editedChunks;                 // Chunks edited since the bake started
+        LightBakeStats stats;
+        LightBake() : gathered(0), nextTask(0), passStartMillis(0.0), lastPassMillis(0.0) {}
+    };
+    std::unique_ptr<LightBake> lightBake;      // Null unless a bake is in progress
+    LightBakeStats lastLightBakeStats;
+    std::unique_ptr<ThreadPool> threadPool;    // Declared last so workers stop before the state they use is destroyed
+
+    // Noise parameters for one biome layer
+    struct NoiseSettings {
+        float scaleX, scaleY, scaleZ;
+        float persistence;
+        int octaves;
+    };
+
+    NoiseSettings noiseSettingsAt(int y) const;
+    float perlinNoise(int x, int y, int z) const;
+    void perlinNoiseRow(int startX, int y, int z, int count, float* out) const;
+    // A run of voxels along x whose noise a chunk needs
+    struct NoiseRun {
+        int startX, y, z, count;
+        float* out;
+    };
+    void evaluateNoise(const std::vector<NoiseRun>& runs) const;
+
+    bool chunkInBounds(const glm::ivec3& coord) const;
+    bool clipToBounds(glm::ivec3& min, glm::ivec3& max) const;
+    CaveChunk* findChunk(const glm::ivec3& coord) const;
+    void generateChunkVoxels(CaveChunk& chunk, const ChunkEditLog& edits) const;
+    uint8_t materialAt(float noise, int y, bool floor) const;
+    template <typename Visit>
+    static void forEachEditedVoxel(const glm::ivec3& origin, const VoxelEdit& edit, Visit visit);
+    static VoxelEdit sphereEdit(const glm::vec3& centre, float radius, uint8_t material);
+    static VoxelEdit boxEdit(const glm::ivec3& min, const glm::ivec3& max, uint8_t material);
+    void applyEdit(const VoxelEdit& edit);
+    void applyEditToChunk(CaveChunk& chunk, const VoxelEdit& edit) const;
+    void recordEdit(const glm::ivec3& coord, const VoxelEdit& edit);
+    void replayEdits(CaveChunk& chunk, const ChunkEditLog& edits, size_t editCount) const;
+    void removeBuriedCrystals(CaveChunk& chunk);
+    RayHit traceRay(const RayQuery& query) const;
+    unsigned int meshChunk(const PaletteGrid& voxels, const uint8_t* light, MeshingMode mode, RenderMode render, bool occlusion,
+                           SolidityMask& solidMask, std::vector<uint16_t>& floorVoxels, std::vector<uint64_t>& faceData,
+                           std::vector<Vertex>& vertexData) const;
+    static void collectFloorVoxels(const SolidityMask& solidMask, std::vector<uint16_t>& floorVoxels);
+    void meshGreedy(const SolidityMask& solidMask, const uint8_t* light, bool occlusion, std::vector<uint64_t>& faceData) const;
+    static int cornerOcclusion(const SolidityMask& solidMask, int x, int y, int z, SolidityMask::Face face);
+    bool gatherLight(const CaveChunk& chunk, std::vector<uint8_t>& light) const;
+    void stepLightBake(double millisBudget);
+    void gatherLightBakeChunk(LightBakeChunk& bake, const std::vector<glm::vec4>& emitters, int maxBounces) const;
+    void finishLightBake();
+    float sampleBakedLight(const glm::vec3& position, const std::vector<glm::vec4>& emitters, const LightBakeSettings& settings,
+                           uint64_t seed, uint64_t& rays) const;
+    bool lightVisible(const glm::vec3& from, const glm::vec3& to, uint64_t& rays) const;
+    void updateLighting();
+    void setVoxelLight(CaveChunk& chunk, const glm::ivec3& local, int level);
+    void seedLight(CaveChunk& chunk, const glm::ivec3& voxel, int level);
+    void darkenVoxel(CaveChunk& chunk, const glm::ivec3& voxel);
+    int lightSourceLevel(const CaveChunk& chunk, const glm::ivec3& voxel) const;
+    void lightNewChunk(CaveChunk& chunk);
+    void unlightChunk(CaveChunk& chunk);
+    void relightEdit(CaveChunk& chunk, const VoxelEdit& edit);
+    void reserveQuadIndices(size_t quads);
+    void uploadChunkMesh(CaveChunk& chunk, const uint64_t* faceData, size_t faceCount, const Vertex* vertexData, size_t vertexCount);
+    void keepMeshForCache(int64_t key, const std::vector<uint64_t>& faceData, const std::vector<Vertex>& vertexData);
+    void releaseChunk(CaveChunk& chunk);
+    void queryFaceRecordLimit();
+    void submitChunkJobs(const std::vector<glm::ivec3>& coords);
+    void finishJob(MeshJob job);
+    void processUploads(size_t byteBudget, double millisBudget);
+    void installJob(MeshJob& job);
+    void makeResident(int64_t key, std::unique_ptr<CaveChunk> chunk, size_t editCount);
+    bool installCachedChunk(const glm::ivec3& coord);
+    uint64_t cacheKey() const;
+    void writeCache();
+    void remeshDirtyChunks();
+    void remeshEditedChunks(int maxChunks);
+    void streamChunks(int maxChunks);
+    void evictChunks();
+    void spawnCrystals(CaveChunk& chunk);
+    void placeCrystals(CaveChunk& chunk) const;
+    void seedCrystals(CaveChunk& chunk);
+    void rebuildCrystalList();
+
     void carveCorridor(int startX, int startY, int startZ, int corridorWidth, int corridorHeight, int corridorDepth);
-    void updateLighting(int y);
 };
 
 #endif // CAVEGENERATOR_H
@@ -0,0 +1,95 @@
+#ifndef CLUSTEREDLIGHTS_H
+#define CLUSTEREDLIGHTS_H
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "shader.h"
+#include "ThreadPool.h"
+
+// Point lights binned into a froxel grid over the view frustum, so a fragment shader only loops
+// over the lights that reach its cluster. The screen is split into TILES_X x TILES_Y tiles and the
+// depth range into SLICES slices spaced exponentially, which keeps clusters roughly cubic. Lights
+// are assigned on the CPU every frame, one depth slice per task across a thread pool, and the
+// result is uploaded as three buffer textures:
+//   lights:  two RGBA32F texels per light, world-space position and radius, then colour
+//   ranges:  one RG32UI texel per cluster, the offset and count of its run of light indices
+//   indices: one R32UI texel per entry, indexing the lights
+// Clusters are numbered (slice * TILES_Y + tileY) * TILES_X + tileX, tile (0, 0) being the bottom
+// left of the screen. The GLSL side is clusteredLight() in the shaders that bind the lights.
+class ClusteredLights {
+public:
+    static const int TILES_X = 16;
+    static const int TILES_Y = 9;
+    static const int SLICES = 24;
+    static const int CLUSTER_COUNT = TILES_X * TILES_Y * SLICES;
+    // Texture units the buffer textures are bound to, clear of the cave's face records on unit 2
+    // and of the units from 0 up that Mesh::Draw binds a model's textures to
+    static const int LIGHT_TEXTURE_UNIT = 8;
+    static const int RANGE_TEXTURE_UNIT = 9;
+    static const int INDEX_TEXTURE_UNIT = 10;
+
+    // A light with a smooth falloff to nothing at radius
+    struct PointLight {
+        glm::vec3 position;
+        float radius;
+        glm::vec3 color;
+    };
+
+    // Metrics of the last update()
+    struct Stats {
+        int lights;           // Lights passed in
+        int visibleLights;    // Those touching the view frustum
+        size_t indices;       // Light indices over every cluster
+        int maxClusterLights; // Most lights any one cluster holds
+        double assignMs;      // Time assigning lights to clusters
+        double uploadMs;      // Time uploading the buffers
+        Stats() : lights(0), visibleLights(0), indices(0), maxClusterLights(0), assignMs(0.0), uploadMs(0.0) {}
+    };
+
+    // Creates the buffers lazily on the first update(). A threadCount of 0 uses the hardware concurrency.
+    explicit ClusteredLights(unsigned int threadCount = 0);
+    ~ClusteredLights();
+
+    ClusteredLights(const ClusteredLights&) = delete;
+    ClusteredLights& operator=(const ClusteredLights&) = delete;
+
+    // Assigns the lights to clusters for this frame's camera and uploads the result. The projection
+    // must be glm::perspective(fovY, aspect, nearPlane, farPlane). Must run on the GL thread.
+    void update(const std::vector<PointLight>& lights, const glm::mat4& view, float fovY, float aspect,
+                float nearPlane, float farPlane);
+    // Binds the buffer textures and sets the cluster uniforms of a shader that uses clusteredLight().
+    // The shader must be in use. Leaves texture unit 0 active.
+    // Parameters:
+    //   - screenWidth, screenHeight: Size of the framebuffer being drawn, in pixels.
+    void bind(const Shader& shader, int screenWidth, int screenHeight) const;
+
+    Stats getStats() const { return stats; }
+
+private:
+    // View-space bounds of one cluster
+    struct Bounds {
+        glm::vec3 min, max;
+    };
+
+    std::unique_ptr<ThreadPool> threadPool;
+    float fovY, aspect, nearPlane, farPlane;  // Projection the cluster bounds were built for
+    std::vector<Bounds> clusterBounds;        // CLUSTER_COUNT entries
+    std::vector<glm::vec4> viewLights;        // View-space position and radius of each light
+    std::vector<std::vector<int>> sliceLights; // Lights overlapping each slice's depth range
+    std::vector<std::vector<std::vector<uint32_t>>> clusterLights; // Per slice, per tile
+    std::vector<glm::vec4> lightData;
+    std::vector<uint32_t> rangeData;
+    std::vector<uint32_t> indexData;
+    GLuint buffers[3];
+    GLuint textures[3];
+    Stats stats;
+
+    void buildClusterBounds();
+    int sliceOf(float depth) const;
+};
+
+#endif // CLUSTEREDLIGHTS_H
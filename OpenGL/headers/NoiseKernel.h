@@ -0,0 +1,57 @@
+#ifndef NOISEKERNEL_H
+#define NOISEKERNEL_H
+
+// Batched 3D gradient noise. The kernels evaluate the same classic Perlin noise as
+// glm::perlin(glm::vec3), 4 (SSE2), 8 (AVX2) or 16 (AVX-512) points per call, and the
+// widest instruction set the CPU supports is picked at runtime.
+//
+// Tolerance: every path performs the same float operations in the same order as
+// glm::perlin, so results are normally bit-identical to it. Compilers are allowed to
+// fuse multiply-adds inside the kernels, so the guaranteed bound is an absolute error
+// of at most 1e-5 per sample against glm::perlin (noise values lie in roughly [-1, 1]).
+
+enum NoiseISA {
+    NOISE_ISA_SCALAR,
+    NOISE_ISA_SSE2,
+    NOISE_ISA_AVX2,
+    NOISE_ISA_AVX512
+};
+
+// Widest instruction set that is both compiled in and supported by this CPU.
+NoiseISA detectNoiseISA();
+
+// Instruction set currently used by accumulatePerlinRow (detected on first use).
+NoiseISA getNoiseISA();
+
+// Forces a specific instruction set, e.g. to compare paths. Requests for an unsupported
+// set fall back to the widest supported one.
+void setNoiseISA(NoiseISA isa);
+
+const char* noiseISAName(NoiseISA isa);
+
+// Bound on |glm::perlin| everywhere, derived from glm's code (a port of Gustavson's classic noise,
+// "Simplex noise demystified", 2005) rather than measured. The noise is 2.2 times a blend of the
+// eight lattice corners' ramps g . d, d being the offset from the corner, with fade weights that
+// are non-negative and sum to 1. By Cauchy-Schwarz the blend is at most
+// max|g| * sqrt(sum of weight * |d|^2), and that sum splits per axis into
+// (1 - fade(t)) t^2 + fade(t) (1 - t)^2, which peaks at 1/4 at t = 1/2. Enumerating all 289^3
+// lattice hashes gives max|g| = 0.9987 after taylorInvSqrt, so
+// |noise| <= 2.2 * 0.9987 * sqrt(3/4) = 1.9027; rounded up to cover float rounding. The largest
+// value actually reached is about 1.17.
+const float PERLIN_VALUE_BOUND = 1.906f;
+
+// Scalar reference evaluation of a single point.
+float perlinNoiseScalar(float x, float y, float z);
+
+// Most points any kernel evaluates per register. Counts that are a multiple of it never fall back
+// to scalar evaluation for the tail.
+const int NOISE_MAX_WIDTH = 16;
+
+// Adds amplitude * perlin(px[i], py, pz) to out[i] for i in [0, count).
+// A row of the volume shares y and z, so only the x coordinates are passed per point.
+void accumulatePerlinRow(const float* px, float py, float pz, float amplitude, float* out, int count);
+
+// Adds amplitude * perlin(px[i], py[i], pz[i]) to out[i] for i in [0, count), for scattered points.
+void accumulatePerlinPoints(const float* px, const float* py, const float* pz, float amplitude, float* out, int count);
+
+#endif // NOISEKERNEL_H
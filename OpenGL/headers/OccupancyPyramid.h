@@ -0,0 +1,109 @@
+#ifndef OCCUPANCYPYRAMID_H
+#define OCCUPANCYPYRAMID_H
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include "SolidityMask.h"
+
+// Coarse occupancy mip levels over a 32^3 chunk, used to skip empty space when tracing rays.
+// Level k (1 to 5) has one bit per cube of 2^k voxels on a side, set when any voxel in the cube
+// may be solid. Bits may be set for cubes that are empty (edits only ever add bits until the next
+// build), but never cleared for cubes that hold rock, so skipping a clear cube is always safe.
+class OccupancyPyramid {
+public:
+    static const int EDGE = 32;     // Voxels along each side of the chunk
+    static const int LEVELS = 5;    // Levels above single voxels, up to the whole chunk
+
+    OccupancyPyramid() { std::fill(bits, bits + WORD_COUNT, ~uint64_t(0)); }
+
+    // Rebuilds every level from a chunk's solidity mask, ghost ring excluded.
+    void build(const SolidityMask& mask) {
+        std::fill(bits, bits + WORD_COUNT, 0);
+
+        // Level 1 straight from the mask rows: OR each 2x2 block of rows, then each pair of bits
+        const int cells = EDGE / 2;
+        for (int z = 0; z < EDGE; z += 2) {
+            for (int y = 0; y < EDGE; y += 2) {
+                uint64_t rows = (mask.row(y, z)[0] | mask.row(y + 1, z)[0] |
+                                 mask.row(y, z + 1)[0] | mask.row(y + 1, z + 1)[0]) >> 1; // Drop the ghost voxel x = -1
+                for (int x = 0; x < cells; ++x) {
+                    if ((rows >> (x * 2)) & 3) {
+                        setBit(1, x, y / 2, z / 2);
+                    }
+                }
+            }
+        }
+
+        // Each coarser level ORs the eight cells below it
+        for (int level = 2; level <= LEVELS; ++level) {
+            const int n = EDGE >> level;
+            for (int z = 0; z < n; ++z) {
+                for (int y = 0; y < n; ++y) {
+                    for (int x = 0; x < n; ++x) {
+                        bool occupied = false;
+                        for (int child = 0; child < 8 && !occupied; ++child) {
+                            occupied = getBit(level - 1, x * 2 + (child & 1), y * 2 + ((child >> 1) & 1), z * 2 + (child >> 2));
+                        }
+                        if (occupied) {
+                            setBit(level, x, y, z);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Marks a box of voxels [lo, hi] (inclusive, chunk-local, clamped to the chunk) as possibly solid.
+    void markSolid(int loX, int loY, int loZ, int hiX, int hiY, int hiZ) {
+        loX = std::max(loX, 0); loY = std::max(loY, 0); loZ = std::max(loZ, 0);
+        hiX = std::min(hiX, EDGE - 1); hiY = std::min(hiY, EDGE - 1); hiZ = std::min(hiZ, EDGE - 1);
+        if (loX > hiX || loY > hiY || loZ > hiZ) return;
+        for (int level = 1; level <= LEVELS; ++level) {
+            for (int z = loZ >> level; z <= hiZ >> level; ++z) {
+                for (int y = loY >> level; y <= hiY >> level; ++y) {
+                    for (int x = loX >> level; x <= hiX >> level; ++x) {
+                        setBit(level, x, y, z);
+                    }
+                }
+            }
+        }
+    }
+
+    // Edge length of the largest empty cube containing chunk-local voxel (x, y, z), or 1 if even
+    // the smallest cube around it may hold rock and the voxel has to be tested itself.
+    int emptyCellSize(int x, int y, int z) const {
+        for (int level = LEVELS; level >= 1; --level) {
+            if (!getBit(level, x >> level, y >> level, z >> level)) {
+                return 1 << level;
+            }
+        }
+        return 1;
+    }
+
+    size_t sizeInBytes() const { return sizeof(bits); }
+
+private:
+    // Word offset of each level; level k holds (EDGE >> k)^3 bits
+    static int levelOffset(int level) {
+        static const int offsets[LEVELS + 1] = { 0, 0, 64, 72, 73, 74 };
+        return offsets[level];
+    }
+    static const int WORD_COUNT = 75;
+
+    uint64_t bits[WORD_COUNT];
+
+    bool getBit(int level, int x, int y, int z) const {
+        const int n = EDGE >> level;
+        int index = (z * n + y) * n + x;
+        return (bits[levelOffset(level) + (index >> 6)] >> (index & 63)) & 1;
+    }
+
+    void setBit(int level, int x, int y, int z) {
+        const int n = EDGE >> level;
+        int index = (z * n + y) * n + x;
+        bits[levelOffset(level) + (index >> 6)] |= uint64_t(1) << (index & 63);
+    }
+};
+
+#endif // OCCUPANCYPYRAMID_H
@@ -0,0 +1,212 @@
+#ifndef PALETTEGRID_H
+#define PALETTEGRID_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+// Palette-compressed voxel volume of 8-bit values, laid out like VoxelGrid (x fastest, then y,
+// then z, with a one-voxel ghost ring on every face) so the two share indices. Each distinct value
+// gets a palette entry, and every voxel stores the index of its entry in 1, 2, 4 or 8 bits, as few
+// as the palette allows. A grid holding a single value stores no indices at all. Value 0 is air.
+class PaletteGrid {
+public:
+    PaletteGrid() : width(0), height(0), depth(0), strideY(0), strideZ(0), voxelCount(0), bitsPerIndex(0), indexMask(0) {}
+
+    // Reallocates the grid for the given interior dimensions with every voxel (ghost ring included)
+    // set to fillValue; the grid starts out uniform.
+    void resize(int width, int height, int depth, uint8_t fillValue) {
+        this->width = width;
+        this->height = height;
+        this->depth = depth;
+        strideY = width + 2;
+        strideZ = strideY * (height + 2);
+        voxelCount = static_cast<size_t>(strideZ) * (depth + 2);
+        palette.assign(1, fillValue);
+        setIndexWidth(0);
+    }
+
+    // Linear index of voxel (x, y, z). Coordinates from -1 to size inclusive are valid,
+    // the outermost layer being the ghost ring.
+    int index(int x, int y, int z) const {
+        return (x + 1) + (y + 1) * strideY + (z + 1) * strideZ;
+    }
+
+    uint8_t operator[](int i) const {
+        if (bitsPerIndex == 0) return palette[0];
+        size_t bit = static_cast<size_t>(i) * bitsPerIndex;
+        return palette[(words[bit >> 6] >> (bit & 63)) & indexMask];
+    }
+    uint8_t at(int x, int y, int z) const { return (*this)[index(x, y, z)]; }
+    bool isSolid(int x, int y, int z) const { return at(x, y, z) != 0; }
+
+    // Sets one voxel, adding a palette entry and widening the indices if the value is new.
+    void set(int i, uint8_t value) {
+        int entry = findEntry(value);
+        if (entry < 0) {
+            entry = static_cast<int>(palette.size());
+            palette.push_back(value);
+            if (palette.size() > (size_t(1) << bitsPerIndex)) {
+                widen();
+            }
+        }
+        if (bitsPerIndex == 0) return;
+        size_t bit = static_cast<size_t>(i) * bitsPerIndex;
+        uint64_t& word = words[bit >> 6];
+        word = (word & ~(indexMask << (bit & 63))) | (static_cast<uint64_t>(entry) << (bit & 63));
+    }
+    void set(int x, int y, int z, uint8_t value) { set(index(x, y, z), value); }
+
+    // Replaces the whole grid, ghost ring included, with the voxelCount() values given in index
+    // order, using the narrowest indices they fit in.
+    void assign(const uint8_t* values) {
+        bool present[256] = {};
+        palette.clear();
+        for (size_t i = 0; i < voxelCount; ++i) {
+            if (!present[values[i]]) {
+                present[values[i]] = true;
+                palette.push_back(values[i]);
+            }
+        }
+        std::sort(palette.begin(), palette.end());
+        setIndexWidth(widthFor(palette.size()));
+        if (bitsPerIndex == 0) return;
+
+        uint8_t entryOf[256];
+        for (size_t entry = 0; entry < palette.size(); ++entry) {
+            entryOf[palette[entry]] = static_cast<uint8_t>(entry);
+        }
+        for (size_t i = 0; i < voxelCount; ++i) {
+            size_t bit = i * bitsPerIndex;
+            words[bit >> 6] |= static_cast<uint64_t>(entryOf[values[i]]) << (bit & 63);
+        }
+    }
+
+    // Drops palette entries no voxel uses any more and narrows the indices to match, collapsing
+    // the grid to a single value if that is all it holds. Edits only ever add entries.
+    void compact() {
+        if (bitsPerIndex == 0) return;
+        bool used[256] = {};
+        size_t usedCount = 0;
+        forEachEntry([&](int entry) {
+            if (!used[entry]) {
+                used[entry] = true;
+                ++usedCount;
+            }
+        });
+        if (usedCount == palette.size() && widthFor(usedCount) == bitsPerIndex) return;
+
+        std::vector<uint8_t> values(voxelCount);
+        for (size_t i = 0; i < voxelCount; ++i) {
+            values[i] = (*this)[static_cast<int>(i)];
+        }
+        assign(values.data());
+    }
+
+    // Restores a grid from its palette and packed indices, as returned by the accessors below.
+    void load(const uint8_t* entries, size_t entryCount, int bits, const uint64_t* indexWords) {
+        palette.assign(entries, entries + entryCount);
+        setIndexWidth(bits);
+        std::copy(indexWords, indexWords + words.size(), words.begin());
+    }
+
+    // Calls visit(entry) with the palette entry of every voxel in index order, which is row by row
+    // with the ghost voxels at either end of each row included. Unpacks whole words at a time.
+    template <typename Visit>
+    void forEachEntry(Visit visit) const {
+        if (bitsPerIndex == 0) {
+            for (size_t i = 0; i < voxelCount; ++i) visit(0);
+            return;
+        }
+        switch (bitsPerIndex) {
+        case 1: forEachEntryOfWidth<1>(visit); break;
+        case 2: forEachEntryOfWidth<2>(visit); break;
+        case 4: forEachEntryOfWidth<4>(visit); break;
+        default: forEachEntryOfWidth<8>(visit); break;
+        }
+    }
+
+    bool isUniform() const { return bitsPerIndex == 0; }
+    const std::vector<uint8_t>& getPalette() const { return palette; }
+    int getBitsPerIndex() const { return bitsPerIndex; }
+    const std::vector<uint64_t>& getIndexWords() const { return words; }
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    int getDepth() const { return depth; }
+    int getStrideY() const { return strideY; }
+    int getStrideZ() const { return strideZ; }
+    // Voxels in the grid, ghost ring included
+    size_t getVoxelCount() const { return voxelCount; }
+
+    size_t sizeInBytes() const { return palette.size() * sizeof(uint8_t) + words.size() * sizeof(uint64_t); }
+
+private:
+    int width, height, depth;
+    int strideY, strideZ;
+    size_t voxelCount;
+    int bitsPerIndex;          // 0 when the palette has a single entry
+    uint64_t indexMask;
+    std::vector<uint8_t> palette;
+    std::vector<uint64_t> words; // Indices packed from bit 0 up; widths divide 64 so none straddle words
+
+    static int widthFor(size_t entries) {
+        int bits = 0;
+        while ((size_t(1) << bits) < entries) {
+            bits = (bits == 0) ? 1 : bits * 2;
+        }
+        return bits;
+    }
+
+    int findEntry(uint8_t value) const {
+        for (size_t entry = 0; entry < palette.size(); ++entry) {
+            if (palette[entry] == value) return static_cast<int>(entry);
+        }
+        return -1;
+    }
+
+    // forEachEntry for one index width, so the unpacking loop has constant shifts and trip counts
+    template <int Bits, typename Visit>
+    void forEachEntryOfWidth(Visit visit) const {
+        const int perWord = 64 / Bits;
+        const uint64_t mask = (uint64_t(1) << Bits) - 1;
+        size_t fullWords = voxelCount / perWord;
+        for (size_t w = 0; w < fullWords; ++w) {
+            uint64_t word = words[w];
+            for (int k = 0; k < perWord; ++k) {
+                visit(static_cast<int>((word >> (k * Bits)) & mask));
+            }
+        }
+        uint64_t last = (fullWords < words.size()) ? words[fullWords] : 0;
+        for (size_t i = fullWords * perWord; i < voxelCount; ++i) {
+            visit(static_cast<int>(last & mask));
+            last >>= Bits;
+        }
+    }
+
+    // Clears the indices and sizes them for the given width.
+    void setIndexWidth(int bits) {
+        bitsPerIndex = bits;
+        indexMask = (bits == 0) ? 0 : ((uint64_t(1) << bits) - 1);
+        words.assign((voxelCount * bits + 63) / 64, 0);
+    }
+
+    // Doubles the index width, keeping every voxel's entry.
+    void widen() {
+        std::vector<uint64_t> old;
+        old.swap(words);
+        int oldBits = bitsPerIndex;
+        uint64_t oldMask = indexMask;
+        setIndexWidth((oldBits == 0) ? 1 : oldBits * 2);
+        if (oldBits == 0) return; // Every voxel was entry 0, which the cleared words already hold
+        for (size_t i = 0; i < voxelCount; ++i) {
+            size_t oldBit = i * oldBits;
+            uint64_t entry = (old[oldBit >> 6] >> (oldBit & 63)) & oldMask;
+            size_t bit = i * bitsPerIndex;
+            words[bit >> 6] |= entry << (bit & 63);
+        }
+    }
+};
+
+#endif // PALETTEGRID_H
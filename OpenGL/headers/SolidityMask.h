@@ -0,0 +1,169 @@
+#ifndef SOLIDITYMASK_H
+#define SOLIDITYMASK_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include "PaletteGrid.h"
+
+// One bit per voxel occupancy grid mirroring a PaletteGrid, ghost ring included. Each (y, z) row
+// is packed into 64-bit words along x, with bit b of word w holding voxel x = w * 64 + b - 1 so
+// that the ghost voxels on both ends of the row are stored too. Exposed faces for a whole word
+// of voxels are found with shifts and masks instead of six per-voxel lookups.
+class SolidityMask {
+public:
+    // Face directions, in the order generateCave emits them
+    enum Face { POS_X, NEG_X, POS_Y, NEG_Y, POS_Z, NEG_Z, FACE_COUNT };
+
+    SolidityMask() : width(0), height(0), depth(0), wordsPerRow(0) {}
+
+    // Rebuilds the mask from a voxel grid: a voxel is solid unless it is air (value 0).
+    void build(const PaletteGrid& grid) {
+        width = grid.getWidth();
+        height = grid.getHeight();
+        depth = grid.getDepth();
+        wordsPerRow = (width + 2 + 63) / 64;
+        words.assign(static_cast<size_t>(wordsPerRow) * (height + 2) * (depth + 2), 0);
+
+        if (grid.isUniform()) {
+            if (grid.getPalette()[0] == 0) return;
+            // Solid throughout: every row, ghost voxels included, is the same run of set bits
+            std::vector<uint64_t> full(wordsPerRow, 0);
+            for (int bit = 0; bit < width + 2; ++bit) {
+                full[bit >> 6] |= uint64_t(1) << (bit & 63);
+            }
+            for (size_t i = 0; i < words.size(); i += wordsPerRow) {
+                std::copy(full.begin(), full.end(), words.begin() + i);
+            }
+            return;
+        }
+
+        // The grid's voxels run row by row in the same order as the mask's rows
+        const std::vector<uint8_t>& palette = grid.getPalette();
+        bool solidEntry[256] = {};
+        for (size_t entry = 0; entry < palette.size(); ++entry) {
+            solidEntry[entry] = palette[entry] != 0;
+        }
+        const int rowLength = width + 2;
+        uint64_t* out = words.data();
+        if (rowLength <= 56) {
+            // Rows fit one word with a byte to spare: turn each byte of packed indices into the
+            // solidity bits of its voxels with one table lookup and cut the bit stream into rows
+            const int bits = grid.getBitsPerIndex();
+            const int perByte = 8 / bits;
+            uint8_t byteSolid[256];
+            for (int byte = 0; byte < 256; ++byte) {
+                byteSolid[byte] = 0;
+                for (int k = 0; k < perByte; ++k) {
+                    byteSolid[byte] |= static_cast<uint8_t>(solidEntry[(byte >> (k * bits)) & ((1 << bits) - 1)]) << k;
+                }
+            }
+            const uint64_t rowMask = (uint64_t(1) << rowLength) - 1;
+            uint64_t pending = 0;
+            int pendingBits = 0;
+            size_t remaining = grid.getVoxelCount();
+            for (uint64_t word : grid.getIndexWords()) {
+                for (int byte = 0; byte < 8 && remaining > 0; ++byte) {
+                    int count = static_cast<int>(std::min<size_t>(perByte, remaining));
+                    pending |= static_cast<uint64_t>(byteSolid[(word >> (byte * 8)) & 255] & ((1 << count) - 1)) << pendingBits;
+                    pendingBits += count;
+                    remaining -= count;
+                    if (pendingBits >= rowLength) {
+                        *out = pending & rowMask;
+                        out += wordsPerRow;
+                        pending >>= rowLength;
+                        pendingBits -= rowLength;
+                    }
+                }
+            }
+            return;
+        }
+        int bit = 0;
+        grid.forEachEntry([&](int entry) {
+            out[bit >> 6] |= static_cast<uint64_t>(solidEntry[entry]) << (bit & 63);
+            if (++bit == rowLength) {
+                bit = 0;
+                out += wordsPerRow;
+            }
+        });
+    }
+
+    bool isSolid(int x, int y, int z) const {
+        return (row(y, z)[(x + 1) >> 6] >> ((x + 1) & 63)) & 1;
+    }
+
+    void set(int x, int y, int z, bool solid) {
+        uint64_t bit = uint64_t(1) << ((x + 1) & 63);
+        uint64_t& word = row(y, z)[(x + 1) >> 6];
+        word = solid ? (word | bit) : (word & ~bit);
+    }
+
+    // Bits of word w that belong to interior voxels (0 <= x < width) rather than the ghost ring.
+    uint64_t interiorBits(int w) const {
+        int first = w * 64;
+        int lo = std::max(1, first) - first;
+        int hi = std::min(width + 1, first + 64) - first;
+        if (hi <= lo) return 0;
+        uint64_t upper = (hi == 64) ? ~uint64_t(0) : ((uint64_t(1) << hi) - 1);
+        return upper & ~((uint64_t(1) << lo) - 1);
+    }
+
+    // Voxel x coordinate of bit b in word w.
+    static int voxelX(int w, int bit) { return w * 64 + bit - 1; }
+
+    // Returns the exposed-face bits of word 'w' in row (y, z) for one face direction:
+    // a bit is set when the voxel is solid and its neighbour across that face is not.
+    // Rows must be interior (0 <= y < height, 0 <= z < depth); ghost bits in the result
+    // should be discarded with interiorBits.
+    uint64_t exposedFaces(Face face, int w, int y, int z) const {
+        const uint64_t* r = row(y, z);
+        uint64_t solid = r[w];
+        switch (face) {
+        case POS_X: {
+            uint64_t next = (w + 1 < wordsPerRow) ? r[w + 1] : 0;
+            return solid & ~((solid >> 1) | (next << 63));
+        }
+        case NEG_X: {
+            uint64_t prev = (w > 0) ? r[w - 1] : 0;
+            return solid & ~((solid << 1) | (prev >> 63));
+        }
+        case POS_Y: return solid & ~row(y + 1, z)[w];
+        case NEG_Y: return solid & ~row(y - 1, z)[w];
+        case POS_Z: return solid & ~row(y, z + 1)[w];
+        case NEG_Z: return solid & ~row(y, z - 1)[w];
+        default: return 0;
+        }
+    }
+
+    // Index of the lowest set bit; word must be non-zero.
+    static int lowestBit(uint64_t word) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward64(&index, word);
+        return static_cast<int>(index);
+#else
+        return __builtin_ctzll(word);
+#endif
+    }
+
+    uint64_t* row(int y, int z) {
+        return &words[(static_cast<size_t>(z + 1) * (height + 2) + (y + 1)) * wordsPerRow];
+    }
+    const uint64_t* row(int y, int z) const {
+        return &words[(static_cast<size_t>(z + 1) * (height + 2) + (y + 1)) * wordsPerRow];
+    }
+
+    int getWordsPerRow() const { return wordsPerRow; }
+    size_t sizeInBytes() const { return words.size() * sizeof(uint64_t); }
+
+private:
+    int width, height, depth;
+    int wordsPerRow;
+    std::vector<uint64_t> words;
+};
+
+#endif // SOLIDITYMASK_H
@@ -0,0 +1,251 @@
+#ifndef SPATIALHASH_H
+#define SPATIALHASH_H
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <cassert>
+#include <glm/glm.hpp>
+
+// Uniform grid over points in world space, hashed by cell so only occupied cells take memory. Each
+// item is a position plus an id chosen by its owner to tell its items apart. Queries only visit the
+// cells overlapping the query volume and test the items in them, so they cost what is nearby rather
+// than the whole set. Items are inserted and removed one at a time, e.g. as crystals spawn, are
+// buried or unload.
+class SpatialHash {
+public:
+    struct Item {
+        glm::vec3 position;
+        uint32_t id;
+    };
+
+    // Parameters:
+    //   - cellSize: Edge length of a grid cell. About the radius of a typical query works well.
+    explicit SpatialHash(float cellSize = 8.0f) : cellSize(cellSize), inverseCellSize(1.0f / cellSize), count(0) {}
+
+    void insert(const glm::vec3& position, uint32_t id) {
+        glm::ivec3 coord = cellOf(position);
+        Cell& cell = cells[cellKey(coord)];
+        cell.coord = coord;
+        cell.items.push_back(Item{ position, id });
+        ++count;
+    }
+
+    // Removes one item inserted with exactly this position and id. Returns false if there is none.
+    bool remove(const glm::vec3& position, uint32_t id) {
+        auto it = cells.find(cellKey(cellOf(position)));
+        if (it == cells.end()) return false;
+        std::vector<Item>& items = it->second.items;
+        for (size_t i = 0; i < items.size(); ++i) {
+            if (items[i].id == id && items[i].position == position) {
+                items[i] = items.back();
+                items.pop_back();
+                if (items.empty()) {
+                    cells.erase(it);
+                }
+                --count;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void clear() {
+        cells.clear();
+        count = 0;
+    }
+
+    size_t size() const { return count; }
+    size_t getCellCount() const { return cells.size(); }
+    float getCellSize() const { return cellSize; }
+
+    // Visits every item within radius of centre.
+    template <typename Visit>
+    void queryRadius(const glm::vec3& centre, float radius, Visit visit) const {
+        const float radiusSquared = radius * radius;
+        forEachCell(cellOf(centre - glm::vec3(radius)), cellOf(centre + glm::vec3(radius)), [&](const Cell& cell) {
+            for (const Item& item : cell.items) {
+                glm::vec3 offset = item.position - centre;
+                if (glm::dot(offset, offset) <= radiusSquared) {
+                    visit(item);
+                }
+            }
+        });
+    }
+
+    // Visits every item inside the box [min, max].
+    template <typename Visit>
+    void queryBox(const glm::vec3& min, const glm::vec3& max, Visit visit) const {
+        forEachCell(cellOf(min), cellOf(max), [&](const Cell& cell) {
+            for (const Item& item : cell.items) {
+                const glm::vec3& p = item.position;
+                if (p.x >= min.x && p.y >= min.y && p.z >= min.z && p.x <= max.x && p.y <= max.y && p.z <= max.z) {
+                    visit(item);
+                }
+            }
+        });
+    }
+
+    // Visits every item inside a view frustum or less than margin outside it, so items standing for
+    // spheres (lights, models) can pass their radius. Only the cells within the frustum's bounding box
+    // are looked at, and cells wholly outside a plane are skipped without testing their items.
+    // Parameters:
+    //   - viewProjection: projection * view of the frustum; the far plane must be finite.
+    //   - margin: How far outside the frustum an item may lie and still be visited.
+    template <typename Visit>
+    void queryFrustum(const glm::mat4& viewProjection, float margin, Visit visit) const {
+        // Planes with normals pointing inwards, normalized so dot(normal, p) + w is a distance
+        glm::vec4 planes[6];
+        for (int i = 0; i < 3; ++i) {
+            glm::vec4 row(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+            glm::vec4 last(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+            planes[i * 2] = last + row;
+            planes[i * 2 + 1] = last - row;
+        }
+        for (glm::vec4& plane : planes) {
+            plane = plane / glm::length(glm::vec3(plane));
+        }
+
+        // Bounding box of the frustum with every plane pushed out by margin, which is the region the
+        // items are tested against. Each corner is where a near or far, side and top or bottom plane meet
+        glm::vec4 widened[6];
+        for (int i = 0; i < 6; ++i) {
+            widened[i] = planes[i] + glm::vec4(0.0f, 0.0f, 0.0f, margin);
+        }
+        glm::vec3 boxMin(std::numeric_limits<float>::max()), boxMax(-std::numeric_limits<float>::max());
+        for (int corner = 0; corner < 8; ++corner) {
+            glm::vec3 point = intersect(widened[corner & 1], widened[2 + ((corner >> 1) & 1)], widened[4 + (corner >> 2)]);
+            // An infinite far plane leaves nothing to intersect with, and the corner comes out infinite or NaN
+            assert(std::isfinite(point.x) && std::isfinite(point.y) && std::isfinite(point.z) && "queryFrustum needs a finite far plane");
+            boxMin = glm::min(boxMin, point);
+            boxMax = glm::max(boxMax, point);
+        }
+
+        auto visitInside = [&](const Cell& cell) {
+            for (const Item& item : cell.items) {
+                bool inside = true;
+                for (int i = 0; i < 6 && inside; ++i) {
+                    inside = glm::dot(glm::vec3(planes[i]), item.position) + planes[i].w >= -margin;
+                }
+                if (inside) {
+                    visit(item);
+                }
+            }
+        };
+        glm::ivec3 lo = cellOf(boxMin), hi = cellOf(boxMax);
+        if (cellsInRange(lo, hi) > static_cast<int64_t>(cells.size())) {
+            // Few occupied cells: skip those whose corner furthest along some plane's normal is still outside it
+            for (const auto& entry : cells) {
+                const glm::ivec3& c = entry.second.coord;
+                if (c.x < lo.x || c.y < lo.y || c.z < lo.z || c.x > hi.x || c.y > hi.y || c.z > hi.z) continue;
+                glm::vec3 cellMin = glm::vec3(c) * cellSize;
+                bool outside = false;
+                for (int i = 0; i < 6 && !outside; ++i) {
+                    glm::vec3 furthest(planes[i].x >= 0.0f ? cellMin.x + cellSize : cellMin.x,
+                                       planes[i].y >= 0.0f ? cellMin.y + cellSize : cellMin.y,
+                                       planes[i].z >= 0.0f ? cellMin.z + cellSize : cellMin.z);
+                    outside = glm::dot(glm::vec3(planes[i]), furthest) + planes[i].w < -margin;
+                }
+                if (!outside) {
+                    visitInside(entry.second);
+                }
+            }
+            return;
+        }
+        // Otherwise clip each row of cells along x to the planes, so only cells that may reach into the
+        // frustum are looked up. A cell passes a plane when its corner furthest along the normal does
+        for (int z = lo.z; z <= hi.z; ++z) {
+            for (int y = lo.y; y <= hi.y; ++y) {
+                int first = lo.x, last = hi.x;
+                for (int i = 0; i < 6 && first <= last; ++i) {
+                    const glm::vec4& plane = planes[i];
+                    float rest = plane.w + margin + plane.y * (plane.y >= 0.0f ? y + 1 : y) * cellSize
+                                                  + plane.z * (plane.z >= 0.0f ? z + 1 : z) * cellSize;
+                    if (plane.x == 0.0f) {
+                        if (rest < 0.0f) last = first - 1;
+                        continue;
+                    }
+                    // Rounded outwards by a cell, as the items are tested on their own anyway
+                    float edge = -rest / (plane.x * cellSize);
+                    if (plane.x > 0.0f) {
+                        first = std::max(first, static_cast<int>(std::floor(std::max(edge, -1e9f))) - 2);
+                    }
+                    else {
+                        last = std::min(last, static_cast<int>(std::ceil(std::min(edge, 1e9f))) + 1);
+                    }
+                }
+                for (int x = first; x <= last; ++x) {
+                    auto it = cells.find(cellKey(glm::ivec3(x, y, z)));
+                    if (it != cells.end()) {
+                        visitInside(it->second);
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    struct Cell {
+        glm::ivec3 coord;
+        std::vector<Item> items;
+    };
+
+    float cellSize;
+    float inverseCellSize;
+    size_t count;
+    std::unordered_map<int64_t, Cell> cells;
+
+    glm::ivec3 cellOf(const glm::vec3& position) const {
+        return glm::ivec3(static_cast<int>(std::floor(position.x * inverseCellSize)),
+                          static_cast<int>(std::floor(position.y * inverseCellSize)),
+                          static_cast<int>(std::floor(position.z * inverseCellSize)));
+    }
+
+    // Packs cell coordinates into a key, 21 bits per axis like chunkKey
+    static int64_t cellKey(const glm::ivec3& coord) {
+        const int64_t mask = (int64_t(1) << 21) - 1;
+        return ((coord.x & mask) << 42) | ((coord.y & mask) << 21) | (coord.z & mask);
+    }
+
+    static int64_t cellsInRange(const glm::ivec3& lo, const glm::ivec3& hi) {
+        return int64_t(hi.x - lo.x + 1) * (hi.y - lo.y + 1) * (hi.z - lo.z + 1);
+    }
+
+    // Calls visit on every occupied cell in [lo, hi]. Looks each cell of the range up, or walks the
+    // occupied cells instead when there are fewer of those than the range holds.
+    template <typename Visit>
+    void forEachCell(const glm::ivec3& lo, const glm::ivec3& hi, Visit visit) const {
+        if (cellsInRange(lo, hi) > static_cast<int64_t>(cells.size())) {
+            for (const auto& entry : cells) {
+                const glm::ivec3& c = entry.second.coord;
+                if (c.x >= lo.x && c.y >= lo.y && c.z >= lo.z && c.x <= hi.x && c.y <= hi.y && c.z <= hi.z) {
+                    visit(entry.second);
+                }
+            }
+            return;
+        }
+        for (int z = lo.z; z <= hi.z; ++z) {
+            for (int y = lo.y; y <= hi.y; ++y) {
+                for (int x = lo.x; x <= hi.x; ++x) {
+                    auto it = cells.find(cellKey(glm::ivec3(x, y, z)));
+                    if (it != cells.end()) {
+                        visit(it->second);
+                    }
+                }
+            }
+        }
+    }
+
+    // Point where three planes meet.
+    static glm::vec3 intersect(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c) {
+        glm::vec3 na(a), nb(b), nc(c);
+        glm::vec3 bc = glm::cross(nb, nc);
+        return -(a.w * bc + b.w * glm::cross(nc, na) + c.w * glm::cross(na, nb)) / glm::dot(na, bc);
+    }
+};
+
+#endif // SPATIALHASH_H
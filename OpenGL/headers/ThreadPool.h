@@ -0,0 +1,123 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <algorithm>
+#include <memory>
+
+// Fixed-size pool of worker threads consuming a FIFO of tasks.
+class ThreadPool {
+public:
+    // Creates the pool. A threadCount of 0 uses the hardware concurrency.
+    explicit ThreadPool(unsigned int threadCount = 0) : stopping(false) {
+        if (threadCount == 0) {
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (unsigned int i = 0; i < threadCount; ++i) {
+            workers.emplace_back([this]() { workerLoop(); });
+        }
+    }
+
+    // Finishes the queued tasks, then joins every worker.
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeWorkers.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Queues a task to run on one of the workers.
+    void enqueue(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push(std::move(task));
+        }
+        wakeWorkers.notify_one();
+    }
+
+    // Runs body(i) for every i in [begin, end) across the workers and the calling thread,
+    // returning once all of them have finished. Indices are handed out one at a time, so
+    // uneven work balances itself. Helpers that only reach a worker after every index has been
+    // claimed exit without touching body, so a call behind a long queue of other tasks is never
+    // held up waiting for them. Must not be called from inside a pool task.
+    void parallelFor(int begin, int end, const std::function<void(int)>& body) {
+        if (end <= begin) return;
+
+        // Shared with the helpers, which may outlive this call
+        struct Loop {
+            std::atomic<int> next;
+            int end;
+            const std::function<void(int)>* body;
+            int running;  // Helpers inside drain
+            std::mutex mutex;
+            std::condition_variable done;
+        };
+        std::shared_ptr<Loop> loop = std::make_shared<Loop>();
+        loop->next = begin;
+        loop->end = end;
+        loop->body = &body;
+        loop->running = 0;
+
+        auto drain = [](Loop& state) {
+            for (int i = state.next++; i < state.end; i = state.next++) {
+                (*state.body)(i);
+            }
+        };
+
+        int helpers = std::min(static_cast<int>(workers.size()), end - begin - 1);
+        for (int h = 0; h < helpers; ++h) {
+            enqueue([loop, drain]() {
+                {
+                    std::lock_guard<std::mutex> lock(loop->mutex);
+                    if (loop->next >= loop->end) return; // Everything was claimed already
+                    ++loop->running;
+                }
+                drain(*loop);
+                std::lock_guard<std::mutex> lock(loop->mutex);
+                if (--loop->running == 0) loop->done.notify_one();
+            });
+        }
+
+        drain(*loop);
+        std::unique_lock<std::mutex> lock(loop->mutex);
+        loop->done.wait(lock, [&]() { return loop->running == 0; });
+    }
+
+    unsigned int size() const { return static_cast<unsigned int>(workers.size()); }
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wakeWorkers;
+    bool stopping;
+
+    void workerLoop() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeWorkers.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if (tasks.empty()) return; // stopping with nothing left to do
+                task = std::move(tasks.front());
+                tasks.pop();
+            }
+            task();
+        }
+    }
+};
+
+#endif // THREADPOOL_H
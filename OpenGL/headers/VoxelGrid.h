@@ -0,0 +1,63 @@
+#ifndef VOXELGRID_H
+#define VOXELGRID_H
+
+#include <vector>
+#include <cstddef>
+
+// Dense scalar voxel volume stored as a single contiguous array (x fastest, then y, then z).
+// Every face of the volume is surrounded by a one-voxel ghost ring, so the six neighbours of
+// any voxel inside the volume are reachable by adding a fixed stride to its index and no
+// bounds checks are needed when walking the grid.
+class VoxelGrid {
+public:
+    VoxelGrid() : width(0), height(0), depth(0), strideY(0), strideZ(0) {}
+
+    VoxelGrid(int width, int height, int depth, float fillValue) {
+        resize(width, height, depth, fillValue);
+    }
+
+    // Reallocates the grid for the given interior dimensions and sets every voxel
+    // (ghost ring included) to fillValue.
+    void resize(int width, int height, int depth, float fillValue) {
+        this->width = width;
+        this->height = height;
+        this->depth = depth;
+        strideY = width + 2;
+        strideZ = strideY * (height + 2);
+        values.assign(static_cast<size_t>(strideZ) * (depth + 2), fillValue);
+    }
+
+    // Linear index of voxel (x, y, z). Coordinates from -1 to size inclusive are valid,
+    // the outermost layer being the ghost ring.
+    int index(int x, int y, int z) const {
+        return (x + 1) + (y + 1) * strideY + (z + 1) * strideZ;
+    }
+
+    float& at(int x, int y, int z) { return values[index(x, y, z)]; }
+    float at(int x, int y, int z) const { return values[index(x, y, z)]; }
+
+    float& operator[](int i) { return values[i]; }
+    float operator[](int i) const { return values[i]; }
+
+    // Pointer to the first interior voxel of row (y, z); the row holds 'width' consecutive values.
+    float* row(int y, int z) { return &values[index(0, y, z)]; }
+    const float* row(int y, int z) const { return &values[index(0, y, z)]; }
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    int getDepth() const { return depth; }
+
+    // Index offsets between neighbouring voxels along each axis.
+    int getStrideX() const { return 1; }
+    int getStrideY() const { return strideY; }
+    int getStrideZ() const { return strideZ; }
+
+    size_t sizeInBytes() const { return values.size() * sizeof(float); }
+
+private:
+    int width, height, depth;
+    int strideY, strideZ;
+    std::vector<float> values;
+};
+
+#endif // VOXELGRID_H
@@ -31,6 +31,17 @@ struct Vertex {
     float m_Weights[MAX_BONE_INFLUENCE];
 };
 
+// per-instance data of an instanced draw
+struct InstanceData {
+    // model matrix
+    glm::mat4 Transform;
+    // colour the texture is multiplied by
+    glm::vec4 Tint;
+};
+
+// first vertex attribute location of the per-instance data; the transform takes four, one per column
+#define INSTANCE_ATTRIBUTE_LOCATION 7
+
 struct Texture {
     unsigned int id;
     string type;
@@ -58,6 +69,57 @@ public:
 
     // render the mesh
     void Draw(Shader& shader)
+    {
+        bindTextures(shader);
+
+        // draw mesh
+        glBindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
+        glBindVertexArray(0);
+
+        // always good practice to set everything back to defaults once configured.
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // render instanceCount copies of the mesh in one draw call, with the per-instance data
+    // from the buffer given to setInstanceBuffer
+    void DrawInstanced(Shader& shader, unsigned int instanceCount)
+    {
+        bindTextures(shader);
+
+        glBindVertexArray(VAO);
+        glDrawElementsInstanced(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0, instanceCount);
+        glBindVertexArray(0);
+
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // point the per-instance attributes at a buffer of InstanceData. The VAO keeps the buffer, so
+    // this is only needed once; refilling the buffer later is enough to change the instances
+    void setInstanceBuffer(unsigned int instanceVBO)
+    {
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        // transform, one vec4 column per location
+        for (unsigned int column = 0; column < 4; column++)
+        {
+            glEnableVertexAttribArray(INSTANCE_ATTRIBUTE_LOCATION + column);
+            glVertexAttribPointer(INSTANCE_ATTRIBUTE_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offsetof(InstanceData, Transform) + column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(INSTANCE_ATTRIBUTE_LOCATION + column, 1);
+        }
+        // tint
+        glEnableVertexAttribArray(INSTANCE_ATTRIBUTE_LOCATION + 4);
+        glVertexAttribPointer(INSTANCE_ATTRIBUTE_LOCATION + 4, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)offsetof(InstanceData, Tint));
+        glVertexAttribDivisor(INSTANCE_ATTRIBUTE_LOCATION + 4, 1);
+        glBindVertexArray(0);
+    }
+
+private:
+    // render data 
+    unsigned int VBO, EBO;
+
+    // bind the textures to units 0 and up and point the shader's samplers at them
+    void bindTextures(Shader& shader)
     {
         // bind appropriate textures
         unsigned int diffuseNr = 1;
@@ -84,20 +146,8 @@ public:
             // and finally bind the texture
             glBindTexture(GL_TEXTURE_2D, textures[i].id);
         }
-
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
     }
 
-private:
-    // render data 
-    unsigned int VBO, EBO;
-
     // initializes all the buffer objects/arrays
     void setupMesh()
     {
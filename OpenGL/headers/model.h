@@ -31,7 +31,17 @@ public:
     // Draw the model
     void Draw(Shader& shader, glm::mat4& modelMatrix);
 
+    // Replaces the instances DrawInstanced draws with one per transform. Each tint multiplies its
+    // instance's texture colour; without tints every instance is drawn untinted.
+    void setInstances(const std::vector<glm::mat4>& transforms, const std::vector<glm::vec4>& tints = std::vector<glm::vec4>());
+    // Draws every instance in one draw call per mesh. The shader takes the instance transform and
+    // tint as vertex attributes from INSTANCE_ATTRIBUTE_LOCATION on instead of a model uniform.
+    void DrawInstanced(Shader& shader);
+
 private:
+    unsigned int instanceVBO;   // InstanceData of every instance, created by the first setInstances
+    unsigned int instanceCount;
+
     // Private methods
     //glm::mat4 model = glm::mat4(1.0f);
     void loadModel(std::string const& path);
@@ -8,12 +8,19 @@ using namespace irrklang;
 #include "headers/camera.h"
 #include "headers/model.h"
 #include "headers/CaveGenerator.h"
+#include "headers/ClusteredLights.h"
+#include "headers/SpatialHash.h"
+#include "headers/VoxelGrid.h"
+#include "headers/NoiseKernel.h"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 #include <iostream>
+#include <random>
+#include <chrono>
+#include <algorithm>
 
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
@@ -21,6 +28,12 @@ void processInput(GLFWwindow* window, float deltatime);
 void mouseCallback(GLFWwindow* window, double xpos, double ypos);
 void scrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void PrintMatrix(const glm::mat4& mat);
+void benchmarkRaycasts(const CaveGenerator& cave, const glm::vec3& origin);
+void benchmarkNoiseEarlyOut();
+void checkDeterminism(uint64_t seed);
+void benchmarkVoxelLayout();
+void checkVertexPacking();
+void benchmarkSpatialHash();
 
 #pragma region Settings
 const unsigned int SCR_WIDTH = 1280;
@@ -87,6 +100,7 @@ int main()
     Shader ourShader("shaders/vertex_shader.vs", "shaders/fragment_shader.fs"); // General objects
     Shader crystalShader("shaders/light_vertex_shader.vs", "shaders/light_fragment_shader.fs"); // Crystals
     Shader caveShader("shaders/cave_vertex_shader.vs", "shaders/cave_fragment_shader.fs"); // Cave
+    Shader cavePullShader("shaders/cave_pull_vertex_shader.vs", "shaders/cave_fragment_shader.fs"); // Cave, face pulling
     Shader animShader("shaders/anim_vertex_shader.vs", "shaders/anim_fragment_shader.fs"); // for animation
     Shader torchShader("shaders/torch_vertex_shader.vs", "shaders/torch_fragment_shader.fs"); // for torch
 
@@ -106,6 +120,9 @@ int main()
     unsigned int texture;
     glGenTextures(1, &texture);
     glBindTexture(GL_TEXTURE_2D, texture);
+    // Greedy cave quads use texture coordinates past 1 to tile the texture once per block
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     
     // load and generate the texture
     int width, height, nrChannels;
@@ -127,6 +144,8 @@ int main()
     unsigned int texture2;
     glGenTextures(1, &texture2);
     glBindTexture(GL_TEXTURE_2D, texture2);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     unsigned char* data2 = stbi_load("textures/cracks.png", &width, &height, &nrChannels, 0);
     if (data2)
     {
@@ -141,10 +160,58 @@ int main()
     }
     stbi_image_free(data2);
 
-    CaveGenerator cave(75, 50, 75, 0.5f);
+    // Cave streamed in chunks around the camera
+    CaveGenerator::StreamingSettings caveStreaming;
+    CaveGenerator cave(0.5f, caveStreaming);
+    cave.setMeshingMode(CaveGenerator::MESHING_GREEDY); // G switches back to one quad per block face
+    cave.setCacheFile("cave.cache"); // Later runs load unchanged chunks from this file instead of generating them
+    cave.update(camera.Position, camera.Front);
     cave.generateCave();
     cave.generateCrystals();
+
+    // Torches; their light is flooded through the cave and baked into its meshes
+    const float torchHeightOffset = 1.2f; // so the light is at the top of the torch
+    const int torchLightLevel = 14;
+    std::vector<glm::vec3> torchPositions = { glm::vec3(29.8f, 42.0f, 25.0f) };
+    SpatialHash torchIndex; // The torches' lights by position, each with its index in torchPositions
+    torchIndex.insert(torchPositions[0] + glm::vec3(0.0f, torchHeightOffset, 0.0f), 0);
+    cave.addLight(torchPositions[0] + glm::vec3(0.0f, torchHeightOffset, 0.0f), torchLightLevel);
+    bool torchKeyWasDown = false;
+    bool bakeKeyWasDown = false;
+    CaveGenerator::LightBakeSettings lightBake;
+    lightBake.samplesPerVoxel = 64;
+    lightBake.millisPerUpdate = 4.0; // Traced a slice per frame, so the bake never stalls the game
+    lightBake.maxBakeMillis = 5000.0; // Fewer samples on slow machines rather than a long wait for the light
+    bool lightBakeRunning = false;
+
+    // The models and crystals aren't part of the baked cave light, so every torch and crystal also
+    // lights them as a point light, binned into view-space clusters each frame
+    ClusteredLights clusteredLights;
+    std::vector<glm::mat4> crystalTransforms;
+    unsigned int crystalInstanceVersion = 0; // Crystal list the crystal model's instances were built from
+    std::vector<ClusteredLights::PointLight> pointLights;
+    const float torchLightRadius = 12.0f;
+    const glm::vec3 torchLightColor(1.5f, 0.75f, 0.0f);
+    const float crystalLightRadius = 6.0f;
+    const glm::vec3 crystalLightColor(0.2f, 0.7f, 0.3f);
     float rotationAngle = 0.0f;
+    float lastStreamingReport = 0.0f;
+    bool meshingKeyWasDown = false;
+    bool renderKeyWasDown = false;
+    bool occlusionKeyWasDown = false;
+    bool raycastKeyWasDown = false;
+    bool noiseKeyWasDown = false;
+    bool determinismKeyWasDown = false;
+    bool layoutKeyWasDown = false;
+    bool packingKeyWasDown = false;
+    bool spatialHashKeyWasDown = false;
+    bool collisionEnabled = false;
+    bool collisionKeyWasDown = false;
+    const glm::vec3 cameraHalfExtents(0.25f, 0.25f, 0.25f); // Collision box around the eye, wider than the near plane
+    const float digReach = 8.0f;     // Furthest block the pick can reach
+    const float digRadius = 1.5f;    // Radius of the hollow each swing carves or fills
+    const float digInterval = 0.1f;  // Seconds between swings while a button is held
+    float lastDig = 0.0f;
 #pragma endregion
 
 #pragma region Render Loop
@@ -156,8 +223,175 @@ int main()
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
-        // Input
+        // Input. With collision on, the camera's movement this frame is swept against the cave instead
+        glm::vec3 previousPosition = camera.Position;
         processInput(window, deltaTime);
+        if (collisionEnabled) {
+            camera.Position = cave.sweepBox(previousPosition, cameraHalfExtents, camera.Position - previousPosition);
+        }
+
+        // Toggle camera collision with the cave
+        bool collisionKeyDown = glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS;
+        if (collisionKeyDown && !collisionKeyWasDown) {
+            collisionEnabled = !collisionEnabled;
+            std::cout << "Camera collision: " << (collisionEnabled ? "on" : "off") << std::endl;
+        }
+        collisionKeyWasDown = collisionKeyDown;
+
+        // Toggle between greedy and naive cave meshing
+        bool meshingKeyDown = glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS;
+        if (meshingKeyDown && !meshingKeyWasDown) {
+            bool greedy = cave.getMeshingMode() == CaveGenerator::MESHING_GREEDY;
+            cave.setMeshingMode(greedy ? CaveGenerator::MESHING_NAIVE : CaveGenerator::MESHING_GREEDY);
+            std::cout << "Cave meshing: " << (greedy ? "naive" : "greedy") << std::endl;
+        }
+        meshingKeyWasDown = meshingKeyDown;
+
+        // Toggle between face pulling and the vertex buffer fallback for the cave
+        bool renderKeyDown = glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS;
+        if (renderKeyDown && !renderKeyWasDown) {
+            bool pulling = cave.getRenderMode() == CaveGenerator::RENDER_FACE_PULLING;
+            cave.setRenderMode(pulling ? CaveGenerator::RENDER_VERTEX_BUFFER : CaveGenerator::RENDER_FACE_PULLING);
+            std::cout << "Cave rendering: " << (pulling ? "vertex buffers" : "face pulling") << std::endl;
+        }
+        renderKeyWasDown = renderKeyDown;
+
+        // Toggle the ambient occlusion baked into the cave meshes
+        bool occlusionKeyDown = glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS;
+        if (occlusionKeyDown && !occlusionKeyWasDown) {
+            cave.setAmbientOcclusion(!cave.getAmbientOcclusion());
+            std::cout << "Cave ambient occlusion: " << (cave.getAmbientOcclusion() ? "on" : "off") << std::endl;
+        }
+        occlusionKeyWasDown = occlusionKeyDown;
+
+        // Measure cave ray tracing throughput from the camera
+        bool raycastKeyDown = glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS;
+        if (raycastKeyDown && !raycastKeyWasDown) {
+            benchmarkRaycasts(cave, camera.Position);
+        }
+        raycastKeyWasDown = raycastKeyDown;
+
+        // Time cave generation with and without the noise octave early-out
+        bool noiseKeyDown = glfwGetKey(window, GLFW_KEY_F1) == GLFW_PRESS;
+        if (noiseKeyDown && !noiseKeyWasDown) {
+            benchmarkNoiseEarlyOut();
+        }
+        noiseKeyWasDown = noiseKeyDown;
+
+        // Check that the cave's seed generates the same cave whatever the thread count
+        bool determinismKeyDown = glfwGetKey(window, GLFW_KEY_F2) == GLFW_PRESS;
+        if (determinismKeyDown && !determinismKeyWasDown) {
+            checkDeterminism(cave.getSeed());
+        }
+        determinismKeyWasDown = determinismKeyDown;
+
+        // Time the flat voxel grid against the nested vectors it replaced
+        bool layoutKeyDown = glfwGetKey(window, GLFW_KEY_F3) == GLFW_PRESS;
+        if (layoutKeyDown && !layoutKeyWasDown) {
+            benchmarkVoxelLayout();
+        }
+        layoutKeyWasDown = layoutKeyDown;
+
+        // Check the packed cave vertices and face records against the faces they encode
+        bool packingKeyDown = glfwGetKey(window, GLFW_KEY_F4) == GLFW_PRESS;
+        if (packingKeyDown && !packingKeyWasDown) {
+            checkVertexPacking();
+        }
+        packingKeyWasDown = packingKeyDown;
+
+        // Time the spatial hash's queries against scanning every item
+        bool spatialHashKeyDown = glfwGetKey(window, GLFW_KEY_F5) == GLFW_PRESS;
+        if (spatialHashKeyDown && !spatialHashKeyWasDown) {
+            benchmarkSpatialHash();
+        }
+        spatialHashKeyWasDown = spatialHashKeyDown;
+
+        // Dig at the crosshair with the right mouse button, or fill the space in front of the hit
+        // block with the middle one. The edit is remeshed by the update below, so it shows this frame.
+        bool digDown = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS;
+        bool fillDown = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_MIDDLE) == GLFW_PRESS;
+        if ((digDown || fillDown) && currentFrame - lastDig >= digInterval) {
+            glm::ivec3 hitVoxel, lastEmptyVoxel;
+            if (cave.raycast(camera.Position, camera.Front, digReach, hitVoxel, lastEmptyVoxel)) {
+                if (digDown) {
+                    cave.carveSphere(CaveGenerator::voxelCentre(hitVoxel), digRadius);
+                }
+                else {
+                    cave.fillSphere(CaveGenerator::voxelCentre(lastEmptyVoxel), digRadius);
+                }
+                lastDig = currentFrame;
+            }
+        }
+
+        // Place a torch in front of the block at the crosshair with T, or take the last one back with Shift+T
+        bool torchKeyDown = glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS;
+        if (torchKeyDown && !torchKeyWasDown) {
+            if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS) {
+                if (!torchPositions.empty()) {
+                    cave.removeLight(torchPositions.back() + glm::vec3(0.0f, torchHeightOffset, 0.0f));
+                    torchIndex.remove(torchPositions.back() + glm::vec3(0.0f, torchHeightOffset, 0.0f), static_cast<uint32_t>(torchPositions.size() - 1));
+                    torchPositions.pop_back();
+                }
+            }
+            else {
+                glm::ivec3 hitVoxel, lastEmptyVoxel;
+                if (cave.raycast(camera.Position, camera.Front, digReach, hitVoxel, lastEmptyVoxel)) {
+                    // Stand the torch in the empty voxel so its light shines from inside it
+                    glm::vec3 lightPosition = CaveGenerator::voxelCentre(lastEmptyVoxel);
+                    torchPositions.push_back(lightPosition - glm::vec3(0.0f, torchHeightOffset, 0.0f));
+                    torchIndex.insert(lightPosition, static_cast<uint32_t>(torchPositions.size() - 1));
+                    cave.addLight(lightPosition, torchLightLevel);
+                }
+            }
+        }
+        torchKeyWasDown = torchKeyDown;
+
+        // Path trace the light of the torches and crystals with B and show it once it is done, or go
+        // back to the flood-filled light with Shift+B
+        bool bakeKeyDown = glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS;
+        if (bakeKeyDown && !bakeKeyWasDown) {
+            if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS) {
+                cave.setLightingMode(CaveGenerator::LIGHTING_FLOOD_FILL);
+                lightBakeRunning = false; // A bake in progress still finishes, but isn't shown
+                std::cout << "Cave lighting: flood fill" << std::endl;
+            }
+            else {
+                cave.startLightBake(lightBake);
+                lightBakeRunning = true;
+                std::cout << "Cave lighting: baking " << lightBake.samplesPerVoxel << " samples per voxel" << std::endl;
+            }
+        }
+        bakeKeyWasDown = bakeKeyDown;
+
+        // Stream cave chunks around the new camera position, and trace a slice of the light bake
+        cave.update(camera.Position, camera.Front);
+        if (lightBakeRunning && !cave.isBakingLight()) {
+            lightBakeRunning = false;
+            CaveGenerator::LightBakeStats bake = cave.getLightBakeStats();
+            cave.setLightingMode(CaveGenerator::LIGHTING_PATH_TRACED);
+            std::cout << "Cave lighting: path traced, " << bake.voxels << " voxels in " << bake.chunks << " chunks, "
+                      << bake.samplesPerVoxel << " of " << lightBake.samplesPerVoxel << " samples per voxel, " << bake.rays << " rays in "
+                      << bake.milliseconds << " ms (" << bake.rays / std::max(bake.milliseconds, 1.0) / 1000.0 << " Mrays/s)" << std::endl;
+        }
+
+        // Report the cave generation pipeline every few seconds
+        if (currentFrame - lastStreamingReport > 5.0f) {
+            lastStreamingReport = currentFrame;
+            CaveGenerator::StreamingStats streamingStats = cave.getStreamingStats();
+            std::cout << "Cave streaming: " << cave.getLoadedChunkCount() << " chunks, "
+                      << cave.getVertexCount() << " vertices (" << cave.getUnitFaceVertexCount() << " as unit faces), "
+                      << cave.getMeshBytes() / 1024 << " KB of meshes, "
+                      << cave.getVoxelBytes() / 1024 << " KB of voxels (" << cave.getUniformChunkCount() << " chunks of one material), "
+                      << streamingStats.jobsInFlight << " jobs in flight, "
+                      << streamingStats.uploadQueueDepth << " waiting for upload, upload latency "
+                      << streamingStats.averageUploadLatencyMs << " ms avg / "
+                      << streamingStats.maxUploadLatencyMs << " ms max, last light update "
+                      << streamingStats.lightVoxelsLastUpdate << " voxels in " << streamingStats.lightUpdateMs << " ms" << std::endl;
+            ClusteredLights::Stats clusterStats = clusteredLights.getStats();
+            std::cout << "Clustered lights: " << clusterStats.visibleLights << " of " << clusterStats.lights << " in view, "
+                      << clusterStats.indices << " cluster entries (at most " << clusterStats.maxClusterLights << " in a cluster), assigned in "
+                      << clusterStats.assignMs << " ms, uploaded in " << clusterStats.uploadMs << " ms" << std::endl;
+        }
 
         // Rendering commands here
         glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
@@ -167,110 +401,144 @@ int main()
         glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom),
             (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
         glm::mat4 view = camera.getViewMatrix();
+
+        // Gather the point lights that reach the view and bin them into its clusters
+        glm::mat4 viewProjection = projection * view;
+        pointLights.clear();
+        torchIndex.queryFrustum(viewProjection, torchLightRadius, [&](const SpatialHash::Item& torch) {
+            ClusteredLights::PointLight light;
+            light.position = torch.position;
+            light.radius = torchLightRadius;
+            light.color = torchLightColor;
+            pointLights.push_back(light);
+        });
+        const glm::vec3 crystalCentre(0.5f, 0.5f, -0.5f); // From a crystal's voxel corner to the middle of the drawn crystal
+        cave.getCrystalIndex().queryFrustum(viewProjection, crystalLightRadius + glm::length(crystalCentre), [&](const SpatialHash::Item& crystal) {
+            ClusteredLights::PointLight light;
+            light.position = crystal.position + crystalCentre;
+            light.radius = crystalLightRadius;
+            light.color = crystalLightColor;
+            pointLights.push_back(light);
+        });
+        clusteredLights.update(pointLights, view, glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
 #pragma region crystal
         // Render Crystals
-        for (const auto& pos : cave.getCrystalPositions()) {
-            glm::mat4 crystalModelMatrix = glm::mat4(1.0f);
-
-            glm::vec3 offset(0.5f, 0.0f, -0.5f); // Offset so blocks aren't in corners
-
-            glm::vec3 adjustedPos = pos + offset;
+        // Every crystal is an instance of one model, drawn in a single call per mesh. Their transforms
+        // are only rebuilt when the cave's crystal list changes
+        if (cave.getCrystalListVersion() != crystalInstanceVersion) {
+            crystalInstanceVersion = cave.getCrystalListVersion();
+            crystalTransforms.clear();
+            for (const auto& pos : cave.getCrystalPositions()) {
+                glm::mat4 crystalModelMatrix = glm::mat4(1.0f);
+
+                glm::vec3 offset(0.5f, 0.0f, -0.5f); // Offset so blocks aren't in corners
+
+                glm::vec3 adjustedPos = pos + offset;
+
+                crystalModelMatrix = glm::translate(crystalModelMatrix, adjustedPos);
+                crystalModelMatrix = glm::scale(crystalModelMatrix, glm::vec3(0.8f, 0.8f, 0.8f)); // Scale if needed
+                crystalTransforms.push_back(crystalModelMatrix);
+            }
+            crystal.setInstances(crystalTransforms);
+        }
 
-            crystalModelMatrix = glm::translate(crystalModelMatrix, adjustedPos);
-            crystalModelMatrix = glm::scale(crystalModelMatrix, glm::vec3(0.8f, 0.8f, 0.8f)); // Scale if needed
+        crystalShader.use();
+        crystalShader.setInt("texture1", 0);
 
-            crystalShader.use();
-            crystalShader.setInt("texture1", 0);
+        crystalShader.setMat4("projection", projection);
+        crystalShader.setMat4("view", view);
 
-            crystalShader.setMat4("projection", projection);
-            crystalShader.setMat4("view", view);
-            crystalShader.setMat4("model", crystalModelMatrix);
+        crystalShader.setVec3("viewPos", camera.Position);
 
-            crystalShader.setVec3("viewPos", camera.Position);
+        crystalShader.setFloat("maxGlowIntensity", 0.5f); // Prevents the glow from becoming too intense
+        crystalShader.setFloat("glowVisibilityDistance", 2.0f); // Sets the distance at which the glow is fully visible
+        crystalShader.setFloat("glowFactor", 0.001f); // Adjust this factor to control the attenuation of the glow
 
-            crystalShader.setFloat("maxGlowIntensity", 0.5f); // Prevents the glow from becoming too intense
-            crystalShader.setFloat("glowVisibilityDistance", 2.0f); // Sets the distance at which the glow is fully visible
-            crystalShader.setFloat("glowFactor", 0.001f); // Adjust this factor to control the attenuation of the glow
+        crystalShader.setVec3("ambientLight", glm::vec3(1.0f)); // Crystals keep their full texture colour
+        clusteredLights.bind(crystalShader, framebufferWidth, framebufferHeight);
 
-            crystal.Draw(crystalShader, crystalModelMatrix);
-        }
+        crystal.DrawInstanced(crystalShader);
 #pragma endregion
 
 #pragma region torch
-        torchShader.use();
-
-        // Set the torch position and scale
-        glm::vec3 torchPosition = glm::vec3(29.8f, 42.0f, 25.0f); // Torch's position
-        glm::mat4 torchModel = glm::mat4(1.0f);
-        torchModel = glm::translate(torchModel, torchPosition);
-        torchModel = glm::scale(torchModel, glm::vec3(1.0f, 1.0f, 1.0f));
-        torchModel = glm::rotate(torchModel, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-
-        // Set the light properties
-        torchShader.setVec3("torchPos", torchPosition); // Use the same position for lightPos
-        torchShader.setVec3("viewPos", camera.Position);
-        torchShader.setVec3("lightColor", glm::vec3(1.0f, 0.5f, 0.0f)); // Dim orange light
-        torchShader.setVec3("objectColor", glm::vec3(1.0f, 1.0f, 1.0f)); // Torch color
-
-        // Bind texture if the torch model uses one
-        glActiveTexture(GL_TEXTURE0);
-        // glBindTexture(GL_TEXTURE_2D, torchTexture); // Bind the actual texture of the torch here
-        torchShader.setInt("texture1", 0);
-
-        // Set the matrices
-        torchShader.setMat4("projection", projection);
-        torchShader.setMat4("view", view);
-        torchShader.setMat4("model", torchModel);
-
-        // Draw the torch
-        torch.Draw(torchShader, torchModel);
+        for (const glm::vec3& torchPosition : torchPositions) {
+            torchShader.use();
+
+            // Set the torch position and scale
+            glm::mat4 torchModel = glm::mat4(1.0f);
+            torchModel = glm::translate(torchModel, torchPosition);
+            torchModel = glm::scale(torchModel, glm::vec3(1.0f, 1.0f, 1.0f));
+            torchModel = glm::rotate(torchModel, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+            // Set the light properties
+            torchShader.setVec3("torchPos", torchPosition); // Use the same position for lightPos
+            torchShader.setVec3("viewPos", camera.Position);
+            torchShader.setVec3("lightColor", glm::vec3(1.0f, 0.5f, 0.0f)); // Dim orange light
+            torchShader.setVec3("objectColor", glm::vec3(1.0f, 1.0f, 1.0f)); // Torch color
+
+            // Bind texture if the torch model uses one
+            glActiveTexture(GL_TEXTURE0);
+            // glBindTexture(GL_TEXTURE_2D, torchTexture); // Bind the actual texture of the torch here
+            torchShader.setInt("texture1", 0);
+
+            // Set the matrices
+            torchShader.setMat4("projection", projection);
+            torchShader.setMat4("view", view);
+            torchShader.setMat4("model", torchModel);
+
+            // Draw the torch
+            torch.Draw(torchShader, torchModel);
+        }
 #pragma endregion
 
 #pragma region cave
-        float torchHeightOffset = 1.2f; // so the light is at the top of the torch
-        torchPosition.y += torchHeightOffset; // Move the light source up
         // Render Cave
-        caveShader.use();
-
         // Bind texture
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, texture);
         glActiveTexture(GL_TEXTURE1);
         glBindTexture(GL_TEXTURE_2D, texture2);
 
+        // Pulled and vertex buffer chunks use different vertex shaders but the same fragment shader
+        for (Shader* shader : { &caveShader, &cavePullShader }) {
+            shader->use();
 
-        caveShader.setVec3("torchPos", torchPosition);
-        caveShader.setVec3("torchLightColor", glm::vec3(1.0f, 0.5f, 0.0f)); // Orange light
+            shader->setVec3("torchLightColor", glm::vec3(1.0f, 0.5f, 0.0f)); // Orange light, baked into the cave meshes
 
-        caveShader.setInt("texture1", 0);  // Assuming your shader has a uniform named 'texture1'
-        caveShader.setInt("texture2", 1);
-        caveShader.setFloat("blendFactor", 0.3f);
-        caveShader.setFloat("cameraY", camera.Position.y);
+            shader->setInt("texture1", 0);  // Assuming your shader has a uniform named 'texture1'
+            shader->setInt("texture2", 1);
+            shader->setFloat("blendFactor", 0.3f);
+            shader->setFloat("cameraY", camera.Position.y);
 
-        caveShader.setMat4("projection", projection);
-        caveShader.setMat4("view", view);
-        glm::mat4 caveModel = glm::mat4(1.0f); // Apply transformations as needed
-        caveShader.setMat4("model", caveModel);
+            shader->setMat4("projection", projection);
+            shader->setMat4("view", view);
+            glm::mat4 caveModel = glm::mat4(1.0f); // Apply transformations as needed
+            shader->setMat4("model", caveModel);
 
-        // Set the color of the cave walls (earthy brownish-grey)
-        caveShader.setVec3("objectColor", glm::vec3(0.55f, 0.5f, 0.45f));
+            // Set the color of the cave walls (earthy brownish-grey)
+            shader->setVec3("objectColor", glm::vec3(0.55f, 0.5f, 0.45f));
 
-        // Set the primary light to mimic an old lantern (dim yellowish light)
-        caveShader.setVec3("lightColor", glm::vec3(0.98f, 0.88f, 0.72f));
-        caveShader.setVec3("lightDir", glm::normalize(glm::vec3(0.5f, -1.0f, 0.5f)));
-        caveShader.setVec3("ambientStrength", glm::vec3(0.15f, 0.15f, 0.15f));
+            // Set the primary light to mimic an old lantern (dim yellowish light)
+            shader->setVec3("lightColor", glm::vec3(0.98f, 0.88f, 0.72f));
+            shader->setVec3("lightDir", glm::normalize(glm::vec3(0.5f, -1.0f, 0.5f)));
+            shader->setVec3("ambientStrength", glm::vec3(0.15f, 0.15f, 0.15f));
 
-        // Set the secondary light for contrast (softer, cooler light)
-        caveShader.setVec3("secondLightDir", glm::normalize(glm::vec3(-0.5f, -1.0f, -0.5f)));
-        caveShader.setVec3("secondLightColor", glm::vec3(0.6f, 0.7f, 0.8f));
-        caveShader.setVec3("secondAmbientStrength", glm::vec3(0.05f, 0.05f, 0.05f));
+            // Set the secondary light for contrast (softer, cooler light)
+            shader->setVec3("secondLightDir", glm::normalize(glm::vec3(-0.5f, -1.0f, -0.5f)));
+            shader->setVec3("secondLightColor", glm::vec3(0.6f, 0.7f, 0.8f));
+            shader->setVec3("secondAmbientStrength", glm::vec3(0.05f, 0.05f, 0.05f));
+        }
 
         // Render the cave
-        cave.render(); // This binds its own VAO and use its own vertex data
+        cave.render(caveShader, cavePullShader); // This binds its own VAO and use its own vertex data
 #pragma endregion
 
 #pragma region mineshaft
         ourShader.use();
+        ourShader.setVec3("ambientLight", glm::vec3(0.5f)); // Models in the dark pick up the torches and crystals
+        clusteredLights.bind(ourShader, framebufferWidth, framebufferHeight);
 
         ourShader.setMat4("projection", projection);
         ourShader.setMat4("view", view);
@@ -288,6 +556,8 @@ int main()
 
 #pragma region pick
         animShader.use();
+        animShader.setVec3("ambientLight", glm::vec3(0.5f));
+        clusteredLights.bind(animShader, framebufferWidth, framebufferHeight);
 
         animShader.setMat4("projection", projection);
         animShader.setMat4("view", view);
@@ -426,4 +696,439 @@ void PrintMatrix(const glm::mat4& mat) {
         }
         std::cout << std::endl;
     }
-}
\ No newline at end of file
+}
+
+// Microbenchmark for cave ray tracing. Casts 100,000 rays in random directions from a point, one at
+// a time on this thread and then as a single batch across the worker threads, and prints the
+// throughput of each in rays per second.
+// Parameters:
+//   - cave: The cave to trace.
+//   - origin: World-space start of every ray.
+void benchmarkRaycasts(const CaveGenerator& cave, const glm::vec3& origin) {
+    const int rayCount = 100000;
+    const float maxDistance = 128.0f;
+    std::mt19937 random(12345);
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+    std::vector<CaveGenerator::RayQuery> queries(rayCount);
+    for (CaveGenerator::RayQuery& query : queries) {
+        query.origin = origin;
+        query.direction = glm::vec3(normal(random), normal(random), normal(random)); // Uniform over the sphere once normalized
+        query.maxDistance = maxDistance;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    int hits = 0;
+    glm::ivec3 hitVoxel, lastEmptyVoxel;
+    for (const CaveGenerator::RayQuery& query : queries) {
+        hits += cave.raycast(query.origin, query.direction, query.maxDistance, hitVoxel, lastEmptyVoxel) ? 1 : 0;
+    }
+    auto middle = std::chrono::high_resolution_clock::now();
+    std::vector<CaveGenerator::RayHit> results;
+    cave.raycastBatch(queries, results);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    double singleSeconds = std::chrono::duration<double>(middle - start).count();
+    double batchSeconds = std::chrono::duration<double>(end - middle).count();
+    std::cout << "Raycast benchmark: " << rayCount << " rays up to " << maxDistance << " voxels, "
+              << hits << " hits, " << rayCount / singleSeconds << " rays/s on one thread, "
+              << rayCount / batchSeconds << " rays/s batched" << std::endl;
+}
+
+// Benchmark for the noise octave early-out. Generates the same bounded cave with exact noise and
+// with the early-out, at the default 3 octaves and at 6, best of three runs each, and prints the
+// time each takes; generateCave itself reports the share of octaves the early-out skipped. The
+// times include meshing, which is the same either way. Both must give the same volume, so a
+// mismatch is reported as a failure.
+void benchmarkNoiseEarlyOut() {
+    const int caveDepth = 128, caveWidth = 128, caveHeight = 96;
+    const int runs = 3;
+    for (int octaves : { 3, 6 }) {
+        double bestMs[2] = { 1e30, 1e30 };
+        uint64_t hashes[2] = { 0, 0 };
+        for (int run = 0; run < runs; ++run) {
+            for (int exact = 0; exact < 2; ++exact) {
+                CaveGenerator bench(caveDepth, caveWidth, caveHeight, 0.5f);
+                bench.setNoiseOctaves(octaves);
+                bench.setExactNoise(exact == 1);
+                auto start = std::chrono::high_resolution_clock::now();
+                bench.generateCave();
+                auto end = std::chrono::high_resolution_clock::now();
+                bestMs[exact] = std::min(bestMs[exact], std::chrono::duration<double, std::milli>(end - start).count());
+                hashes[exact] = bench.volumeHash();
+            }
+        }
+        std::cout << "Noise benchmark, " << octaves << " octaves: " << bestMs[1] << " ms exact, "
+                  << bestMs[0] << " ms with the early-out" << std::endl;
+        if (hashes[0] != hashes[1]) {
+            std::cerr << "Noise benchmark FAILED: the early-out changed the volume at " << octaves << " octaves" << std::endl;
+        }
+    }
+}
+
+// Determinism check for cave generation. Generates a bounded cave and its crystals from the same
+// seed twice on one thread, then on two threads and on every hardware thread, and compares each
+// volumeHash() and crystal list with the first. Any difference is reported as a failure.
+// Parameters:
+//   - seed: The seed to generate from.
+void checkDeterminism(uint64_t seed) {
+    const int caveDepth = 96, caveWidth = 96, caveHeight = 64;
+    const unsigned int threadCounts[] = { 1, 1, 2, 0 }; // 0 is the hardware concurrency
+    const char* threadNames[] = { "1 thread", "1 thread", "2 threads", "all threads" };
+    uint64_t firstHash = 0;
+    std::vector<glm::vec3> firstCrystals;
+    bool passed = true;
+    for (size_t run = 0; run < sizeof(threadCounts) / sizeof(threadCounts[0]); ++run) {
+        CaveGenerator check(caveDepth, caveWidth, caveHeight, 0.5f, threadCounts[run]);
+        check.setSeed(seed);
+        check.generateCave();
+        check.generateCrystals();
+        uint64_t hash = check.volumeHash();
+        // Crystals are placed by the workers, so compare them in a fixed order
+        std::vector<glm::vec3> crystals = check.getCrystalPositions();
+        std::sort(crystals.begin(), crystals.end(), [](const glm::vec3& a, const glm::vec3& b) {
+            return a.x != b.x ? a.x < b.x : (a.y != b.y ? a.y < b.y : a.z < b.z);
+        });
+        if (run == 0) {
+            firstHash = hash;
+            firstCrystals = crystals;
+        }
+        else if (hash != firstHash || crystals != firstCrystals) {
+            std::cerr << "Determinism check FAILED: seed " << seed << " on " << threadNames[run] << " gave volume hash "
+                      << std::hex << hash << " and " << crystals.size() << " crystals, expected " << firstHash << " and "
+                      << firstCrystals.size() << std::dec << std::endl;
+            passed = false;
+        }
+    }
+    if (passed) {
+        std::cout << "Determinism check passed: seed " << seed << ", volume hash " << std::hex << firstHash << std::dec
+                  << ", " << firstCrystals.size() << " crystals, the same on 1, 2 and all threads" << std::endl;
+    }
+}
+
+// Benchmark for the cave's voxel storage. Times the nested vectors the cave used to be stored in
+// against the flat VoxelGrid with its ghost ring, at the old default size and a large one, over the
+// steps generateCave used to take on the whole volume: constructing it, filling it with a row of
+// noise at a time and counting the rock faces exposed to air, which the nested layout needs bounds
+// checks for. Both layouts must count the same faces, so a mismatch is reported as a failure.
+void benchmarkVoxelLayout() {
+    const int sizes[2][3] = { { 75, 50, 75 }, { 512, 256, 512 } }; // Depth, width and height, as CaveGenerator takes them
+    const float scale = 0.05f;
+    const float threshold = 0.5f;
+    const float air = 1.0e30f; // Noise outside the volume
+    for (const auto& size : sizes) {
+        const int depth = size[0], width = size[1], height = size[2];
+        std::vector<float> px(width);
+        for (int x = 0; x < width; ++x) {
+            px[x] = x * scale;
+        }
+        auto elapsed = [](std::chrono::high_resolution_clock::time_point from, std::chrono::high_resolution_clock::time_point to) {
+            return std::chrono::duration<double, std::milli>(to - from).count();
+        };
+
+        // Nested vectors, indexed [z][y][x]
+        double nestedMs[3];
+        size_t nestedFaces = 0;
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            std::vector<std::vector<std::vector<float>>> nested(depth, std::vector<std::vector<float>>(height, std::vector<float>(width, 0.0f)));
+            auto built = std::chrono::high_resolution_clock::now();
+            for (int z = 0; z < depth; ++z) {
+                for (int y = 0; y < height; ++y) {
+                    accumulatePerlinRow(px.data(), y * scale, z * scale, 1.0f, nested[z][y].data(), width);
+                }
+            }
+            auto filled = std::chrono::high_resolution_clock::now();
+            auto solid = [&](int x, int y, int z) {
+                if (x < 0 || y < 0 || z < 0 || x >= width || y >= height || z >= depth) return false;
+                return nested[z][y][x] < threshold;
+            };
+            for (int z = 0; z < depth; ++z) {
+                for (int y = 0; y < height; ++y) {
+                    for (int x = 0; x < width; ++x) {
+                        if (!solid(x, y, z)) continue;
+                        nestedFaces += !solid(x + 1, y, z) + !solid(x - 1, y, z) + !solid(x, y + 1, z) +
+                                       !solid(x, y - 1, z) + !solid(x, y, z + 1) + !solid(x, y, z - 1);
+                    }
+                }
+            }
+            auto counted = std::chrono::high_resolution_clock::now();
+            nestedMs[0] = elapsed(start, built);
+            nestedMs[1] = elapsed(built, filled);
+            nestedMs[2] = elapsed(filled, counted);
+        }
+
+        // Flat grid, whose ghost ring stands in for the bounds checks
+        double flatMs[3];
+        size_t flatFaces = 0;
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            VoxelGrid grid(width, height, depth, air);
+            auto built = std::chrono::high_resolution_clock::now();
+            for (int z = 0; z < depth; ++z) {
+                for (int y = 0; y < height; ++y) {
+                    float* row = grid.row(y, z);
+                    std::fill(row, row + width, 0.0f);
+                    accumulatePerlinRow(px.data(), y * scale, z * scale, 1.0f, row, width);
+                }
+            }
+            auto filled = std::chrono::high_resolution_clock::now();
+            const int strideY = grid.getStrideY();
+            const int strideZ = grid.getStrideZ();
+            for (int z = 0; z < depth; ++z) {
+                for (int y = 0; y < height; ++y) {
+                    int index = grid.index(0, y, z);
+                    for (int x = 0; x < width; ++x, ++index) {
+                        if (!(grid[index] < threshold)) continue;
+                        flatFaces += !(grid[index + 1] < threshold) + !(grid[index - 1] < threshold) +
+                                     !(grid[index + strideY] < threshold) + !(grid[index - strideY] < threshold) +
+                                     !(grid[index + strideZ] < threshold) + !(grid[index - strideZ] < threshold);
+                    }
+                }
+            }
+            auto counted = std::chrono::high_resolution_clock::now();
+            flatMs[0] = elapsed(start, built);
+            flatMs[1] = elapsed(built, filled);
+            flatMs[2] = elapsed(filled, counted);
+        }
+
+        std::cout << "Voxel layout benchmark, " << depth << "x" << width << "x" << height << ": nested vectors "
+                  << nestedMs[0] << " ms to construct, " << nestedMs[1] << " ms to fill, " << nestedMs[2] << " ms to count faces; flat grid "
+                  << flatMs[0] << " ms, " << flatMs[1] << " ms, " << flatMs[2] << " ms" << std::endl;
+        if (nestedFaces != flatFaces) {
+            std::cerr << "Voxel layout benchmark FAILED: " << nestedFaces << " faces in the nested vectors, "
+                      << flatFaces << " in the flat grid" << std::endl;
+        }
+    }
+}
+
+// Check of the packed cave vertices and face records. Packs faces of every direction, light level
+// and a spread of positions, sizes and corner occlusions, decodes them on the CPU the way both cave
+// vertex shaders do (Vertex::unpack for the vertex buffers, unpackFace for face pulling), and
+// compares the result with the voxel faces they were packed from: the corners of the face's
+// rectangle, its normal, light and corner occlusion, a texture repeating once per block, and
+// triangles wound the same way as every other face of their direction. Any difference is reported
+// as a failure.
+void checkVertexPacking() {
+    // Per SolidityMask::Face: the normal, and the axes the face's columns and rows run along
+    const glm::vec3 normals[SolidityMask::FACE_COUNT] = {
+        glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f),
+        glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)
+    };
+    const int columnAxis[SolidityMask::FACE_COUNT] = { 2, 2, 0, 0, 0, 0 };
+    const int rowAxis[SolidityMask::FACE_COUNT] = { 1, 1, 2, 2, 1, 1 };
+    const glm::ivec3 origin(-64, 32, 96); // Any chunk's first voxel
+    const int blocks[] = { 0, 1, 17, CHUNK_SIZE - 1 };
+    const int sizes[] = { 1, 3, CHUNK_SIZE };
+    const int occlusions[] = { 0xFF, 0x00, 0x1B, 0xE4, 0x36, 0x8D }; // Four 2-bit corners each
+
+    size_t faces = 0, failures = 0;
+    // Sign of the first triangle's winding about its normal, per direction. Top and bottom faces
+    // have always been wound the other way round from the rest, and nothing culls back faces, so
+    // only consistency is checked.
+    float winding[SolidityMask::FACE_COUNT] = {};
+    auto fail = [&](const char* what, uint64_t faceRecord) {
+        if (failures++ < 10) {
+            std::cerr << "Vertex packing check FAILED: " << what << " for face record 0x" << std::hex << faceRecord << std::dec << std::endl;
+        }
+    };
+    // Checks one decoded vertex against the face; corner00 is where the texture starts
+    auto checkVertex = [&](uint64_t faceRecord, int face, int light, int occlusion, const glm::vec3 corners[4], const glm::vec3& corner00,
+                           const glm::vec3& position, const glm::vec3& normal, const glm::vec2& texCoords, float decodedLight, float decodedOcclusion) {
+        if (std::find(corners, corners + 4, position) == corners + 4) fail("position off the face's corners", faceRecord);
+        if (normal != normals[face]) fail("wrong normal", faceRecord);
+        if (texCoords.x != std::abs(position[columnAxis[face]] - corner00[columnAxis[face]]) ||
+            texCoords.y != std::abs(position[rowAxis[face]] - corner00[rowAxis[face]])) {
+            fail("texture not repeating once per block", faceRecord);
+        }
+        if (decodedLight != light / 15.0f) fail("wrong light", faceRecord);
+        int corner = (texCoords.x == 0.0f) ? (texCoords.y == 0.0f ? 0 : 1) : (texCoords.y == 0.0f ? 3 : 2);
+        if (decodedOcclusion != ((occlusion >> (corner * 2)) & 3) / 3.0f) fail("wrong occlusion", faceRecord);
+    };
+    auto checkTriangle = [&](uint64_t faceRecord, int face, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+        float side = glm::dot(glm::cross(b - a, c - a), normals[face]);
+        if (winding[face] == 0.0f) winding[face] = side;
+        if (side == 0.0f || (side > 0.0f) != (winding[face] > 0.0f)) fail("triangle wound the wrong way", faceRecord);
+    };
+
+    for (int face = 0; face < SolidityMask::FACE_COUNT; ++face) {
+        const int normalAxis = face / 2;
+        for (int x : blocks) for (int y : blocks) for (int z : blocks) {
+            for (int columns : sizes) for (int rows : sizes) {
+                for (int light = 0; light < 16; ++light) {
+                    for (int occlusion : occlusions) {
+                        uint64_t faceRecord = CaveGenerator::packFace(x, y, z, static_cast<SolidityMask::Face>(face), columns, rows, light, occlusion);
+                        ++faces;
+
+                        // The voxels the face covers; voxel (x, y, z) fills [x, x + 1] x [y, y + 1] x [z - 1, z]
+                        glm::vec3 low = glm::vec3(origin + glm::ivec3(x, y, z - 1));
+                        glm::vec3 high = low + glm::vec3(1.0f);
+                        high[columnAxis[face]] += static_cast<float>(columns - 1);
+                        high[rowAxis[face]] += static_cast<float>(rows - 1);
+                        glm::vec3 corners[4];
+                        for (int i = 0; i < 4; ++i) {
+                            corners[i][normalAxis] = (face % 2 == 0) ? high[normalAxis] : low[normalAxis];
+                            corners[i][columnAxis[face]] = (i & 1) ? high[columnAxis[face]] : low[columnAxis[face]];
+                            corners[i][rowAxis[face]] = (i & 2) ? high[rowAxis[face]] : low[rowAxis[face]];
+                        }
+
+                        // Vertex buffer path: four vertices, drawn as triangles 0 1 2 and 0 2 3
+                        std::vector<CaveGenerator::Vertex> vertices;
+                        CaveGenerator::addFace(vertices, faceRecord);
+                        glm::vec3 positions[4], normal;
+                        glm::vec2 texCoords[4];
+                        float decodedLight[4], decodedOcclusion[4];
+                        for (int i = 0; i < 4; ++i) {
+                            vertices[i].unpack(origin, positions[i], normal, texCoords[i], decodedLight[i], decodedOcclusion[i]);
+                            if (normal != normals[face]) fail("wrong vertex normal", faceRecord);
+                        }
+                        glm::vec3 corner00 = positions[0];
+                        for (int i = 0; i < 4; ++i) {
+                            if (texCoords[i] == glm::vec2(0.0f)) corner00 = positions[i];
+                        }
+                        for (int i = 0; i < 4; ++i) {
+                            checkVertex(faceRecord, face, light, occlusion, corners, corner00, positions[i], normals[face], texCoords[i],
+                                        decodedLight[i], decodedOcclusion[i]);
+                            for (int j = 0; j < i; ++j) {
+                                if (positions[i] == positions[j]) fail("vertices sharing a corner", faceRecord);
+                            }
+                        }
+                        checkTriangle(faceRecord, face, positions[0], positions[1], positions[2]);
+                        checkTriangle(faceRecord, face, positions[0], positions[2], positions[3]);
+
+                        // Face pulling: six vertices, two triangles
+                        glm::vec3 pulled[6];
+                        for (int i = 0; i < 6; ++i) {
+                            glm::vec2 pulledTexCoords;
+                            float pulledLight, pulledOcclusion;
+                            CaveGenerator::unpackFace(faceRecord, i, origin, pulled[i], normal, pulledTexCoords, pulledLight, pulledOcclusion);
+                            checkVertex(faceRecord, face, light, occlusion, corners, corner00, pulled[i], normal, pulledTexCoords,
+                                        pulledLight, pulledOcclusion);
+                        }
+                        checkTriangle(faceRecord, face, pulled[0], pulled[1], pulled[2]);
+                        checkTriangle(faceRecord, face, pulled[3], pulled[4], pulled[5]);
+                    }
+                }
+            }
+        }
+    }
+    if (failures == 0) {
+        std::cout << "Vertex packing check passed: " << faces << " faces decode to the faces they were packed from" << std::endl;
+    }
+    else {
+        std::cerr << "Vertex packing check FAILED: " << failures << " mismatches over " << faces << " faces" << std::endl;
+    }
+}
+
+// Benchmark for the spatial hash the crystals and torches are indexed in. Scatters 100,000 points
+// through a 512 voxel cube, about a crystal per 1,300 voxels like a cave that size grows, then runs
+// radius, box and frustum queries through the hash and as a linear scan over every point, and
+// prints the time per query of each. Both must find the same points, so a mismatch is reported as
+// a failure.
+void benchmarkSpatialHash() {
+    const int itemCount = 100000;
+    const float extent = 512.0f;
+    const int queryCount = 1000;
+    const float radius = 16.0f;        // About the reach of a light
+    const float boxHalfSize = 16.0f;
+    const float frustumMargin = 6.0f;  // A crystal's light radius
+    std::mt19937 random(12345);
+    std::uniform_real_distribution<float> coordinate(0.0f, extent);
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+
+    SpatialHash index;
+    std::vector<glm::vec3> positions(itemCount);
+    for (int i = 0; i < itemCount; ++i) {
+        positions[i] = glm::vec3(coordinate(random), coordinate(random), coordinate(random));
+        index.insert(positions[i], static_cast<uint32_t>(i));
+    }
+    std::vector<glm::vec3> centres(queryCount);
+    std::vector<glm::mat4> frustums(queryCount);
+    for (int i = 0; i < queryCount; ++i) {
+        centres[i] = glm::vec3(coordinate(random), coordinate(random), coordinate(random));
+        glm::vec3 direction(normal(random), normal(random), normal(random)); // Uniform over the sphere once normalized
+        glm::vec3 up = (std::abs(direction.y) > 0.99f * glm::length(direction)) ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        frustums[i] = glm::perspective(glm::radians(45.0f), static_cast<float>(SCR_WIDTH) / SCR_HEIGHT, 0.1f, 100.0f)
+                    * glm::lookAt(centres[i], centres[i] + direction, up);
+    }
+
+    // Visited ids are summed, so the hash and the scan can be compared without sorting
+    auto elapsed = [](std::chrono::high_resolution_clock::time_point from, std::chrono::high_resolution_clock::time_point to) {
+        return std::chrono::duration<double, std::micro>(to - from).count() / queryCount;
+    };
+    auto report = [](const char* query, double hashMicros, double scanMicros, uint64_t hashFound, uint64_t scanFound,
+                     uint64_t hashSum, uint64_t scanSum) {
+        std::cout << "Spatial hash benchmark, " << query << ": " << hashMicros << " us per query, " << scanMicros << " us scanning, "
+                  << hashFound / static_cast<double>(queryCount) << " found per query" << std::endl;
+        if (hashFound != scanFound || hashSum != scanSum) {
+            std::cerr << "Spatial hash benchmark FAILED: " << query << " queries found " << hashFound << " items, the scan "
+                      << scanFound << std::endl;
+        }
+    };
+
+    {
+        uint64_t hashFound = 0, hashSum = 0, scanFound = 0, scanSum = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (const glm::vec3& centre : centres) {
+            index.queryRadius(centre, radius, [&](const SpatialHash::Item& item) { ++hashFound; hashSum += item.id; });
+        }
+        auto middle = std::chrono::high_resolution_clock::now();
+        for (const glm::vec3& centre : centres) {
+            for (int i = 0; i < itemCount; ++i) {
+                glm::vec3 offset = positions[i] - centre;
+                if (glm::dot(offset, offset) <= radius * radius) { ++scanFound; scanSum += i; }
+            }
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        report("radius", elapsed(start, middle), elapsed(middle, end), hashFound, scanFound, hashSum, scanSum);
+    }
+
+    {
+        uint64_t hashFound = 0, hashSum = 0, scanFound = 0, scanSum = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (const glm::vec3& centre : centres) {
+            index.queryBox(centre - glm::vec3(boxHalfSize), centre + glm::vec3(boxHalfSize),
+                           [&](const SpatialHash::Item& item) { ++hashFound; hashSum += item.id; });
+        }
+        auto middle = std::chrono::high_resolution_clock::now();
+        for (const glm::vec3& centre : centres) {
+            glm::vec3 min = centre - glm::vec3(boxHalfSize), max = centre + glm::vec3(boxHalfSize);
+            for (int i = 0; i < itemCount; ++i) {
+                const glm::vec3& p = positions[i];
+                if (p.x >= min.x && p.y >= min.y && p.z >= min.z && p.x <= max.x && p.y <= max.y && p.z <= max.z) { ++scanFound; scanSum += i; }
+            }
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        report("box", elapsed(start, middle), elapsed(middle, end), hashFound, scanFound, hashSum, scanSum);
+    }
+
+    {
+        uint64_t hashFound = 0, hashSum = 0, scanFound = 0, scanSum = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (const glm::mat4& frustum : frustums) {
+            index.queryFrustum(frustum, frustumMargin, [&](const SpatialHash::Item& item) { ++hashFound; hashSum += item.id; });
+        }
+        auto middle = std::chrono::high_resolution_clock::now();
+        for (const glm::mat4& frustum : frustums) {
+            // The same planes as queryFrustum, pointing inwards and normalized
+            glm::vec4 planes[6];
+            for (int i = 0; i < 3; ++i) {
+                glm::vec4 row(frustum[0][i], frustum[1][i], frustum[2][i], frustum[3][i]);
+                glm::vec4 last(frustum[0][3], frustum[1][3], frustum[2][3], frustum[3][3]);
+                planes[i * 2] = last + row;
+                planes[i * 2 + 1] = last - row;
+            }
+            for (glm::vec4& plane : planes) {
+                plane = plane / glm::length(glm::vec3(plane));
+            }
+            for (int i = 0; i < itemCount; ++i) {
+                bool inside = true;
+                for (int p = 0; p < 6 && inside; ++p) {
+                    inside = glm::dot(glm::vec3(planes[p]), positions[i]) + planes[p].w >= -frustumMargin;
+                }
+                if (inside) { ++scanFound; scanSum += i; }
+            }
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        report("frustum", elapsed(start, middle), elapsed(middle, end), hashFound, scanFound, hashSum, scanSum);
+    }
+}
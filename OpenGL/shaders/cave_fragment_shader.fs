@@ -4,6 +4,8 @@ out vec4 FragColor;
 in vec3 normal; // Received from the vertex shader
 in vec2 TexCoord; // Texture coordinates passed from the vertex shader
 in vec3 FragPos; // World position passed from the vertex shader
+flat in float bakedLight; // Baked voxel light of the face, 0 to 1
+in float occlusion;       // Baked ambient occlusion, 0 fully occluded to 1 open
 
 uniform sampler2D texture1;
 uniform sampler2D texture2;
@@ -20,9 +22,8 @@ uniform vec3 secondAmbientStrength; // Second light ambient strength
 
 uniform vec3 viewPos; // Camera position for specular calculation
 
-// Torch light properties
-uniform vec3 torchPos; // Position of the torch
-uniform vec3 torchLightColor; // Color of the torch light (e.g., orange)
+// Colour of the baked light from torches and crystals (e.g., orange)
+uniform vec3 torchLightColor;
 
 // New uniform for the camera's Y position
 uniform float cameraY;  
@@ -58,19 +59,13 @@ void main()
     float diff2 = max(dot(norm, secondLightDir), 0.0);
     vec3 diffuse2 = diff2 * secondLightColor;
 
-    // Calculate torch light (Point light with attenuation)
-    float distance = length(torchPos - FragPos);
-    float constant = 1.0;
-    float linear = 0.09;
-    float quadratic = 0.032;
-    float attenuation = 1.0 / (constant + linear * distance + quadratic * (distance * distance));
+    // Torch and crystal light, flooded through the voxels on the CPU and baked into the mesh. Each
+    // level is a quarter brighter than the one below, so light fades out smoothly with distance.
+    float level = bakedLight * 15.0;
+    vec3 torchDiffuse = (level > 0.0 ? pow(0.8, 15.0 - level) : 0.0) * torchLightColor;
 
-    vec3 torchDir = normalize(torchPos - FragPos);
-    float torchDiff = max(dot(norm, torchDir), 0.0);
-    vec3 torchDiffuse = torchDiff * torchLightColor * attenuation;
-
-    // Add torch light to the scene
-    vec3 result = (ambient + diffuse + ambient2 + diffuse2 + torchDiffuse) * finalColor.rgb;
+    // Add torch light to the scene, darkened in the creases of the rock
+    vec3 result = (ambient + diffuse + ambient2 + diffuse2 + torchDiffuse) * mix(0.35, 1.0, occlusion) * finalColor.rgb;
     result = mix(result, objectColor, 0.2); // Blend with object color
 
     FragColor = vec4(result, finalColor.a); 
@@ -0,0 +1,72 @@
+#version 330 core
+// Vertex pulling for the cave: there are no vertex attributes. Each face is one packed 8-byte
+// record in an RG32UI buffer texture (see CaveGenerator::packFace) and gl_VertexID selects the
+// face and its corner.
+
+out vec3 normal;
+out vec3 FragPos;   // Output for world position
+out vec2 TexCoord; // Pass texture coordinates to fragment shader
+flat out float bakedLight; // Voxel light level in front of the face, 0 to 1
+out float occlusion;       // Baked ambient occlusion, 0 fully occluded to 1 open
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 chunkOrigin;          // World position of the chunk's first voxel
+uniform usamplerBuffer faceRecords; // One record per face, low word in r and high word in g
+
+// Face normals and quad layout indexed by SolidityMask::Face, matching CaveGenerator.cpp
+const vec3 faceNormals[6] = vec3[6](
+    vec3(1.0, 0.0, 0.0), vec3(-1.0, 0.0, 0.0),
+    vec3(0.0, 1.0, 0.0), vec3(0.0, -1.0, 0.0),
+    vec3(0.0, 0.0, 1.0), vec3(0.0, 0.0, -1.0));
+const vec3 faceStart[6] = vec3[6](
+    vec3(1.0, 0.0, 0.0), vec3(0.0, 0.0, -1.0),
+    vec3(0.0, 1.0, -1.0), vec3(0.0, 0.0, 0.0),
+    vec3(0.0, 0.0, 0.0), vec3(1.0, 0.0, -1.0));
+const vec3 faceRight[6] = vec3[6](
+    vec3(0.0, 0.0, -1.0), vec3(0.0, 0.0, 1.0),
+    vec3(1.0, 0.0, 0.0), vec3(1.0, 0.0, 0.0),
+    vec3(1.0, 0.0, 0.0), vec3(-1.0, 0.0, 0.0));
+const vec3 faceUp[6] = vec3[6](
+    vec3(0.0, 1.0, 0.0), vec3(0.0, 1.0, 0.0),
+    vec3(0.0, 0.0, 1.0), vec3(0.0, 0.0, -1.0),
+    vec3(0.0, 1.0, 0.0), vec3(0.0, 1.0, 0.0));
+
+// Corner (u, v) of the six vertices of a quad, in the same triangle order as the shared index
+// buffer, and the same split along the other diagonal, as CaveGenerator::addFace flips it
+const vec2 quadCorners[6] = vec2[6](
+    vec2(0.0, 0.0), vec2(0.0, 1.0), vec2(1.0, 1.0),
+    vec2(0.0, 0.0), vec2(1.0, 1.0), vec2(1.0, 0.0));
+const vec2 flippedQuadCorners[6] = vec2[6](
+    vec2(0.0, 1.0), vec2(1.0, 1.0), vec2(1.0, 0.0),
+    vec2(0.0, 1.0), vec2(1.0, 0.0), vec2(0.0, 0.0));
+
+void main()
+{
+    uvec2 faceRecord = texelFetch(faceRecords, gl_VertexID / 6).rg;
+    uint record = faceRecord.x;
+    vec3 block = vec3(record & 31u, (record >> 5) & 31u, (record >> 10) & 31u);
+    uint face = (record >> 15) & 7u;
+    vec2 size = vec2(((record >> 18) & 31u) + 1u, ((record >> 23) & 31u) + 1u);
+    bakedLight = float(record >> 28) / 15.0;
+
+    // Corner occlusion in bottom left, top left, top right, bottom right order; split the quad
+    // along the diagonal joining the darker pair of corners
+    uvec4 cornerOcclusion = (uvec4(faceRecord.y) >> uvec4(0u, 2u, 4u, 6u)) & 3u;
+    bool flip = cornerOcclusion.x + cornerOcclusion.z > cornerOcclusion.y + cornerOcclusion.w;
+    vec2 corner = flip ? flippedQuadCorners[gl_VertexID % 6] : quadCorners[gl_VertexID % 6];
+    uint cornerIndex = (corner.x < 0.5) ? (corner.y < 0.5 ? 0u : 1u) : (corner.y < 0.5 ? 3u : 2u);
+    occlusion = float(cornerOcclusion[cornerIndex]) / 3.0;
+
+    // A merged face starts from its far block along any direction that points down an axis
+    vec3 right = faceRight[face];
+    vec3 up = faceUp[face];
+    vec3 start = block + faceStart[face] + max(-right, 0.0) * (size.x - 1.0) + max(-up, 0.0) * (size.y - 1.0);
+    vec3 aPos = chunkOrigin + start + right * (size.x * corner.x) + up * (size.y * corner.y);
+
+    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    normal = mat3(transpose(inverse(model))) * faceNormals[face];  // Transform normals
+    FragPos = vec3(model * vec4(aPos, 1.0));  // Calculate world position
+    TexCoord = size * corner; // The texture repeats once per block
+}
@@ -1,20 +1,39 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
-layout (location = 2) in vec2 aTexCoord; // Added texture coordinates
+layout (location = 0) in uvec2 aPacked; // Packed position and attributes, see CaveGenerator::Vertex
 
 out vec3 normal;
 out vec3 FragPos;   // Output for world position
 out vec2 TexCoord; // Pass texture coordinates to fragment shader
+flat out float bakedLight; // Voxel light level in front of the face, 0 to 1
+out float occlusion;       // Baked ambient occlusion, 0 fully occluded to 1 open
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+uniform vec3 chunkOrigin; // World position of the chunk's first voxel
+
+// Face normals indexed by SolidityMask::Face
+const vec3 faceNormals[6] = vec3[6](
+    vec3(1.0, 0.0, 0.0), vec3(-1.0, 0.0, 0.0),
+    vec3(0.0, 1.0, 0.0), vec3(0.0, -1.0, 0.0),
+    vec3(0.0, 0.0, 1.0), vec3(0.0, 0.0, -1.0));
 
 void main()
 {
+    // Corner position relative to the chunk, stored with a +1 bias, 10 bits per axis
+    vec3 local = vec3(aPacked.x & 1023u, (aPacked.x >> 10) & 1023u, (aPacked.x >> 20) & 1023u) - 1.0;
+    vec3 aPos = chunkOrigin + local;
+
+    // Face, corner and quad size; the texture repeats once per block across merged quads
+    uint face = aPacked.y & 7u;
+    uint corner = (aPacked.y >> 3) & 3u;
+    vec2 size = vec2(((aPacked.y >> 5) & 63u) + 1u, ((aPacked.y >> 11) & 63u) + 1u);
+    vec2 aTexCoord = vec2(corner >= 2u ? size.x : 0.0, (corner == 1u || corner == 2u) ? size.y : 0.0);
+    bakedLight = float((aPacked.y >> 17) & 15u) / 15.0;
+    occlusion = float((aPacked.y >> 21) & 3u) / 3.0;
+
     gl_Position = projection * view * model * vec4(aPos, 1.0);
-    normal = mat3(transpose(inverse(model))) * aNormal;  // Transform normals
+    normal = mat3(transpose(inverse(model))) * faceNormals[face];  // Transform normals
     FragPos = vec3(model * vec4(aPos, 1.0));  // Calculate world position
     TexCoord = aTexCoord; // Pass texture coordinates to the fragment shader
 }
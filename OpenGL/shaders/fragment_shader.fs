@@ -2,10 +2,47 @@
 out vec4 FragColor;
 
 in vec2 TexCoords;
+in vec3 Normal;
+in vec3 FragPos;
 
 uniform sampler2D texture_diffuse1;
+uniform vec3 ambientLight; // Light reaching the model everywhere, before the torches and crystals
+
+// Clustered point lights, assigned to froxels on the CPU by ClusteredLights
+uniform samplerBuffer clusterLights;   // Per light: position and radius, then colour
+uniform usamplerBuffer clusterRanges;  // Per cluster: offset and count of its light indices
+uniform usamplerBuffer clusterIndices; // Light indices of every cluster, one run after another
+uniform int clusterTilesX;
+uniform int clusterTilesY;
+uniform int clusterSlices;
+uniform vec2 clusterTileScale;         // Tiles per pixel across and up the screen
+uniform float clusterNear;
+uniform float clusterFar;
+uniform float clusterSliceScale;       // Depth slices per unit of log view depth
+
+// Diffuse light from the lights that reach this fragment's cluster, each fading out smoothly at its radius
+vec3 clusteredLight(vec3 position, vec3 normal)
+{
+    float depth = clusterNear * clusterFar / (clusterFar - gl_FragCoord.z * (clusterFar - clusterNear));
+    int slice = clamp(int(log(depth / clusterNear) * clusterSliceScale), 0, clusterSlices - 1);
+    ivec2 tile = min(ivec2(gl_FragCoord.xy * clusterTileScale), ivec2(clusterTilesX - 1, clusterTilesY - 1));
+    uvec2 range = texelFetch(clusterRanges, (slice * clusterTilesY + tile.y) * clusterTilesX + tile.x).rg;
+
+    vec3 result = vec3(0.0);
+    for (uint i = 0u; i < range.y; ++i) {
+        int light = int(texelFetch(clusterIndices, int(range.x + i)).r);
+        vec4 positionRadius = texelFetch(clusterLights, light * 2);
+        vec3 color = texelFetch(clusterLights, light * 2 + 1).rgb;
+        vec3 toLight = positionRadius.xyz - position;
+        float distance = length(toLight);
+        float falloff = clamp(1.0 - distance / positionRadius.w, 0.0, 1.0);
+        result += color * max(dot(normal, toLight / max(distance, 1e-4)), 0.0) * falloff * falloff;
+    }
+    return result;
+}
 
 void main()
 {    
-    FragColor = texture(texture_diffuse1, TexCoords);
+    vec4 texColor = texture(texture_diffuse1, TexCoords);
+    FragColor = vec4(texColor.rgb * (ambientLight + clusteredLight(FragPos, normalize(Normal))), texColor.a);
 }
\ No newline at end of file
@@ -2,20 +2,23 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+layout (location = 7) in mat4 aInstanceModel; // Per crystal, locations 7 to 10
+layout (location = 11) in vec4 aInstanceTint;
 
 out vec2 TexCoords;
 out vec3 Normal;
 out vec3 FragPos;
+out vec4 Tint;
 
-uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;  
+    FragPos = vec3(aInstanceModel * vec4(aPos, 1.0));
+    Normal = mat3(transpose(inverse(aInstanceModel))) * aNormal;  
 
     gl_Position = projection * view * vec4(FragPos, 1.0);
     TexCoords = aTexCoords;
+    Tint = aInstanceTint;
 }
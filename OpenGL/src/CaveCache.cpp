@@ -0,0 +1,228 @@
+#include "../headers/CaveCache.h"
+#include "../headers/CaveChunk.h"
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const char CACHE_MAGIC[8] = { 'C', 'A', 'V', 'E', 'C', 'H', 'N', 'K' };
+
+// Rounds a file offset up to the data alignment.
+static uint64_t alignOffset(uint64_t offset) {
+    return (offset + CaveCache::DATA_ALIGNMENT - 1) / CaveCache::DATA_ALIGNMENT * CaveCache::DATA_ALIGNMENT;
+}
+
+// Bytes taken by a voxel palette, padded so the index words after it stay 8-byte aligned.
+static uint64_t paletteBytes(uint64_t entries) {
+    return (entries + 7) / 8 * 8;
+}
+
+CaveCache::CaveCache() : mappedData(nullptr), mappedSize(0),
+#ifdef _WIN32
+    fileHandle(nullptr), mappingHandle(nullptr)
+#else
+    fileDescriptor(-1)
+#endif
+{
+}
+
+CaveCache::~CaveCache() {
+    close();
+}
+
+// Maps a cache file read-only and indexes its chunk records. Only the header and the record table
+// are read; chunk data stays in the mapped pages until it is used.
+// Parameters:
+//   - path: The cache file.
+//   - key: Hash of the current generation parameters; the file must have been written with it.
+bool CaveCache::open(const std::string& path, uint64_t key) {
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart < static_cast<LONGLONG>(sizeof(Header))) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view) {
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    fileHandle = file;
+    mappingHandle = mapping;
+    mappedData = static_cast<const unsigned char*>(view);
+    mappedSize = static_cast<size_t>(size.QuadPart);
+#else
+    int descriptor = ::open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) return false;
+    struct stat status;
+    if (fstat(descriptor, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(Header))) {
+        ::close(descriptor);
+        return false;
+    }
+    void* view = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+    if (view == MAP_FAILED) {
+        ::close(descriptor);
+        return false;
+    }
+    fileDescriptor = descriptor;
+    mappedData = static_cast<const unsigned char*>(view);
+    mappedSize = static_cast<size_t>(status.st_size);
+#endif
+
+    const Header* header = reinterpret_cast<const Header*>(mappedData);
+    bool valid = std::memcmp(header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 && header->version == VERSION &&
+                 header->headerSize == sizeof(Header) && header->recordSize == sizeof(ChunkRecord) && header->key == key &&
+                 sizeof(Header) + static_cast<uint64_t>(header->chunkCount) * sizeof(ChunkRecord) <= mappedSize;
+    if (valid) {
+        const ChunkRecord* table = reinterpret_cast<const ChunkRecord*>(mappedData + sizeof(Header));
+        for (uint32_t i = 0; i < header->chunkCount && valid; ++i) {
+            const ChunkRecord& record = table[i];
+            uint64_t meshBytes = record.faceCount * sizeof(uint64_t) + record.vertexBytes;
+            valid = record.voxelOffset + record.voxelBytes <= mappedSize && paletteBytes(record.paletteSize) <= record.voxelBytes &&
+                    record.meshOffset + meshBytes <= mappedSize;
+            records.push_back(&record);
+            recordsByChunk[chunkKey(glm::ivec3(record.x, record.y, record.z))] = &record;
+        }
+    }
+    if (!valid) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+// Unmaps the file and forgets its records.
+void CaveCache::close() {
+    records.clear();
+    recordsByChunk.clear();
+#ifdef _WIN32
+    if (mappedData) UnmapViewOfFile(mappedData);
+    if (mappingHandle) CloseHandle(static_cast<HANDLE>(mappingHandle));
+    if (fileHandle) CloseHandle(static_cast<HANDLE>(fileHandle));
+    fileHandle = mappingHandle = nullptr;
+#else
+    if (mappedData) munmap(const_cast<unsigned char*>(mappedData), mappedSize);
+    if (fileDescriptor >= 0) ::close(fileDescriptor);
+    fileDescriptor = -1;
+#endif
+    mappedData = nullptr;
+    mappedSize = 0;
+}
+
+const CaveCache::ChunkRecord* CaveCache::find(const glm::ivec3& coord) const {
+    auto it = recordsByChunk.find(chunkKey(coord));
+    return (it != recordsByChunk.end()) ? it->second : nullptr;
+}
+
+const uint8_t* CaveCache::palette(const ChunkRecord& record) const {
+    return mappedData + record.voxelOffset;
+}
+
+const uint64_t* CaveCache::indices(const ChunkRecord& record) const {
+    return reinterpret_cast<const uint64_t*>(mappedData + record.voxelOffset + paletteBytes(record.paletteSize));
+}
+
+size_t CaveCache::indexWordCount(const ChunkRecord& record) const {
+    return static_cast<size_t>((record.voxelBytes - paletteBytes(record.paletteSize)) / sizeof(uint64_t));
+}
+
+const uint64_t* CaveCache::faces(const ChunkRecord& record) const {
+    return reinterpret_cast<const uint64_t*>(mappedData + record.meshOffset);
+}
+
+const void* CaveCache::vertices(const ChunkRecord& record) const {
+    return mappedData + record.meshOffset;
+}
+
+// Writes the header, the record table and then every chunk's voxels and mesh.
+// Parameters:
+//   - path: The file to create or overwrite.
+//   - key: Hash of the generation parameters the chunks were made with.
+//   - chunks: The chunks to store.
+bool CaveCache::write(const std::string& path, uint64_t key, const std::vector<ChunkData>& chunks) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cerr << "Failed to write cave cache " << path << std::endl;
+        return false;
+    }
+
+    Header header;
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = VERSION;
+    header.headerSize = sizeof(Header);
+    header.recordSize = sizeof(ChunkRecord);
+    header.chunkCount = static_cast<uint32_t>(chunks.size());
+    header.key = key;
+
+    // Lay the data blocks out after the table
+    std::vector<ChunkRecord> table(chunks.size());
+    uint64_t offset = sizeof(Header) + chunks.size() * sizeof(ChunkRecord);
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        const ChunkData& chunk = chunks[i];
+        ChunkRecord& record = table[i];
+        std::memset(&record, 0, sizeof(record));
+        record.x = chunk.coord.x;
+        record.y = chunk.coord.y;
+        record.z = chunk.coord.z;
+        record.editCount = chunk.editCount;
+        record.unitFaces = chunk.unitFaces;
+        record.faceCount = static_cast<uint32_t>(chunk.faceCount);
+        record.paletteSize = static_cast<uint32_t>(chunk.paletteSize);
+        record.indexBits = static_cast<uint32_t>(chunk.indexBits);
+        record.vertexBytes = chunk.vertexBytes;
+        record.voxelOffset = alignOffset(offset);
+        record.voxelBytes = paletteBytes(chunk.paletteSize) + chunk.indexWords * sizeof(uint64_t);
+        record.meshOffset = alignOffset(record.voxelOffset + record.voxelBytes);
+        offset = record.meshOffset + chunk.faceCount * sizeof(uint64_t) + chunk.vertexBytes;
+    }
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(ChunkRecord));
+    uint64_t written = sizeof(Header) + table.size() * sizeof(ChunkRecord);
+    static const char padding[DATA_ALIGNMENT] = {};
+    auto pad = [&](uint64_t target) {
+        file.write(padding, static_cast<std::streamsize>(target - written));
+        written = target;
+    };
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        const ChunkData& chunk = chunks[i];
+        const ChunkRecord& record = table[i];
+        pad(record.voxelOffset);
+        file.write(reinterpret_cast<const char*>(chunk.palette), static_cast<std::streamsize>(chunk.paletteSize));
+        written += chunk.paletteSize;
+        pad(record.voxelOffset + paletteBytes(chunk.paletteSize));
+        file.write(reinterpret_cast<const char*>(chunk.indices), static_cast<std::streamsize>(chunk.indexWords * sizeof(uint64_t)));
+        written += chunk.indexWords * sizeof(uint64_t);
+        pad(record.meshOffset);
+        if (chunk.faceCount > 0) {
+            file.write(reinterpret_cast<const char*>(chunk.faces), static_cast<std::streamsize>(chunk.faceCount * sizeof(uint64_t)));
+            written += chunk.faceCount * sizeof(uint64_t);
+        }
+        else {
+            file.write(static_cast<const char*>(chunk.vertices), static_cast<std::streamsize>(chunk.vertexBytes));
+            written += chunk.vertexBytes;
+        }
+    }
+
+    if (!file) {
+        std::cerr << "Failed to write cave cache " << path << std::endl;
+        return false;
+    }
+    return true;
+}
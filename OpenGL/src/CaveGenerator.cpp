@@ -1,292 +1,3096 @@
 #include "../headers/CaveGenerator.h"
 #include <cmath>
 #include <glm/gtc/noise.hpp> // For Perlin noise
+#include "../headers/NoiseKernel.h"
+#include "../headers/VoxelGrid.h"
 #include <iostream>
+#include <chrono>
+#include <limits>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <cstdio>
 
+// Number of set bits in a word.
+static int popCount(uint64_t word) {
+#ifdef _MSC_VER
+    return static_cast<int>(__popcnt64(word));
+#else
+    return __builtin_popcountll(word);
+#endif
+}
+
+// Face normals indexed by SolidityMask::Face
+static const glm::vec3 faceNormals[SolidityMask::FACE_COUNT] = {
+    glm::vec3(1.0f, 0.0f, 0.0f),  // Right face
+    glm::vec3(-1.0f, 0.0f, 0.0f), // Left face
+    glm::vec3(0.0f, 1.0f, 0.0f),  // Top face
+    glm::vec3(0.0f, -1.0f, 0.0f), // Bottom face
+    glm::vec3(0.0f, 0.0f, 1.0f),  // Front face
+    glm::vec3(0.0f, 0.0f, -1.0f)  // Back face
+};
+
+
+// Quad layout per face, indexed by SolidityMask::Face and mirrored in cave_pull_vertex_shader.vs:
+// a unit face of the block at b spans b + faceStart + u * faceRight + v * faceUp for u, v in [0, 1].
+// A merged face starts from the far block along any direction that points down its axis.
+static const glm::ivec3 faceStart[SolidityMask::FACE_COUNT] = {
+    glm::ivec3(1, 0, 0),  // Right face
+    glm::ivec3(0, 0, -1), // Left face
+    glm::ivec3(0, 1, -1), // Top face
+    glm::ivec3(0, 0, 0),  // Bottom face
+    glm::ivec3(0, 0, 0),  // Front face
+    glm::ivec3(1, 0, -1)  // Back face
+};
+static const glm::ivec3 faceRight[SolidityMask::FACE_COUNT] = {
+    glm::ivec3(0, 0, -1), glm::ivec3(0, 0, 1), glm::ivec3(1, 0, 0),
+    glm::ivec3(1, 0, 0), glm::ivec3(1, 0, 0), glm::ivec3(-1, 0, 0)
+};
+static const glm::ivec3 faceUp[SolidityMask::FACE_COUNT] = {
+    glm::ivec3(0, 1, 0), glm::ivec3(0, 1, 0), glm::ivec3(0, 0, 1),
+    glm::ivec3(0, 0, -1), glm::ivec3(0, 1, 0), glm::ivec3(0, 1, 0)
+};
+
+// Neighbouring voxel each face looks into, indexed by SolidityMask::Face
+static const glm::ivec3 faceOffset[SolidityMask::FACE_COUNT] = {
+    glm::ivec3(1, 0, 0), glm::ivec3(-1, 0, 0), glm::ivec3(0, 1, 0),
+    glm::ivec3(0, -1, 0), glm::ivec3(0, 0, 1), glm::ivec3(0, 0, -1)
+};
+
+// Corner occlusion of a face nothing occludes, 3 for each of its four corners
+static const int UNOCCLUDED = 0xFF;
+
+// Edits a chunk's edit log holds one by one before they are merged into its grid of edited voxels
+static const size_t MAX_RECENT_EDITS = 16;
+
+// Value of a merged edit grid's voxels that no merged edit wrote; no VoxelMaterial has it
+static const uint8_t EDIT_UNTOUCHED = 0xFF;
+
+// Light level a crystal glows with
+static const int CRYSTAL_LIGHT_LEVEL = 8;
+
+// Chance of a floor voxel growing a crystal
+static const float CRYSTAL_SPAWN_PROBABILITY = 0.01f;
+
+// Seed of a cave until setSeed() picks another
+static const uint64_t DEFAULT_SEED = 0x2545F4914F6CDD1Dull;
+
+// Philox streams, the last counter word, so each kind of placement draws its own numbers per voxel
+static const uint32_t CRYSTAL_STREAM = 0;
+
+// Brightness of a light level relative to the level above it, as cave_fragment_shader.fs decodes them
+static const float LIGHT_LEVEL_FALLOFF = 0.8f;
+
+// Baked brightness below which a voxel rounds down to light level 0, half a level under level 1
+static const float BAKED_LIGHT_CUTOFF = std::pow(LIGHT_LEVEL_FALLOFF, MAX_LIGHT_LEVEL - 0.5f);
+
+// Furthest a light bake path travels between bounces, in voxels
+static const float BAKE_BOUNCE_DISTANCE = 16.0f;
+
+// Air voxels a light bake hands to a worker at a time
+static const int BAKE_VOXELS_PER_TASK = 512;
+
+// Texture unit the face record buffer texture is bound to while drawing pulled chunks
+static const int FACE_RECORD_TEXTURE_UNIT = 2;
+
+// Noise value used for air: the ghost ring outside a bounded cave and anything not generated
+static const float AIR_VALUE = std::numeric_limits<float>::max();
+
+// Rock whose noise is below this is ore, a few percent of the rock in either biome
+static const float ORE_VALUE = -0.6f;
+
+// Voxel (x, y, z) fills the cube [x, x + 1] x [y, y + 1] x [z - 1, z] in world space, as laid out by
+// faceStart, so the lattice cell floor(p) of a world position p holds voxel floor(p) + VOXEL_CELL_OFFSET.
+static const glm::ivec3 VOXEL_CELL_OFFSET(0, 0, 1);
+
+// Constructor for the CaveGenerator class. Initializes a bounded cave with specified dimensions and threshold
+// for determining solid blocks based on Perlin noise. Chunks are generated by generateCave().
+// Parameters:
+//   - depth: Depth of the cave (z-axis).
+//   - width: Width of the cave (x-axis).
+//   - height: Height of the cave (y-axis).
+//   - threshold: Noise threshold for determining solid blocks.
+//   - threadCount: Worker threads used for generation (0 uses the hardware concurrency).
+CaveGenerator::CaveGenerator(int depth, int width, int height, float threshold, unsigned int threadCount)
+    : bounded(true), depth(depth), width(width), height(height), threshold(threshold), meshingMode(MESHING_NAIVE), renderMode(RENDER_FACE_PULLING), ambientOcclusion(true), lightingMode(LIGHTING_FLOOD_FILL), maxFaceRecords(0),
+      frameCounter(0), streamingCentre(0.0f), lastCameraPosition(0.0f), travelDirection(0.0f, 0.0f, -1.0f),
+      crystalsEnabled(false), crystalListDirty(false), crystalListVersion(0), seed(DEFAULT_SEED), pullVao(0), quadIndexBuffer(0), quadIndexCapacity(0), jobsInFlight(0), nextChunkId(1), cancelJobs(false), exactNoise(true), noiseOctaves(3), noiseOctavesEvaluated(0), noiseOctavesSkipped(0),
+      cacheMeshingMode(MESHING_NAIVE), cacheRenderMode(RENDER_FACE_PULLING), cacheAmbientOcclusion(true), collectingCacheMeshes(false), lightEdited(false), lightVoxelsChanged(0),
+      threadPool(new ThreadPool(threadCount)) {
+    queryFaceRecordLimit();
+    // Generate and apply Perlin worm
+    carveCorridor(20, 40, 20, 10, 8, 40);
+}
+
+// Constructor for an unbounded cave that is generated in chunks around the camera as it moves.
+// Parameters:
+//   - threshold: Noise threshold for determining solid blocks.
+//   - streaming: View radius, memory budget and per-frame generation limit.
+//   - threadCount: Worker threads used for generation (0 uses the hardware concurrency).
+CaveGenerator::CaveGenerator(float threshold, const StreamingSettings& streaming, unsigned int threadCount)
+    : bounded(false), depth(0), width(0), height(0), threshold(threshold), meshingMode(MESHING_NAIVE), renderMode(RENDER_FACE_PULLING), ambientOcclusion(true), lightingMode(LIGHTING_FLOOD_FILL), maxFaceRecords(0), streaming(streaming),
+      frameCounter(0), streamingCentre(0.0f), lastCameraPosition(0.0f), travelDirection(0.0f, 0.0f, -1.0f),
+      crystalsEnabled(false), crystalListDirty(false), crystalListVersion(0), seed(DEFAULT_SEED), pullVao(0), quadIndexBuffer(0), quadIndexCapacity(0), jobsInFlight(0), nextChunkId(1), cancelJobs(false), exactNoise(true), noiseOctaves(3), noiseOctavesEvaluated(0), noiseOctavesSkipped(0),
+      cacheMeshingMode(MESHING_NAIVE), cacheRenderMode(RENDER_FACE_PULLING), cacheAmbientOcclusion(true), collectingCacheMeshes(false), lightEdited(false), lightVoxelsChanged(0),
+      threadPool(new ThreadPool(threadCount)) {
+    queryFaceRecordLimit();
+    carveCorridor(20, 40, 20, 10, 8, 40);
+}
+
+// Destructor for the CaveGenerator class. Stops the background jobs, then cleans up OpenGL
+// resources of every resident chunk.
+CaveGenerator::~CaveGenerator() {
+    cancelJobs = true;
+    threadPool.reset(); // Queued jobs see cancelJobs and return straight away
+    for (auto& entry : chunks) {
+        releaseChunk(*entry.second);
+    }
+    if (quadIndexBuffer != 0) {
+        glDeleteBuffers(1, &quadIndexBuffer);
+    }
+    if (pullVao != 0) {
+        glDeleteVertexArrays(1, &pullVao);
+    }
+}
+
+// Generates and meshes every chunk that should currently be resident: the whole volume for a
+// bounded cave, or the view radius around the last update() position for a streaming cave.
+// Unlike update() this has no per-call limit and waits for the jobs to finish, so it is meant for startup.
+void CaveGenerator::generateCave() {
+    auto start = std::chrono::high_resolution_clock::now();
+    if (!cachePath.empty()) {
+        if (cache.open(cachePath, cacheKey())) {
+            cacheMeshingMode = meshingMode;
+            cacheRenderMode = renderMode;
+            cacheAmbientOcclusion = ambientOcclusion;
+        }
+        collectingCacheMeshes = true;
+    }
+
+    if (bounded) {
+        std::vector<glm::ivec3> missing;
+        glm::ivec3 last = chunkCoordOf(glm::ivec3(width - 1, height - 1, depth - 1));
+        for (int cz = 0; cz <= last.z; ++cz) {
+            for (int cy = 0; cy <= last.y; ++cy) {
+                for (int cx = 0; cx <= last.x; ++cx) {
+                    glm::ivec3 coord(cx, cy, cz);
+                    if (!findChunk(coord) && !pendingChunks.count(chunkKey(coord))) {
+                        missing.push_back(coord);
+                    }
+                }
+            }
+        }
+        submitChunkJobs(missing);
+    }
+    else {
+        streamChunks(std::numeric_limits<int>::max());
+    }
+
+    // Upload as jobs finish; installing chunks can queue remeshes for carves made meanwhile, and
+    // for light flowing in from their neighbours
+    for (;;) {
+        processUploads(std::numeric_limits<size_t>::max(), std::numeric_limits<double>::max());
+        updateLighting();
+        remeshDirtyChunks();
+        if (jobsInFlight == 0) break;
+        std::unique_lock<std::mutex> lock(uploadMutex);
+        jobFinished.wait(lock, [this]() { return !uploadQueue.empty(); });
+    }
+    rebuildCrystalList();
+    if (collectingCacheMeshes) {
+        if (!meshesToCache.empty()) {
+            writeCache();
+        }
+        meshesToCache.clear();
+        collectingCacheMeshes = false;
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "Cave generated in " << std::chrono::duration<double, std::milli>(end - start).count()
+              << " ms (" << chunks.size() << " chunks, " << stats.chunksFromCache << " from cache, " << getVertexCount() << " vertices, "
+              << getUnitFaceVertexCount() << " as unit faces, " << getMeshBytes() / 1024 << " KB of meshes, "
+              << getMemoryUsage() / 1024 << " KB, " << noiseISAName(getNoiseISA()) << ", "
+              << threadPool->size() << " threads)" << std::endl;
+    size_t floatBytes = chunks.size() * VoxelGrid(CHUNK_SIZE, CHUNK_SIZE, CHUNK_SIZE, AIR_VALUE).sizeInBytes();
+    std::cout << "Cave voxels: " << getVoxelBytes() / 1024 << " KB, "
+              << (chunks.empty() ? 0 : getVoxelBytes() / chunks.size()) << " bytes per chunk, "
+              << getUniformChunkCount() << " chunks of one material (" << floatBytes / 1024 << " KB as float noise)" << std::endl;
+    uint64_t octavesEvaluated = noiseOctavesEvaluated.exchange(0);
+    uint64_t octavesSkipped = noiseOctavesSkipped.exchange(0);
+    uint64_t octaves = octavesEvaluated + octavesSkipped;
+    std::cout << "Noise octaves skipped by the early-out: " << octavesSkipped << " of " << octaves << " ("
+              << (octaves ? 100.0 * octavesSkipped / octaves : 0.0) << "%)" << std::endl;
+    stats = StreamingStats(); // Metrics from here on describe streaming, not the startup burst
+}
+
+// Per-frame streaming step. Propagates light changes, remeshes up to maxImmediateRemeshes edited
+// chunks straight away so edits show this frame, submits jobs for up to maxChunksPerUpdate missing chunks around the camera,
+// nearest first and favouring the direction of travel, and for the other chunks that need remeshing,
+// advances a light bake in progress by its time slice, uploads finished jobs within the per-frame
+// budget and evicts the least recently used chunks once the memory budget is exceeded. A bounded
+// cave only remeshes and bakes. Never waits for the workers, other than on the bake's slice.
+// Parameters:
+//   - cameraPosition: Current camera position in world space.
+//   - cameraFront: Camera view direction, used as the travel direction while standing still.
+void CaveGenerator::update(const glm::vec3& cameraPosition, const glm::vec3& cameraFront) {
+    ++frameCounter;
+    if (!bounded) {
+        glm::vec3 travel = cameraPosition - lastCameraPosition;
+        travelDirection = (glm::dot(travel, travel) > 1e-6f) ? glm::normalize(travel) : cameraFront;
+        lastCameraPosition = cameraPosition;
+        streamingCentre = cameraPosition;
+        streamChunks(std::max(0, std::min(streaming.maxChunksPerUpdate, streaming.maxPendingJobs - jobsInFlight)));
+    }
+    updateLighting();
+    remeshEditedChunks(streaming.maxImmediateRemeshes);
+    if (lightBake) {
+        stepLightBake(lightBake->settings.millisPerUpdate);
+    }
+    remeshDirtyChunks();
+    processUploads(streaming.uploadBytesPerFrame, streaming.uploadMillisPerFrame);
+    if (!bounded) {
+        evictChunks();
+    }
+    rebuildCrystalList();
+}
+
+// Renders the cave geometry. Pulled chunks are drawn without vertex attributes: the vertex shader
+// fetches each face record from the chunk's buffer texture by gl_VertexID and expands it into two
+// triangles. Chunks on the vertex buffer path bind their VAO and draw through the shared indices.
+// Parameters:
+//   - vertexShader: The cave shader for vertex buffer chunks.
+//   - pullShader: The cave shader for pulled chunks.
+void CaveGenerator::render(const Shader& vertexShader, const Shader& pullShader) {
+    bool pullBound = false;
+    for (const auto& entry : chunks) {
+        const CaveChunk& chunk = *entry.second;
+        if (chunk.quadCount == 0 || chunk.faceTexture == 0) continue;
+        if (!pullBound) {
+            pullShader.use();
+            pullShader.setInt("faceRecords", FACE_RECORD_TEXTURE_UNIT);
+            glActiveTexture(GL_TEXTURE0 + FACE_RECORD_TEXTURE_UNIT);
+            glBindVertexArray(pullVao);
+            pullBound = true;
+        }
+        pullShader.setVec3("chunkOrigin", glm::vec3(chunk.origin()));
+        glBindTexture(GL_TEXTURE_BUFFER, chunk.faceTexture);
+        glDrawArrays(GL_TRIANGLES, 0, chunk.quadCount * 6);
+    }
+    if (pullBound) {
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    bool vertexBound = false;
+    for (const auto& entry : chunks) {
+        const CaveChunk& chunk = *entry.second;
+        if (chunk.quadCount == 0 || chunk.faceTexture != 0) continue;
+        if (!vertexBound) {
+            vertexShader.use();
+            vertexBound = true;
+        }
+        vertexShader.setVec3("chunkOrigin", glm::vec3(chunk.origin()));
+        glBindVertexArray(chunk.vao);
+        glDrawElements(GL_TRIANGLES, chunk.quadCount * 6, GL_UNSIGNED_INT, (void*)0);
+    }
+    glBindVertexArray(0);
+}
+
+// Computes a 64-bit FNV-1a hash over the material of every resident voxel, visiting chunks in key
+// order. Two generations with the same parameters must produce the same hash regardless of thread
+// count.
+uint64_t CaveGenerator::volumeHash() const {
+    std::vector<int64_t> keys;
+    for (const auto& entry : chunks) {
+        keys.push_back(entry.first);
+    }
+    std::sort(keys.begin(), keys.end());
+
+    uint64_t hash = 14695981039346656037ull;
+    for (int64_t key : keys) {
+        const PaletteGrid& voxels = chunks.at(key)->voxels;
+        for (int z = 0; z < CHUNK_SIZE; ++z) {
+            for (int y = 0; y < CHUNK_SIZE; ++y) {
+                for (int x = 0; x < CHUNK_SIZE; ++x) {
+                    hash = (hash ^ voxels.at(x, y, z)) * 1099511628211ull;
+                }
+            }
+        }
+    }
+    return hash;
+}
+
+// Philox4x32-10 (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3"): a counter-based
+// generator. Each output block is a pure function of its counter and key, so placement draws the
+// numbers of a voxel straight from its position instead of from a shared, ordered state.
+// Parameters:
+//   - counter: The four counter words in, the four random words out.
+//   - key: The generator's key, here the two halves of the cave seed.
+static void philox4x32(uint32_t counter[4], uint64_t key) {
+    uint32_t key0 = static_cast<uint32_t>(key), key1 = static_cast<uint32_t>(key >> 32);
+    for (int round = 0; round < 10; ++round) {
+        uint64_t product0 = 0xD2511F53ull * counter[0];
+        uint64_t product1 = 0xCD9E8D57ull * counter[2];
+        uint32_t word0 = static_cast<uint32_t>(product1 >> 32) ^ counter[1] ^ key0;
+        uint32_t word2 = static_cast<uint32_t>(product0 >> 32) ^ counter[3] ^ key1;
+        counter[1] = static_cast<uint32_t>(product1);
+        counter[3] = static_cast<uint32_t>(product0);
+        counter[0] = word0;
+        counter[2] = word2;
+        key0 += 0x9E3779B9u;
+        key1 += 0xBB67AE85u;
+    }
+}
+
+// Uniform random number in [0, 1) belonging to one voxel and stream, the same on every run with the same seed.
+// Parameters:
+//   - voxel: World coordinates of the voxel.
+//   - stream: Which of the voxel's numbers, e.g. CRYSTAL_STREAM.
+//   - seed: The cave seed.
+static float voxelRandom(const glm::ivec3& voxel, uint32_t stream, uint64_t seed) {
+    uint32_t counter[4] = { static_cast<uint32_t>(voxel.x), static_cast<uint32_t>(voxel.y), static_cast<uint32_t>(voxel.z), stream };
+    philox4x32(counter, seed);
+    return static_cast<float>(counter[0] >> 8) * (1.0f / 16777216.0f);
+}
+
+// Generates crystal formations within the cave by randomly placing crystals at certain positions
+// based on a probability check. Chunks streamed in afterwards get their crystals as they load.
+void CaveGenerator::generateCrystals() {
+    crystalsEnabled = true;
+
+    // Placement only touches each chunk's own floor list and crystals, so the chunks are placed in
+    // parallel; their light spreads into neighbouring chunks and is seeded on this thread afterwards
+    std::vector<CaveChunk*> unspawned;
+    for (auto& entry : chunks) {
+        if (!entry.second->crystalsSpawned) {
+            unspawned.push_back(entry.second.get());
+        }
+    }
+    threadPool->parallelFor(0, static_cast<int>(unspawned.size()), [&](int i) {
+        placeCrystals(*unspawned[i]);
+    });
+    for (CaveChunk* chunk : unspawned) {
+        seedCrystals(*chunk);
+    }
+    rebuildCrystalList();
+}
+
+// Places crystals on the floor of a single chunk, once per chunk.
+// Parameters:
+//   - chunk: The chunk to populate.
+void CaveGenerator::spawnCrystals(CaveChunk& chunk) {
+    if (chunk.crystalsSpawned) return;
+    placeCrystals(chunk);
+    seedCrystals(chunk);
+}
+
+// Picks the floor voxels of a chunk that grow a crystal. Only the floor list built by meshing is
+// visited, so the cost follows the floor area rather than the volume, and each voxel's chance comes
+// from voxelRandom so the result doesn't depend on thread count or load order. Safe to run on worker
+// threads for different chunks.
+// Parameters:
+//   - chunk: The chunk to populate; its crystal list is replaced.
+void CaveGenerator::placeCrystals(CaveChunk& chunk) const {
+    chunk.crystalPositions.clear();
+    const PaletteGrid& voxels = chunk.voxels;
+    glm::ivec3 origin = chunk.origin();
+    for (uint16_t index : chunk.floorVoxels) {
+        glm::ivec3 local = CaveChunk::lightVoxel(index);
+        if (voxelRandom(origin + local, CRYSTAL_STREAM, seed) >= CRYSTAL_SPAWN_PROBABILITY) continue;
+        // Edits replayed onto a newly loaded chunk can postdate its floor list
+        if (voxels.isSolid(local.x, local.y, local.z) || !voxels.isSolid(local.x, local.y - 1, local.z)) continue;
+        chunk.crystalPositions.push_back(glm::vec3(origin + local));
+    }
+}
+
+// Marks a chunk's crystals as spawned, adds them to the crystal index and lights them.
+// Parameters:
+//   - chunk: The chunk, with its crystals placed.
+void CaveGenerator::seedCrystals(CaveChunk& chunk) {
+    chunk.crystalsSpawned = true;
+    crystalListDirty = true;
+    for (const glm::vec3& crystal : chunk.crystalPositions) {
+        crystalIndex.insert(crystal, 0);
+        seedLight(chunk, glm::ivec3(crystal), CRYSTAL_LIGHT_LEVEL);
+    }
+}
+
+// Rebuilds the flat crystal position list from the resident chunks after chunks were added or removed.
+void CaveGenerator::rebuildCrystalList() {
+    if (!crystalListDirty) return;
+    crystalListDirty = false;
+    crystalListVersion++;
+    crystalPositions.clear();
+    for (const auto& entry : chunks) {
+        const std::vector<glm::vec3>& positions = entry.second->crystalPositions;
+        crystalPositions.insert(crystalPositions.end(), positions.begin(), positions.end());
+    }
+}
+
+// Returns the material of a voxel, or air if it lies outside the bounds or in a chunk that isn't
+// resident.
+// Parameters:
+//   - x, y, z: World coordinates of the voxel.
+uint8_t CaveGenerator::getMaterial(int x, int y, int z) const {
+    glm::ivec3 voxel(x, y, z);
+    CaveChunk* chunk = findChunk(chunkCoordOf(voxel));
+    if (!chunk) return MATERIAL_AIR;
+    glm::ivec3 local = voxel - chunk->origin();
+    return chunk->voxels.at(local.x, local.y, local.z);
+}
+
+// Sets the material of a voxel in its owning chunk and in the ghost rings of any neighbouring
+// chunks that border it. All of them are remeshed by the next update().
+// Parameters:
+//   - x, y, z: World coordinates of the voxel.
+//   - material: The new VoxelMaterial. Dropped outside a bounded cave, like edits.
+void CaveGenerator::setMaterial(int x, int y, int z, uint8_t material) {
+    glm::ivec3 voxel(x, y, z);
+    glm::ivec3 min = voxel, max = voxel + glm::ivec3(1);
+    if (!clipToBounds(min, max)) return;
+    glm::ivec3 first = chunkCoordOf(voxel - glm::ivec3(1));
+    glm::ivec3 last = chunkCoordOf(voxel + glm::ivec3(1));
+    for (int cz = first.z; cz <= last.z; ++cz) {
+        for (int cy = first.y; cy <= last.y; ++cy) {
+            for (int cx = first.x; cx <= last.x; ++cx) {
+                CaveChunk* chunk = findChunk(glm::ivec3(cx, cy, cz));
+                if (!chunk) continue;
+                glm::ivec3 local = voxel - chunk->origin();
+                chunk->voxels.set(local.x, local.y, local.z, material);
+                if (material != MATERIAL_AIR) {
+                    chunk->occupancy.markSolid(local.x, local.y, local.z, local.x, local.y, local.z);
+                }
+                chunk->editDirty = true;
+            }
+        }
+    }
+}
+
+// Sets the cache file chunks are loaded from and generateCave writes to, and maps it if it was
+// written with the current parameters. An empty path turns caching off.
+// Parameters:
+//   - path: The cache file; it is created by the next generateCave if it doesn't exist.
+void CaveGenerator::setCacheFile(const std::string& path) {
+    cachePath = path;
+    cache.close();
+    if (!cachePath.empty() && cache.open(cachePath, cacheKey())) {
+        cacheMeshingMode = meshingMode;
+        cacheRenderMode = renderMode;
+        cacheAmbientOcclusion = ambientOcclusion;
+    }
+}
+
+// CPU memory held by the resident chunks' voxel grids, in bytes.
+size_t CaveGenerator::getVoxelBytes() const {
+    size_t bytes = 0;
+    for (const auto& entry : chunks) {
+        bytes += entry.second->voxels.sizeInBytes();
+    }
+    return bytes;
+}
+
+// Number of resident chunks whose voxels collapsed to a single material.
+size_t CaveGenerator::getUniformChunkCount() const {
+    size_t count = 0;
+    for (const auto& entry : chunks) {
+        if (entry.second->voxels.isUniform()) ++count;
+    }
+    return count;
+}
+
+// Total CPU and GPU memory held by resident chunks and the shared index buffer, in bytes.
+size_t CaveGenerator::getMemoryUsage() const {
+    size_t total = quadIndexCapacity * 6 * sizeof(GLuint);
+    for (const auto& entry : chunks) {
+        total += entry.second->memoryBytes();
+    }
+    return total;
+}
+
+// Switches between naive and greedy meshing. Resident chunks keep their current mesh until their
+// background remesh is uploaded.
+// Parameters:
+//   - mode: The meshing mode for every chunk meshed from now on.
+void CaveGenerator::setMeshingMode(MeshingMode mode) {
+    if (mode == meshingMode) return;
+    meshingMode = mode;
+    for (auto& entry : chunks) {
+        entry.second->meshDirty = true;
+    }
+}
+
+// Total vertices in the resident chunk meshes, counting 4 per quad on either path.
+size_t CaveGenerator::getVertexCount() const {
+    size_t total = 0;
+    for (const auto& entry : chunks) {
+        total += entry.second->quadCount * 4;
+    }
+    return total;
+}
+
+// GPU bytes of the resident chunk meshes, vertex buffers and face records alike.
+size_t CaveGenerator::getMeshBytes() const {
+    size_t total = 0;
+    for (const auto& entry : chunks) {
+        total += entry.second->gpuBytes;
+    }
+    return total;
+}
+
+// Vertices the resident chunks would need with one quad per exposed voxel face.
+size_t CaveGenerator::getUnitFaceVertexCount() const {
+    size_t total = 0;
+    for (const auto& entry : chunks) {
+        total += entry.second->unitFaceCount * 4;
+    }
+    return total;
+}
+
+// Turns baked ambient occlusion on or off. Resident chunks keep their current mesh until their
+// background remesh is uploaded.
+// Parameters:
+//   - enabled: Whether chunks meshed from now on get ambient occlusion.
+void CaveGenerator::setAmbientOcclusion(bool enabled) {
+    if (enabled == ambientOcclusion) return;
+    ambientOcclusion = enabled;
+    for (auto& entry : chunks) {
+        entry.second->meshDirty = true;
+    }
+}
+
+// Switches between vertex buffers and face pulling. Resident chunks keep their current mesh until
+// their background remesh is uploaded.
+// Parameters:
+//   - mode: The render mode for every chunk meshed from now on.
+void CaveGenerator::setRenderMode(RenderMode mode) {
+    if (mode == renderMode) return;
+    renderMode = mode;
+    for (auto& entry : chunks) {
+        entry.second->meshDirty = true;
+    }
+}
+
+// Reads how many texels a buffer texture may hold, which caps the faces a pulled chunk can have.
+void CaveGenerator::queryFaceRecordLimit() {
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxFaceRecords);
+    if (maxFaceRecords <= 0) {
+        maxFaceRecords = 65536; // The minimum OpenGL 3.3 guarantees
+    }
+}
+
+// Returns a snapshot of the generation pipeline metrics.
+CaveGenerator::StreamingStats CaveGenerator::getStreamingStats() const {
+    StreamingStats snapshot = stats;
+    snapshot.noiseOctavesEvaluated = noiseOctavesEvaluated;
+    snapshot.noiseOctavesSkipped = noiseOctavesSkipped;
+    std::lock_guard<std::mutex> lock(uploadMutex);
+    snapshot.uploadQueueDepth = static_cast<int>(uploadQueue.size());
+    snapshot.jobsInFlight = jobsInFlight - snapshot.uploadQueueDepth;
+    return snapshot;
+}
+
+// Whether a chunk overlaps the cave volume. Always true for an unbounded cave.
+// Parameters:
+//   - coord: Chunk coordinates.
+bool CaveGenerator::chunkInBounds(const glm::ivec3& coord) const {
+    if (!bounded) return true;
+    glm::ivec3 origin = coord * CHUNK_SIZE;
+    return origin.x + CHUNK_SIZE > 0 && origin.x < width &&
+           origin.y + CHUNK_SIZE > 0 && origin.y < height &&
+           origin.z + CHUNK_SIZE > 0 && origin.z < depth;
+}
+
+// Clips a box of voxels to the cave volume of a bounded cave. Returns false if nothing is left.
+// Parameters:
+//   - min: Lowest voxel of the box, raised to the volume.
+//   - max: One past the highest voxel, lowered to the volume.
+bool CaveGenerator::clipToBounds(glm::ivec3& min, glm::ivec3& max) const {
+    if (bounded) {
+        min = glm::ivec3(std::max(min.x, 0), std::max(min.y, 0), std::max(min.z, 0));
+        max = glm::ivec3(std::min(max.x, width), std::min(max.y, height), std::min(max.z, depth));
+    }
+    return min.x < max.x && min.y < max.y && min.z < max.z;
+}
+
+// Looks up a resident chunk by its chunk coordinates, returning nullptr if it isn't loaded.
+CaveChunk* CaveGenerator::findChunk(const glm::ivec3& coord) const {
+    auto it = chunks.find(chunkKey(coord));
+    return (it != chunks.end()) ? it->second.get() : nullptr;
+}
+
+// Fills a chunk's voxels, ghost ring included: the noise is evaluated into a scratch grid, turned
+// into materials, overwritten by the recorded edits and then packed into the chunk's palette grid.
+// Only touches the chunk itself, so chunks can be generated on worker threads.
+// Parameters:
+//   - chunk: The chunk to fill.
+//   - edits: Snapshot of the edits recorded for the chunk.
+void CaveGenerator::generateChunkVoxels(CaveChunk& chunk, const ChunkEditLog& edits) const {
+    VoxelGrid grid(CHUNK_SIZE, CHUNK_SIZE, CHUNK_SIZE, AIR_VALUE);
+    glm::ivec3 origin = chunk.origin();
+
+    std::vector<NoiseRun> runs;
+    for (int z = -1; z <= CHUNK_SIZE; ++z) {
+        for (int y = -1; y <= CHUNK_SIZE; ++y) {
+            int worldY = origin.y + y;
+            int worldZ = origin.z + z;
+            int startX = origin.x - 1;
+            int endX = origin.x + CHUNK_SIZE + 1;
+            if (bounded) {
+                // Outside the cave volume stays air
+                if (worldY < 0 || worldY >= height || worldZ < 0 || worldZ >= depth) continue;
+                startX = std::max(startX, 0);
+                endX = std::min(endX, width);
+                if (startX >= endX) continue;
+            }
+
+            NoiseRun run = { startX, worldY, worldZ, endX - startX, grid.row(y, z) + (startX - origin.x) };
+            runs.push_back(run);
+        }
+    }
+    evaluateNoise(runs);
+
+    // PaletteGrid shares VoxelGrid's indices, so the materials can be laid out in the same order
+    PaletteGrid& voxels = chunk.voxels;
+    voxels.resize(CHUNK_SIZE, CHUNK_SIZE, CHUNK_SIZE, MATERIAL_AIR);
+    std::vector<uint8_t> materials(voxels.getVoxelCount());
+    const int strideY = grid.getStrideY();
+    for (int z = -1; z <= CHUNK_SIZE; ++z) {
+        for (int y = -1; y <= CHUNK_SIZE; ++y) {
+            for (int x = -1; x <= CHUNK_SIZE; ++x) {
+                int index = grid.index(x, y, z);
+                // The top ghost row has nothing above it; its material only matters for solidity
+                bool floor = y < CHUNK_SIZE && !(grid[index + strideY] < threshold);
+                materials[index] = materialAt(grid[index], origin.y + y, floor);
+            }
+        }
+    }
+    if (edits.count > edits.recent.size()) {
+        const std::vector<uint8_t>& palette = edits.merged.getPalette();
+        size_t i = 0;
+        edits.merged.forEachEntry([&](int entry) {
+            if (palette[entry] != EDIT_UNTOUCHED) materials[i] = palette[entry];
+            ++i;
+        });
+    }
+    for (const VoxelEdit& edit : edits.recent) {
+        forEachEditedVoxel(origin, edit, [&](int x, int y, int z) { materials[voxels.index(x, y, z)] = edit.material; });
+    }
+    voxels.assign(materials.data());
+}
+
+// Material of a generated voxel.
+// Parameters:
+//   - noise: The voxel's noise value; below the threshold is rock.
+//   - y: World y coordinate of the voxel, which decides its biome.
+//   - floor: Whether the voxel above it is air.
+uint8_t CaveGenerator::materialAt(float noise, int y, bool floor) const {
+    // Keep the bands in step with evaluateNoise's early-out
+    if (!(noise < threshold)) return MATERIAL_AIR;
+    if (noise < ORE_VALUE) return MATERIAL_ORE;
+    if (y < biomeChangeYLevel) {
+        return floor ? MATERIAL_CRYSTAL_BED : MATERIAL_DEEP_ROCK;
+    }
+    return MATERIAL_ROCK;
+}
+
+// Calls visit(x, y, z) with the chunk-local coordinates of every voxel of a chunk, ghost ring
+// included, that an edit covers.
+// Parameters:
+//   - origin: World coordinates of the chunk's first voxel.
+//   - edit: The edit.
+//   - visit: Called once per covered voxel.
+template <typename Visit>
+void CaveGenerator::forEachEditedVoxel(const glm::ivec3& origin, const VoxelEdit& edit, Visit visit) {
+    glm::ivec3 lo(std::max(edit.min.x, origin.x - 1), std::max(edit.min.y, origin.y - 1), std::max(edit.min.z, origin.z - 1));
+    glm::ivec3 hi(std::min(edit.max.x, origin.x + CHUNK_SIZE + 1), std::min(edit.max.y, origin.y + CHUNK_SIZE + 1),
+                  std::min(edit.max.z, origin.z + CHUNK_SIZE + 1));
+    const float radiusSquared = edit.radius * edit.radius;
+    for (int z = lo.z; z < hi.z; ++z) {
+        for (int y = lo.y; y < hi.y; ++y) {
+            for (int x = lo.x; x < hi.x; ++x) {
+                if (edit.sphere) {
+                    glm::vec3 offset = voxelCentre(glm::ivec3(x, y, z)) - edit.centre;
+                    if (glm::dot(offset, offset) > radiusSquared) continue;
+                }
+                visit(x - origin.x, y - origin.y, z - origin.z);
+            }
+        }
+    }
+}
+
+// Writes an edit into the part of a chunk (ghost ring included) that it overlaps.
+// Parameters:
+//   - chunk: The chunk to modify.
+//   - edit: The edit to apply.
+void CaveGenerator::applyEditToChunk(CaveChunk& chunk, const VoxelEdit& edit) const {
+    glm::ivec3 origin = chunk.origin();
+    glm::ivec3 lo(std::max(edit.min.x, origin.x - 1), std::max(edit.min.y, origin.y - 1), std::max(edit.min.z, origin.z - 1));
+    glm::ivec3 hi(std::min(edit.max.x, origin.x + CHUNK_SIZE + 1), std::min(edit.max.y, origin.y + CHUNK_SIZE + 1),
+                  std::min(edit.max.z, origin.z + CHUNK_SIZE + 1));
+    PaletteGrid& voxels = chunk.voxels;
+    forEachEditedVoxel(origin, edit, [&](int x, int y, int z) { voxels.set(x, y, z, edit.material); });
+    if (edit.material != MATERIAL_AIR) {
+        chunk.occupancy.markSolid(lo.x - origin.x, lo.y - origin.y, lo.z - origin.z,
+                                  hi.x - 1 - origin.x, hi.y - 1 - origin.y, hi.z - 1 - origin.z);
+    }
+}
+
+// Appends an edit to a chunk's edit log, merging the log's recent edits into its grid of edited
+// voxels once there are more than MAX_RECENT_EDITS of them.
+// Parameters:
+//   - coord: Coordinates of the chunk.
+//   - edit: The edit, which overlaps the chunk or its ghost ring.
+void CaveGenerator::recordEdit(const glm::ivec3& coord, const VoxelEdit& edit) {
+    ChunkEditLog& edits = chunkEdits[chunkKey(coord)];
+    edits.recent.push_back(edit);
+    ++edits.count;
+    if (edits.recent.size() <= MAX_RECENT_EDITS) return;
+
+    PaletteGrid& merged = edits.merged;
+    if (merged.getVoxelCount() == 0) {
+        merged.resize(CHUNK_SIZE, CHUNK_SIZE, CHUNK_SIZE, EDIT_UNTOUCHED);
+    }
+    for (const VoxelEdit& recent : edits.recent) {
+        forEachEditedVoxel(coord * CHUNK_SIZE, recent, [&](int x, int y, int z) { merged.set(x, y, z, recent.material); });
+    }
+    merged.compact();
+    edits.recent.clear();
+}
+
+// Replays onto a chunk the recorded edits its voxels don't include yet. If some of those have been
+// merged since, the whole merged grid is replayed, which rewrites the voxels the older merged edits
+// wrote with the values they already hold.
+// Parameters:
+//   - chunk: The chunk to bring up to date.
+//   - edits: The chunk's edit log.
+//   - editCount: Edits the chunk's voxels already include.
+void CaveGenerator::replayEdits(CaveChunk& chunk, const ChunkEditLog& edits, size_t editCount) const {
+    const size_t mergedCount = edits.count - edits.recent.size();
+    size_t first = editCount - std::min(editCount, mergedCount);
+    if (editCount < mergedCount) {
+        const PaletteGrid& merged = edits.merged;
+        glm::ivec3 rockMin(CHUNK_SIZE), rockMax(-1);
+        for (int z = -1; z <= CHUNK_SIZE; ++z) {
+            for (int y = -1; y <= CHUNK_SIZE; ++y) {
+                for (int x = -1; x <= CHUNK_SIZE; ++x) {
+                    uint8_t material = merged.at(x, y, z);
+                    if (material == EDIT_UNTOUCHED) continue;
+                    chunk.voxels.set(x, y, z, material);
+                    if (material != MATERIAL_AIR) {
+                        rockMin = glm::min(rockMin, glm::ivec3(x, y, z));
+                        rockMax = glm::max(rockMax, glm::ivec3(x, y, z));
+                    }
+                }
+            }
+        }
+        if (rockMin.x <= rockMax.x) {
+            chunk.occupancy.markSolid(rockMin.x, rockMin.y, rockMin.z, rockMax.x, rockMax.y, rockMax.z);
+        }
+    }
+    for (size_t i = first; i < edits.recent.size(); ++i) {
+        applyEditToChunk(chunk, edits.recent[i]);
+    }
+}
+
+// Records an edit against every chunk whose voxels or ghost ring it overlaps and applies it to
+// the resident ones, whose light and meshes are updated by the next update(). Chunks still being
+// generated catch up when they are installed.
+// Parameters:
+//   - edit: The edit; clipped to the cave volume for a bounded cave.
+void CaveGenerator::applyEdit(const VoxelEdit& edit) {
+    VoxelEdit clipped = edit;
+    if (!clipToBounds(clipped.min, clipped.max)) return;
+
+    glm::ivec3 first = chunkCoordOf(clipped.min - glm::ivec3(1));
+    glm::ivec3 last = chunkCoordOf(clipped.max);
+    for (int cz = first.z; cz <= last.z; ++cz) {
+        for (int cy = first.y; cy <= last.y; ++cy) {
+            for (int cx = first.x; cx <= last.x; ++cx) {
+                glm::ivec3 coord(cx, cy, cz);
+                if (!chunkInBounds(coord)) continue;
+                recordEdit(coord, clipped);
+
+                CaveChunk* chunk = findChunk(coord);
+                if (!chunk) continue;
+                applyEditToChunk(*chunk, clipped);
+                chunk->editDirty = true;
+                relightEdit(*chunk, clipped);
+                // The bake no longer matches the chunk, which shows flood-filled light until the next one
+                chunk->lightBaked = false;
+                chunk->bakedLight.clear();
+                if (lightBake) lightBake->editedChunks.insert(chunkKey(coord));
+                removeBuriedCrystals(*chunk);
+            }
+        }
+    }
+}
+
+// Drops a chunk's crystals that an edit left inside rock or without a floor beneath them, and
+// takes back their light.
+// Parameters:
+//   - chunk: The edited chunk.
+void CaveGenerator::removeBuriedCrystals(CaveChunk& chunk) {
+    std::vector<glm::vec3>& positions = chunk.crystalPositions;
+    glm::ivec3 origin = chunk.origin();
+    auto buried = [&](const glm::vec3& position) {
+        glm::ivec3 local = glm::ivec3(static_cast<int>(position.x), static_cast<int>(position.y),
+                                      static_cast<int>(position.z)) - origin;
+        return chunk.voxels.isSolid(local.x, local.y, local.z) || !chunk.voxels.isSolid(local.x, local.y - 1, local.z);
+    };
+    auto kept = std::stable_partition(positions.begin(), positions.end(), [&](const glm::vec3& position) { return !buried(position); });
+    if (kept == positions.end()) return;
+    std::vector<glm::vec3> removed(kept, positions.end());
+    positions.erase(kept, positions.end());
+    crystalListDirty = true;
+    for (const glm::vec3& position : removed) {
+        crystalIndex.remove(position, 0);
+        glm::ivec3 voxel(position);
+        darkenVoxel(chunk, voxel);
+        seedLight(chunk, voxel, lightSourceLevel(chunk, voxel)); // A placed light may share the voxel
+    }
+}
+
+#pragma region Lighting
+// Places a light, or changes the level of the one already in the same voxel. The light floods the
+// cave with the next update().
+// Parameters:
+//   - position: World-space position of the light; it shines from the voxel containing it.
+//   - level: Light level at the source, from 1 to MAX_LIGHT_LEVEL.
+void CaveGenerator::addLight(const glm::vec3& position, int level) {
+    glm::ivec3 voxel = glm::ivec3(glm::floor(position)) + VOXEL_CELL_OFFSET;
+    level = std::max(1, std::min(level, MAX_LIGHT_LEVEL));
+    glm::ivec3 coord = chunkCoordOf(voxel);
+    std::vector<LightSource>& sources = chunkLights[chunkKey(coord)];
+    auto existing = std::find_if(sources.begin(), sources.end(), [&](const LightSource& source) { return source.voxel == voxel; });
+    if (existing != sources.end()) {
+        existing->level = static_cast<uint8_t>(level);
+    }
+    else {
+        LightSource source;
+        source.voxel = voxel;
+        source.level = static_cast<uint8_t>(level);
+        sources.push_back(source);
+    }
+
+    CaveChunk* chunk = findChunk(coord);
+    if (!chunk) return; // Lit when the chunk is installed
+    darkenVoxel(*chunk, voxel); // In case a brighter light was replaced
+    seedLight(*chunk, voxel, lightSourceLevel(*chunk, voxel));
+    lightEdited = true;
+}
+
+// Removes the light placed at a position; the cave around it darkens with the next update().
+// Parameters:
+//   - position: World-space position the light was placed at.
+void CaveGenerator::removeLight(const glm::vec3& position) {
+    glm::ivec3 voxel = glm::ivec3(glm::floor(position)) + VOXEL_CELL_OFFSET;
+    glm::ivec3 coord = chunkCoordOf(voxel);
+    auto placed = chunkLights.find(chunkKey(coord));
+    if (placed == chunkLights.end()) return;
+    std::vector<LightSource>& sources = placed->second;
+    auto existing = std::find_if(sources.begin(), sources.end(), [&](const LightSource& source) { return source.voxel == voxel; });
+    if (existing == sources.end()) return;
+    sources.erase(existing);
+    if (sources.empty()) {
+        chunkLights.erase(placed);
+    }
+
+    CaveChunk* chunk = findChunk(coord);
+    if (!chunk) return;
+    darkenVoxel(*chunk, voxel);
+    seedLight(*chunk, voxel, lightSourceLevel(*chunk, voxel)); // A crystal may share the voxel
+    lightEdited = true;
+}
+
+// Returns the light level of a voxel, 0 if it is dark or not resident.
+// Parameters:
+//   - x, y, z: World coordinates of the voxel.
+int CaveGenerator::getLight(int x, int y, int z) const {
+    glm::ivec3 voxel(x, y, z);
+    const CaveChunk* chunk = findChunk(chunkCoordOf(voxel));
+    if (!chunk) return 0;
+    glm::ivec3 local = voxel - chunk->origin();
+    return chunk->lightAt(local.x, local.y, local.z);
+}
+
+// Propagates the queued light changes with a breadth-first flood fill. Removals run first: they
+// darken every voxel the removed light reached and hand the brighter voxels at the edge of the
+// darkened region, lit by other sources, over to the additions. Additions then spread light through
+// the air, one level less per voxel, until it runs out. Only voxels whose light changes are visited,
+// so the work follows the size of the affected region rather than of the cave. Chunks that aren't
+// resident block light. Chunks whose faces see changed light are remeshed: on the GL thread if the
+// changes came from edits or placed lights, in the background if they came from streaming.
+void CaveGenerator::updateLighting() {
+    if (lightRemoveQueue.empty() && lightAddQueue.empty() && relitChunks.empty()) return;
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // Most neighbours share the previous voxel's chunk
+    CaveChunk* current = nullptr;
+    auto locate = [&](const glm::ivec3& voxel, glm::ivec3& local) -> CaveChunk* {
+        glm::ivec3 coord = chunkCoordOf(voxel);
+        if (!current || current->coord != coord) {
+            current = findChunk(coord);
+            if (!current) return nullptr;
+        }
+        local = voxel - current->origin();
+        return current;
+    };
+
+    // A neighbour dimmer than a darkened voxel was lit through it, so it darkens too; a neighbour at
+    // least as bright has another source and relights the region afterwards
+    for (size_t i = 0; i < lightRemoveQueue.size(); ++i) {
+        glm::ivec3 voxel = lightRemoveQueue[i].first;
+        int level = lightRemoveQueue[i].second;
+        for (int face = 0; face < SolidityMask::FACE_COUNT; ++face) {
+            glm::ivec3 neighbour = voxel + faceOffset[face];
+            glm::ivec3 local;
+            CaveChunk* chunk = locate(neighbour, local);
+            if (!chunk) continue;
+            int neighbourLevel = chunk->lightAt(local.x, local.y, local.z);
+            if (neighbourLevel == 0) continue;
+            if (neighbourLevel < level) {
+                setVoxelLight(*chunk, local, 0);
+                lightRemoveQueue.push_back(std::make_pair(neighbour, static_cast<uint8_t>(neighbourLevel)));
+                seedLight(*chunk, neighbour, lightSourceLevel(*chunk, neighbour));
+            }
+            else {
+                lightAddQueue.push_back(neighbour);
+            }
+        }
+    }
+    lightRemoveQueue.clear();
+
+    for (size_t i = 0; i < lightAddQueue.size(); ++i) {
+        glm::ivec3 voxel = lightAddQueue[i];
+        glm::ivec3 local;
+        CaveChunk* chunk = locate(voxel, local);
+        if (!chunk) continue;
+        int level = chunk->lightAt(local.x, local.y, local.z);
+        if (level <= 1) continue;
+        for (int face = 0; face < SolidityMask::FACE_COUNT; ++face) {
+            glm::ivec3 neighbour = voxel + faceOffset[face];
+            CaveChunk* neighbourChunk = locate(neighbour, local);
+            if (!neighbourChunk || neighbourChunk->voxels.isSolid(local.x, local.y, local.z) ||
+                neighbourChunk->lightAt(local.x, local.y, local.z) >= level - 1) {
+                continue;
+            }
+            setVoxelLight(*neighbourChunk, local, level - 1);
+            lightAddQueue.push_back(neighbour);
+        }
+    }
+    lightAddQueue.clear();
+
+    for (int64_t key : relitChunks) {
+        auto it = chunks.find(key);
+        if (it == chunks.end()) continue;
+        if (lightEdited) {
+            it->second->editDirty = true;
+        }
+        else {
+            it->second->meshDirty = true;
+        }
+    }
+    relitChunks.clear();
+    lightEdited = false;
+    stats.lightVoxelsLastUpdate = lightVoxelsChanged;
+    lightVoxelsChanged = 0;
+    stats.lightUpdateMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// Sets the light level of one voxel and records which chunks' faces see it: the chunk itself, and
+// the neighbouring chunk when the voxel lies on a shared face.
+// Parameters:
+//   - chunk: The voxel's chunk.
+//   - local: Chunk-local coordinates of the voxel, excluding the ghost ring.
+//   - level: New light level.
+void CaveGenerator::setVoxelLight(CaveChunk& chunk, const glm::ivec3& local, int level) {
+    if (chunk.light.empty()) {
+        if (level == 0) return;
+        chunk.light.assign(CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE, 0);
+    }
+    chunk.light[CaveChunk::lightIndex(local.x, local.y, local.z)] = static_cast<uint8_t>(level);
+    ++lightVoxelsChanged;
+    relitChunks.insert(chunkKey(chunk.coord));
+    for (int axis = 0; axis < 3; ++axis) {
+        glm::ivec3 step(0);
+        step[axis] = 1;
+        if (local[axis] == 0) relitChunks.insert(chunkKey(chunk.coord - step));
+        if (local[axis] == CHUNK_SIZE - 1) relitChunks.insert(chunkKey(chunk.coord + step));
+    }
+}
+
+// Lights a source's voxel and queues its light to spread, unless the voxel is rock or already as
+// bright.
+// Parameters:
+//   - chunk: The chunk holding the voxel.
+//   - voxel: World coordinates of the voxel.
+//   - level: Light level of the source; 0 does nothing.
+void CaveGenerator::seedLight(CaveChunk& chunk, const glm::ivec3& voxel, int level) {
+    glm::ivec3 local = voxel - chunk.origin();
+    if (level <= chunk.lightAt(local.x, local.y, local.z) || chunk.voxels.isSolid(local.x, local.y, local.z)) return;
+    setVoxelLight(chunk, local, level);
+    lightAddQueue.push_back(voxel);
+}
+
+// Darkens a voxel and queues the removal of the light that spread from it.
+// Parameters:
+//   - chunk: The chunk holding the voxel.
+//   - voxel: World coordinates of the voxel.
+void CaveGenerator::darkenVoxel(CaveChunk& chunk, const glm::ivec3& voxel) {
+    glm::ivec3 local = voxel - chunk.origin();
+    int level = chunk.lightAt(local.x, local.y, local.z);
+    if (level == 0) return;
+    setVoxelLight(chunk, local, 0);
+    lightRemoveQueue.push_back(std::make_pair(voxel, static_cast<uint8_t>(level)));
+}
+
+// Returns the brightest light source in a voxel, placed light or crystal, or 0 if there is none.
+// Parameters:
+//   - chunk: The chunk holding the voxel.
+//   - voxel: World coordinates of the voxel.
+int CaveGenerator::lightSourceLevel(const CaveChunk& chunk, const glm::ivec3& voxel) const {
+    int level = 0;
+    auto placed = chunkLights.find(chunkKey(chunk.coord));
+    if (placed != chunkLights.end()) {
+        for (const LightSource& source : placed->second) {
+            if (source.voxel == voxel) level = std::max(level, static_cast<int>(source.level));
+        }
+    }
+    glm::vec3 position(voxel);
+    for (const glm::vec3& crystal : chunk.crystalPositions) {
+        if (crystal == position) level = std::max(level, CRYSTAL_LIGHT_LEVEL);
+    }
+    return level;
+}
+
+// Queues the light of a newly resident chunk: its placed lights, plus the light of lit neighbours
+// flowing in across the shared faces. Its crystals are seeded as they spawn.
+// Parameters:
+//   - chunk: The chunk, already in the chunk map.
+void CaveGenerator::lightNewChunk(CaveChunk& chunk) {
+    auto placed = chunkLights.find(chunkKey(chunk.coord));
+    if (placed != chunkLights.end()) {
+        for (const LightSource& source : placed->second) {
+            seedLight(chunk, source.voxel, source.level);
+        }
+    }
+
+    for (int face = 0; face < SolidityMask::FACE_COUNT; ++face) {
+        const CaveChunk* neighbour = findChunk(chunk.coord + faceOffset[face]);
+        if (!neighbour || neighbour->light.empty()) continue;
+        // The neighbour's layer of voxels touching this chunk
+        int axis = face / 2;
+        glm::ivec3 local;
+        local[axis] = (faceOffset[face][axis] > 0) ? 0 : CHUNK_SIZE - 1;
+        for (int v = 0; v < CHUNK_SIZE; ++v) {
+            for (int u = 0; u < CHUNK_SIZE; ++u) {
+                local[(axis + 1) % 3] = u;
+                local[(axis + 2) % 3] = v;
+                if (neighbour->lightAt(local.x, local.y, local.z) > 1) {
+                    lightAddQueue.push_back(neighbour->origin() + local);
+                }
+            }
+        }
+    }
+}
+
+// Takes back the light of a chunk's own sources before the chunk is evicted. Light that reached the
+// chunk from elsewhere stays on the neighbours; it is rebuilt from them if the chunk comes back.
+// Parameters:
+//   - chunk: The chunk about to be evicted.
+void CaveGenerator::unlightChunk(CaveChunk& chunk) {
+    if (chunk.light.empty()) return;
+    auto placed = chunkLights.find(chunkKey(chunk.coord));
+    if (placed != chunkLights.end()) {
+        for (const LightSource& source : placed->second) {
+            darkenVoxel(chunk, source.voxel);
+        }
+    }
+    for (const glm::vec3& crystal : chunk.crystalPositions) {
+        darkenVoxel(chunk, glm::ivec3(crystal));
+    }
+    if (!lightRemoveQueue.empty()) {
+        updateLighting();
+    }
+}
+
+// Updates the light around the voxels an edit changed inside a chunk: filled voxels go dark and
+// take back the light that passed through them, carved voxels let the light of their neighbours
+// in and relight any source placed in them.
+// Parameters:
+//   - chunk: The edited chunk.
+//   - edit: The edit, already applied to the chunk.
+void CaveGenerator::relightEdit(CaveChunk& chunk, const VoxelEdit& edit) {
+    glm::ivec3 origin = chunk.origin();
+    forEachEditedVoxel(origin, edit, [&](int x, int y, int z) {
+        // Ghost voxels are handled with the chunk they belong to
+        if (x < 0 || y < 0 || z < 0 || x >= CHUNK_SIZE || y >= CHUNK_SIZE || z >= CHUNK_SIZE) return;
+        glm::ivec3 voxel = origin + glm::ivec3(x, y, z);
+        if (edit.material != MATERIAL_AIR) {
+            darkenVoxel(chunk, voxel);
+            return;
+        }
+        for (int face = 0; face < SolidityMask::FACE_COUNT; ++face) {
+            lightAddQueue.push_back(voxel + faceOffset[face]);
+        }
+        seedLight(chunk, voxel, lightSourceLevel(chunk, voxel));
+    });
+    lightEdited = true;
+}
+
+// Builds the light grid a chunk is meshed with: the chunk's light plus the border light of its six
+// neighbours, in the layout of the chunk's voxel grid so the two share indices. With path-traced
+// lighting, every chunk that has a bake contributes its baked light instead of its flooded light.
+// Must run on the GL thread.
+// Parameters:
+//   - chunk: The chunk about to be meshed.
+//   - light: Receives the grid.
+// Returns false, leaving light alone, if neither the chunk nor its neighbours are lit.
+bool CaveGenerator::gatherLight(const CaveChunk& chunk, std::vector<uint8_t>& light) const {
+    const bool pathTraced = lightingMode == LIGHTING_PATH_TRACED;
+    auto lightOf = [pathTraced](const CaveChunk& source) -> const std::vector<uint8_t>& {
+        return (pathTraced && source.lightBaked) ? source.bakedLight : source.light;
+    };
+    const CaveChunk* neighbours[SolidityMask::FACE_COUNT];
+    const std::vector<uint8_t>& own = lightOf(chunk);
+    bool lit = !own.empty();
+    for (int face = 0; face < SolidityMask::FACE_COUNT; ++face) {
+        neighbours[face] = findChunk(chunk.coord + faceOffset[face]);
+        if (neighbours[face] && lightOf(*neighbours[face]).empty()) neighbours[face] = nullptr;
+        lit = lit || neighbours[face];
+    }
+    if (!lit) return false;
+
+    const PaletteGrid& voxels = chunk.voxels;
+    light.assign(voxels.getVoxelCount(), 0);
+    if (!own.empty()) {
+        for (int z = 0; z < CHUNK_SIZE; ++z) {
+            for (int y = 0; y < CHUNK_SIZE; ++y) {
+                std::copy_n(&own[CaveChunk::lightIndex(0, y, z)], CHUNK_SIZE, &light[voxels.index(0, y, z)]);
+            }
+        }
+    }
+    for (int face = 0; face < SolidityMask::FACE_COUNT; ++face) {
+        if (!neighbours[face]) continue;
+        const std::vector<uint8_t>& border = lightOf(*neighbours[face]);
+        // The ghost layer on this side, filled from the neighbour's opposite border
+        int axis = face / 2;
+        glm::ivec3 ghost;
+        ghost[axis] = (faceOffset[face][axis] > 0) ? CHUNK_SIZE : -1;
+        for (int v = 0; v < CHUNK_SIZE; ++v) {
+            for (int u = 0; u < CHUNK_SIZE; ++u) {
+                ghost[(axis + 1) % 3] = u;
+                ghost[(axis + 2) % 3] = v;
+                glm::ivec3 source = ghost - faceOffset[face] * CHUNK_SIZE;
+                light[voxels.index(ghost.x, ghost.y, ghost.z)] = border[CaveChunk::lightIndex(source.x, source.y, source.z)];
+            }
+        }
+    }
+    return true;
+}
+
+// Chooses between flood-filled and path-traced light. Resident chunks keep their current mesh
+// until their background remesh is uploaded.
+// Parameters:
+//   - mode: The lighting mode for every chunk meshed from now on.
+void CaveGenerator::setLightingMode(LightingMode mode) {
+    if (mode == lightingMode) return;
+    lightingMode = mode;
+    for (auto& entry : chunks) {
+        entry.second->meshDirty = true;
+    }
+}
+
+// Splitmix64: advances a generator state and returns the next well-mixed value. Light bake samples
+// seed it from their chunk, voxel and sample number, so a bake gives the same light however its
+// work is spread over the threads.
+static uint64_t nextRandom(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Uniform random number in [0, 1).
+static float randomUnit(uint64_t& state) {
+    return static_cast<float>(nextRandom(state) >> 40) * (1.0f / 16777216.0f);
+}
+
+// Light level whose brightness, as the shaders decode it, is nearest a baked brightness. Level
+// MAX_LIGHT_LEVEL is brightness 1, and each level below is LIGHT_LEVEL_FALLOFF times the one above.
+static int bakedLightLevel(float brightness) {
+    if (brightness < BAKED_LIGHT_CUTOFF) return 0;
+    float level = static_cast<float>(MAX_LIGHT_LEVEL) + std::log(brightness) / -std::log(LIGHT_LEVEL_FALLOFF);
+    return std::min(MAX_LIGHT_LEVEL, std::max(1, static_cast<int>(std::floor(level + 0.5f))));
+}
+
+// Starts path tracing the light of every placed light and crystal in the resident chunks into the
+// air voxels in front of cave faces, which are the voxels the faces take their light from. Sources
+// are point emitters, so each sample connects straight to every source in reach with a shadow ray,
+// then follows a path of diffuse bounces off the rock, lighting each bounce the same way. The voxel
+// lattice, with the occupancy pyramids skipping empty space, is the acceleration structure: rays
+// are traced by traceRay, the same as raycastBatch. Only the sources and the resident chunks are
+// collected here; update() does the rest in slices, see stepLightBake.
+// Parameters:
+//   - settings: Samples, bounces, rock albedo and time per update() call.
+void CaveGenerator::startLightBake(const LightBakeSettings& settings) {
+    lightBake.reset(new LightBake());
+    LightBake& bake = *lightBake;
+    bake.settings = settings;
+
+    // Every source as xyz position and w intensity. A source of level L is bright enough for its
+    // unshadowed light to fade to the dimmest level L voxels away, where its flood fill runs out.
+    auto addEmitter = [&](const glm::ivec3& voxel, int level) {
+        float intensity = std::pow(LIGHT_LEVEL_FALLOFF, static_cast<float>(MAX_LIGHT_LEVEL - 1)) * static_cast<float>(level * level);
+        bake.emitters.push_back(glm::vec4(voxelCentre(voxel), intensity));
+    };
+    for (auto& entry : chunks) {
+        auto placed = chunkLights.find(entry.first);
+        if (placed != chunkLights.end()) {
+            for (const LightSource& source : placed->second) {
+                addEmitter(source.voxel, source.level);
+            }
+        }
+        for (const glm::vec3& crystal : entry.second->crystalPositions) {
+            addEmitter(glm::ivec3(crystal), CRYSTAL_LIGHT_LEVEL);
+        }
+    }
+
+    for (auto& entry : chunks) {
+        const CaveChunk& chunk = *entry.second;
+        bake.residentChunks.push_back(std::make_pair(entry.first, chunk.id));
+        if (chunk.voxels.isUniform()) continue; // Air or rock throughout, ghost ring included: no faces
+        LightBakeChunk traced;
+        traced.coord = chunk.coord;
+        traced.chunkId = chunk.id;
+        bake.traced.push_back(std::move(traced));
+    }
+}
+
+// Advances the light bake in progress by about millisBudget, and always by at least one batch so
+// it finishes however small the budget. Each batch is a task per thread: first the traced chunks
+// have their voxels and sources gathered, a chunk per task, then passes of one sample per voxel
+// are traced, BAKE_VOXELS_PER_TASK voxels per task. A pass can span several update() calls, as
+// every sample is seeded from its chunk, voxel and pass, not from when it is taken. Once every
+// voxel has all its samples, or the next pass would take the bake past maxBakeMillis, the light
+// is installed; stopping between passes leaves every voxel with the same number of samples.
+// Parameters:
+//   - millisBudget: Time to spend; a batch isn't started if the last one suggests it would overrun.
+void CaveGenerator::stepLightBake(double millisBudget) {
+    LightBake& bake = *lightBake;
+    const LightBakeSettings& settings = bake.settings;
+    const int batch = static_cast<int>(threadPool->size()) + 1;
+    double spent = 0.0, lastBatch = 0.0;
+    // A pass not yet started that the last one suggests would overrun the bake's budget. The
+    // first pass always runs, so a bake never ends without light.
+    auto passOverrunsBake = [&]() {
+        return settings.maxBakeMillis > 0.0 && bake.nextTask == 0 && bake.stats.samplesPerVoxel > 0 &&
+               bake.stats.milliseconds + bake.lastPassMillis > settings.maxBakeMillis;
+    };
+    do {
+        auto start = std::chrono::high_resolution_clock::now();
+        bool passFinished = false;
+        if (bake.gathered < bake.traced.size()) {
+            size_t first = bake.gathered;
+            int count = static_cast<int>(std::min(static_cast<size_t>(batch), bake.traced.size() - first));
+            threadPool->parallelFor(0, count, [&](int i) {
+                gatherLightBakeChunk(bake.traced[first + i], bake.emitters, settings.maxBounces);
+            });
+            bake.gathered += count;
+            if (bake.gathered == bake.traced.size()) {
+                // Each task is a run of one chunk's voxels, so a few brightly lit chunks still spread over every thread
+                for (size_t i = 0; i < bake.traced.size(); ++i) {
+                    const LightBakeChunk& traced = bake.traced[i];
+                    if (traced.voxels.empty()) continue;
+                    ++bake.stats.chunks;
+                    bake.stats.voxels += traced.voxels.size();
+                    for (size_t v = 0; v < traced.voxels.size(); v += BAKE_VOXELS_PER_TASK) {
+                        bake.tasks.push_back(std::make_pair(static_cast<int>(i), static_cast<int>(v)));
+                    }
+                }
+            }
+        }
+        else if (bake.stats.samplesPerVoxel < settings.samplesPerVoxel && !bake.tasks.empty() && !passOverrunsBake()) {
+            if (bake.nextTask == 0) bake.passStartMillis = bake.stats.milliseconds;
+            size_t first = bake.nextTask;
+            int count = static_cast<int>(std::min(static_cast<size_t>(batch), bake.tasks.size() - first));
+            const uint64_t sample = static_cast<uint64_t>(bake.stats.samplesPerVoxel);
+            std::atomic<uint64_t> rays(0);
+            threadPool->parallelFor(0, count, [&](int i) {
+                const std::pair<int, int>& task = bake.tasks[first + i];
+                LightBakeChunk& traced = bake.traced[task.first];
+                const glm::ivec3 origin = traced.coord * CHUNK_SIZE;
+                const uint64_t chunkSeed = static_cast<uint64_t>(chunkKey(traced.coord)) * 0x9E3779B97F4A7C15ull;
+                size_t end = std::min(traced.voxels.size(), static_cast<size_t>(task.second + BAKE_VOXELS_PER_TASK));
+                uint64_t taskRays = 0;
+                for (size_t v = static_cast<size_t>(task.second); v < end; ++v) {
+                    int index = traced.voxels[v];
+                    glm::vec3 centre = voxelCentre(origin + CaveChunk::lightVoxel(index));
+                    uint64_t seed = chunkSeed ^ (static_cast<uint64_t>(index) << 32) ^ sample;
+                    traced.brightness[v] += sampleBakedLight(centre, traced.emitters, settings, seed, taskRays);
+                }
+                rays += taskRays;
+            });
+            bake.stats.rays += rays;
+            bake.nextTask += count;
+            if (bake.nextTask == bake.tasks.size()) {
+                bake.nextTask = 0;
+                ++bake.stats.samplesPerVoxel;
+                passFinished = true;
+            }
+        }
+        else {
+            finishLightBake();
+            return;
+        }
+        lastBatch = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        spent += lastBatch;
+        bake.stats.milliseconds += lastBatch;
+        if (passFinished) bake.lastPassMillis = bake.stats.milliseconds - bake.passStartMillis;
+    } while (spent + lastBatch <= millisBudget);
+}
+
+// Finds a traced chunk's air voxels in front of a cave face, and the sources whose light can reach
+// the chunk directly or over the bounces. Leaves the chunk without voxels if it was evicted or no
+// source reaches it, so it is baked dark without tracing. Runs on the workers.
+// Parameters:
+//   - bake: The chunk to gather.
+//   - emitters: Every source of the bake.
+//   - maxBounces: Bounces per path, which carry light further than the sources reach directly.
+void CaveGenerator::gatherLightBakeChunk(LightBakeChunk& bake, const std::vector<glm::vec4>& emitters, int maxBounces) const {
+    const CaveChunk* chunk = findChunk(bake.coord);
+    if (!chunk || chunk->id != bake.chunkId) return;
+
+    const float bounceReach = static_cast<float>(std::max(maxBounces, 0)) * BAKE_BOUNCE_DISTANCE;
+    glm::vec3 boxMin = voxelCentre(chunk->origin()) - glm::vec3(0.5f);
+    glm::vec3 boxMax = boxMin + glm::vec3(static_cast<float>(CHUNK_SIZE));
+    for (const glm::vec4& emitter : emitters) {
+        glm::vec3 position(emitter);
+        glm::vec3 nearest = glm::clamp(position, boxMin, boxMax);
+        float range = std::sqrt(emitter.w / BAKED_LIGHT_CUTOFF) + bounceReach;
+        if (glm::dot(position - nearest, position - nearest) <= range * range) {
+            bake.emitters.push_back(emitter);
+        }
+    }
+    if (bake.emitters.empty()) return;
+
+    const PaletteGrid& voxels = chunk->voxels;
+    for (int z = 0; z < CHUNK_SIZE; ++z) {
+        for (int y = 0; y < CHUNK_SIZE; ++y) {
+            for (int x = 0; x < CHUNK_SIZE; ++x) {
+                if (voxels.isSolid(x, y, z)) continue;
+                bool faced = false;
+                for (int face = 0; face < SolidityMask::FACE_COUNT && !faced; ++face) {
+                    faced = voxels.isSolid(x + faceOffset[face].x, y + faceOffset[face].y, z + faceOffset[face].z);
+                }
+                if (faced) bake.voxels.push_back(CaveChunk::lightIndex(x, y, z));
+            }
+        }
+    }
+    bake.brightness.assign(bake.voxels.size(), 0.0f);
+}
+
+// Installs the finished light bake into every chunk it started with that is still resident and
+// unedited, remeshing them if path-traced light is shown, and ends the bake.
+void CaveGenerator::finishLightBake() {
+    LightBake& bake = *lightBake;
+    auto target = [&](int64_t key, uint64_t id) -> CaveChunk* {
+        auto it = chunks.find(key);
+        if (it == chunks.end() || it->second->id != id || bake.editedChunks.count(key)) return nullptr;
+        return it->second.get();
+    };
+    const bool remesh = lightingMode == LIGHTING_PATH_TRACED;
+    for (const auto& resident : bake.residentChunks) {
+        CaveChunk* chunk = target(resident.first, resident.second);
+        if (!chunk) continue;
+        chunk->bakedLight.clear();
+        chunk->lightBaked = true;
+        if (remesh) chunk->meshDirty = true;
+    }
+
+    const float samples = static_cast<float>(std::max(bake.stats.samplesPerVoxel, 1));
+    for (const LightBakeChunk& traced : bake.traced) {
+        CaveChunk* chunk = target(chunkKey(traced.coord), traced.chunkId);
+        if (!chunk || traced.voxels.empty()) continue;
+        chunk->bakedLight.assign(CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE, 0);
+        bool lit = false;
+        for (size_t v = 0; v < traced.voxels.size(); ++v) {
+            int level = bakedLightLevel(traced.brightness[v] / samples);
+            chunk->bakedLight[traced.voxels[v]] = static_cast<uint8_t>(level);
+            lit = lit || level > 0;
+        }
+        if (!lit) chunk->bakedLight.clear();
+    }
+
+    lastLightBakeStats = bake.stats;
+    lightBake.reset();
+}
+
+// Takes one sample of the light reaching a voxel: a random point in the voxel, its direct light
+// from every source in reach, then a path of up to maxBounces diffuse bounces, each bounce adding
+// the direct light its point of the rock reflects. Brightness is measured as on a surface facing
+// the light, so a source of intensity I is I / d^2 bright at distance d.
+// Parameters:
+//   - position: Centre of the voxel.
+//   - emitters: Sources that can reach it, as position and intensity.
+//   - settings: Bounces and albedo.
+//   - seed: Seeds the sample's random numbers.
+//   - rays: Incremented for every ray traced.
+float CaveGenerator::sampleBakedLight(const glm::vec3& position, const std::vector<glm::vec4>& emitters, const LightBakeSettings& settings,
+                                      uint64_t seed, uint64_t& rays) const {
+    const float pi = 3.14159265358979f;
+    uint64_t state = seed;
+    glm::vec3 point = position + (glm::vec3(randomUnit(state), randomUnit(state), randomUnit(state)) - glm::vec3(0.5f)) * 0.8f;
+
+    float brightness = 0.0f;
+    for (const glm::vec4& emitter : emitters) {
+        glm::vec3 toLight = glm::vec3(emitter) - point;
+        float light = emitter.w / std::max(glm::dot(toLight, toLight), 1.0f);
+        if (light >= BAKED_LIGHT_CUTOFF && lightVisible(point, glm::vec3(emitter), rays)) {
+            brightness += light;
+        }
+    }
+
+    // Leaving the voxel in a uniformly random direction, the light arriving from it stands for
+    // all the light around the voxel: pi times its radiance
+    float z = 1.0f - 2.0f * randomUnit(state);
+    float radius = std::sqrt(std::max(0.0f, 1.0f - z * z));
+    float angle = 2.0f * pi * randomUnit(state);
+    glm::vec3 direction(radius * std::cos(angle), radius * std::sin(angle), z);
+    float throughput = pi;
+    for (int bounce = 0; bounce < settings.maxBounces; ++bounce) {
+        RayQuery query;
+        query.origin = point;
+        query.direction = direction;
+        query.maxDistance = BAKE_BOUNCE_DISTANCE;
+        RayHit hit = traceRay(query);
+        ++rays;
+        if (!hit.hit) break;
+        glm::ivec3 step = hit.lastEmptyVoxel - hit.voxel;
+        if (std::abs(step.x) + std::abs(step.y) + std::abs(step.z) != 1) break; // The path started inside rock
+        glm::vec3 normal(step);
+        point += direction * hit.distance + normal * 1e-3f;
+
+        // Direct light on the rock, reflected diffusely towards the previous point on the path
+        float irradiance = 0.0f;
+        for (const glm::vec4& emitter : emitters) {
+            glm::vec3 toLight = glm::vec3(emitter) - point;
+            float distanceSquared = std::max(glm::dot(toLight, toLight), 1.0f);
+            float facing = glm::dot(normal, toLight);
+            if (facing <= 0.0f || emitter.w / distanceSquared < BAKED_LIGHT_CUTOFF) continue;
+            if (lightVisible(point, glm::vec3(emitter), rays)) {
+                irradiance += emitter.w * facing / (std::sqrt(glm::dot(toLight, toLight)) * distanceSquared);
+            }
+        }
+        throughput *= settings.albedo / pi;
+        brightness += throughput * irradiance;
+
+        // Cosine-weighted next direction about the normal, so the light it brings back stands for
+        // pi times its radiance again
+        throughput *= pi;
+        glm::vec3 tangent = (std::abs(normal.x) > 0.5f) ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+        glm::vec3 bitangent = glm::cross(normal, tangent);
+        float u = randomUnit(state);
+        float r = std::sqrt(u);
+        angle = 2.0f * pi * randomUnit(state);
+        direction = tangent * (r * std::cos(angle)) + bitangent * (r * std::sin(angle)) + normal * std::sqrt(1.0f - u);
+    }
+    return brightness;
+}
+
+// Whether nothing solid lies between two points, for a light bake's shadow rays.
+// Parameters:
+//   - from: Point being lit.
+//   - to: Position of the light.
+//   - rays: Incremented for the ray traced.
+bool CaveGenerator::lightVisible(const glm::vec3& from, const glm::vec3& to, uint64_t& rays) const {
+    RayQuery query;
+    query.origin = from;
+    query.direction = to - from;
+    query.maxDistance = glm::length(query.direction);
+    ++rays;
+    RayHit hit = traceRay(query);
+    return !hit.hit || hit.distance >= query.maxDistance;
+}
+#pragma endregion
+
+// Builds a sphere edit covering the voxels whose centres lie within radius of a point.
+// Parameters:
+//   - centre: World-space centre of the sphere.
+//   - radius: Radius in voxels.
+//   - material: VoxelMaterial written into the covered voxels.
+CaveGenerator::VoxelEdit CaveGenerator::sphereEdit(const glm::vec3& centre, float radius, uint8_t material) {
+    VoxelEdit edit;
+    edit.sphere = true;
+    edit.centre = centre;
+    edit.radius = radius;
+    edit.material = material;
+    // Every voxel whose centre can lie within the sphere; see VOXEL_CELL_OFFSET for the z shift
+    edit.min = glm::ivec3(static_cast<int>(std::floor(centre.x - radius)), static_cast<int>(std::floor(centre.y - radius)),
+                          static_cast<int>(std::floor(centre.z - radius))) + VOXEL_CELL_OFFSET;
+    edit.max = glm::ivec3(static_cast<int>(std::floor(centre.x + radius)), static_cast<int>(std::floor(centre.y + radius)),
+                          static_cast<int>(std::floor(centre.z + radius))) + VOXEL_CELL_OFFSET + glm::ivec3(1);
+    return edit;
+}
+
+// Builds a box edit.
+// Parameters:
+//   - min, max: The voxels [min, max) in world coordinates.
+//   - material: VoxelMaterial written into the covered voxels.
+CaveGenerator::VoxelEdit CaveGenerator::boxEdit(const glm::ivec3& min, const glm::ivec3& max, uint8_t material) {
+    VoxelEdit edit;
+    edit.min = min;
+    edit.max = max;
+    edit.sphere = false;
+    edit.centre = glm::vec3(0.0f);
+    edit.radius = 0.0f;
+    edit.material = material;
+    return edit;
+}
+
+// Sets the voxels within radius of a point to air.
+// Parameters:
+//   - centre: World-space centre of the sphere.
+//   - radius: Radius in voxels.
+void CaveGenerator::carveSphere(const glm::vec3& centre, float radius) {
+    applyEdit(sphereEdit(centre, radius, MATERIAL_AIR));
+}
+
+// Sets the voxels within radius of a point to rock.
+// Parameters:
+//   - centre: World-space centre of the sphere.
+//   - radius: Radius in voxels.
+void CaveGenerator::fillSphere(const glm::vec3& centre, float radius) {
+    applyEdit(sphereEdit(centre, radius, MATERIAL_ROCK));
+}
+
+// Sets a box of voxels to air.
+// Parameters:
+//   - min, max: The voxels [min, max) in world coordinates.
+void CaveGenerator::carveBox(const glm::ivec3& min, const glm::ivec3& max) {
+    applyEdit(boxEdit(min, max, MATERIAL_AIR));
+}
+
+// Sets a box of voxels to rock.
+// Parameters:
+//   - min, max: The voxels [min, max) in world coordinates.
+void CaveGenerator::fillBox(const glm::ivec3& min, const glm::ivec3& max) {
+    applyEdit(boxEdit(min, max, MATERIAL_ROCK));
+}
+
+// Finds the first solid voxel along a ray; see traceRay.
+// Parameters:
+//   - origin: World-space start of the ray.
+//   - direction: Direction of the ray; need not be normalized.
+//   - maxDistance: Distance along the ray, in voxels, after which the search gives up.
+//   - hitVoxel: Receives the first solid voxel.
+//   - lastEmptyVoxel: Receives the voxel visited just before it (the hit voxel itself if the ray
+//     starts inside rock).
+bool CaveGenerator::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+                            glm::ivec3& hitVoxel, glm::ivec3& lastEmptyVoxel) const {
+    RayQuery query;
+    query.origin = origin;
+    query.direction = direction;
+    query.maxDistance = maxDistance;
+    RayHit result = traceRay(query);
+    if (!result.hit) return false;
+    hitVoxel = result.voxel;
+    lastEmptyVoxel = result.lastEmptyVoxel;
+    return true;
+}
+
+// Traces a batch of rays. Rays are handed out to the workers in blocks, so the cost of a block
+// is dominated by tracing rather than by scheduling.
+// Parameters:
+//   - queries: The rays to trace.
+//   - hits: Receives one result per query, in the same order.
+void CaveGenerator::raycastBatch(const std::vector<RayQuery>& queries, std::vector<RayHit>& hits) const {
+    const int blockSize = 256;
+    hits.resize(queries.size());
+    int blocks = static_cast<int>((queries.size() + blockSize - 1) / blockSize);
+    threadPool->parallelFor(0, blocks, [&](int block) {
+        size_t end = std::min(queries.size(), static_cast<size_t>(block + 1) * blockSize);
+        for (size_t i = static_cast<size_t>(block) * blockSize; i < end; ++i) {
+            hits[i] = traceRay(queries[i]);
+        }
+    });
+}
+
+// Traces one ray with an Amanatides and Woo DDA, stepping through the voxel lattice one cell
+// boundary at a time so no voxel the ray passes through is missed. Whenever the ray enters a cube
+// the chunk's occupancy pyramid knows to be empty, or a chunk that isn't resident (which reads as
+// air), it jumps straight to where it leaves that cube and restarts the DDA there, so long rays
+// through open tunnels cost a handful of steps per empty region instead of one per voxel.
+// Only reads resident chunks, so any number of rays can be traced at once while nothing edits them.
+// Parameters:
+//   - query: The ray.
+CaveGenerator::RayHit CaveGenerator::traceRay(const RayQuery& query) const {
+    RayHit result;
+    result.hit = false;
+    result.distance = query.maxDistance;
+    result.voxel = result.lastEmptyVoxel = glm::ivec3(0);
+    if (glm::dot(query.direction, query.direction) < 1e-12f) return result;
+
+    const glm::vec3 origin = query.origin;
+    const glm::vec3 dir = glm::normalize(query.direction);
+    const float infinity = std::numeric_limits<float>::infinity();
+
+    // DDA over lattice cells; the voxel in a cell is cell + VOXEL_CELL_OFFSET
+    glm::ivec3 cell(static_cast<int>(std::floor(origin.x)), static_cast<int>(std::floor(origin.y)),
+                    static_cast<int>(std::floor(origin.z)));
+    glm::ivec3 step(0);
+    glm::vec3 tMax(infinity), tDelta(infinity);
+    for (int axis = 0; axis < 3; ++axis) {
+        if (dir[axis] > 0.0f) {
+            step[axis] = 1;
+            tDelta[axis] = 1.0f / dir[axis];
+            tMax[axis] = (static_cast<float>(cell[axis] + 1) - origin[axis]) * tDelta[axis];
+        }
+        else if (dir[axis] < 0.0f) {
+            step[axis] = -1;
+            tDelta[axis] = -1.0f / dir[axis];
+            tMax[axis] = (origin[axis] - static_cast<float>(cell[axis])) * tDelta[axis];
+        }
+    }
+
+    glm::ivec3 previous = cell + VOXEL_CELL_OFFSET;
+    glm::ivec3 chunkCoord = chunkCoordOf(previous);
+    const CaveChunk* chunk = findChunk(chunkCoord);
+    float distance = 0.0f;
+    while (distance <= query.maxDistance) {
+        glm::ivec3 voxel = cell + VOXEL_CELL_OFFSET;
+        glm::ivec3 coord = chunkCoordOf(voxel);
+        if (coord != chunkCoord) {
+            chunkCoord = coord;
+            chunk = findChunk(coord);
+        }
+        glm::ivec3 chunkOrigin = chunkCoord * CHUNK_SIZE;
+        glm::ivec3 local = voxel - chunkOrigin;
+
+        int emptySize = CHUNK_SIZE;
+        if (chunk) {
+            if (chunk->voxels.isSolid(local.x, local.y, local.z)) {
+                result.hit = true;
+                result.distance = distance;
+                result.voxel = voxel;
+                result.lastEmptyVoxel = previous;
+                return result;
+            }
+            emptySize = chunk->occupancy.emptyCellSize(local.x, local.y, local.z);
+        }
+
+        if (emptySize > 1) {
+            // Leave the empty cube in one jump, through whichever face the ray reaches first
+            glm::ivec3 cubeMin = chunkOrigin + glm::ivec3(local.x / emptySize, local.y / emptySize, local.z / emptySize) * emptySize
+                               - VOXEL_CELL_OFFSET;
+            int exitAxis = 0;
+            float exitDistance = infinity;
+            for (int axis = 0; axis < 3; ++axis) {
+                if (step[axis] == 0) continue;
+                float face = static_cast<float>(step[axis] > 0 ? cubeMin[axis] + emptySize : cubeMin[axis]);
+                float t = (face - origin[axis]) / dir[axis];
+                if (t < exitDistance) {
+                    exitDistance = t;
+                    exitAxis = axis;
+                }
+            }
+            if (exitDistance > query.maxDistance) break;
+
+            // Restart the DDA in the cell across the exit face, keeping the other axes inside the
+            // cube so rounding can't push the ray into a neighbouring cell it never reached
+            glm::vec3 exitPoint = origin + dir * exitDistance;
+            for (int axis = 0; axis < 3; ++axis) {
+                if (axis == exitAxis) {
+                    cell[axis] = (step[axis] > 0) ? cubeMin[axis] + emptySize : cubeMin[axis] - 1;
+                }
+                else {
+                    cell[axis] = std::min(std::max(static_cast<int>(std::floor(exitPoint[axis])), cubeMin[axis]),
+                                          cubeMin[axis] + emptySize - 1);
+                }
+                if (step[axis] != 0) {
+                    float boundary = static_cast<float>(step[axis] > 0 ? cell[axis] + 1 : cell[axis]);
+                    tMax[axis] = (boundary - origin[axis]) / dir[axis];
+                }
+            }
+            previous = cell + VOXEL_CELL_OFFSET;
+            previous[exitAxis] -= step[exitAxis];
+            distance = std::max(distance, exitDistance);
+            continue;
+        }
+        previous = voxel;
+
+        // Cross whichever cell boundary the ray reaches first
+        int axis = (tMax.x < tMax.y) ? ((tMax.x < tMax.z) ? 0 : 2) : ((tMax.y < tMax.z) ? 1 : 2);
+        distance = tMax[axis];
+        cell[axis] += step[axis];
+        tMax[axis] += tDelta[axis];
+    }
+    return result;
+}
+
+// Sweeps a box through the voxel lattice one axis at a time, vertical first. Along each axis only
+// the layers of cells the leading face enters are tested, nearest first, and the motion is cut
+// short just before the first layer holding rock. The other axes keep their full motion, which is
+// what makes the box slide along walls, floors and ceilings instead of sticking to them.
+// Parameters:
+//   - centre: World-space centre of the box.
+//   - halfExtents: Half the box size along each axis.
+//   - motion: Desired displacement this step.
+glm::vec3 CaveGenerator::sweepBox(const glm::vec3& centre, const glm::vec3& halfExtents, const glm::vec3& motion) const {
+    const float skin = 1e-3f; // Gap kept between the box and the rock it stops against
+    glm::vec3 boxMin = centre - halfExtents;
+    glm::vec3 boxMax = centre + halfExtents;
+    static const int axisOrder[3] = { 1, 0, 2 };
+
+    for (int axis : axisOrder) {
+        float delta = motion[axis];
+        if (delta == 0.0f) continue;
+        const int u = (axis + 1) % 3;
+        const int v = (axis + 2) % 3;
+
+        // Cells the box overlaps across the motion; cell c covers [c, c + 1) and holds voxel c + VOXEL_CELL_OFFSET
+        int uFirst = static_cast<int>(std::floor(boxMin[u])), uLast = static_cast<int>(std::ceil(boxMax[u])) - 1;
+        int vFirst = static_cast<int>(std::floor(boxMin[v])), vLast = static_cast<int>(std::ceil(boxMax[v])) - 1;
+
+        // Layers entered by the leading face, nearest first
+        int layer, lastLayer, layerStep;
+        if (delta > 0.0f) {
+            layer = static_cast<int>(std::ceil(boxMax[axis]));
+            lastLayer = static_cast<int>(std::ceil(boxMax[axis] + delta)) - 1;
+            layerStep = 1;
+        }
+        else {
+            layer = static_cast<int>(std::floor(boxMin[axis])) - 1;
+            lastLayer = static_cast<int>(std::floor(boxMin[axis] + delta));
+            layerStep = -1;
+        }
+
+        for (; (layer - lastLayer) * layerStep <= 0; layer += layerStep) {
+            bool blocked = false;
+            glm::ivec3 cell;
+            cell[axis] = layer;
+            for (int a = uFirst; a <= uLast && !blocked; ++a) {
+                for (int b = vFirst; b <= vLast && !blocked; ++b) {
+                    cell[u] = a;
+                    cell[v] = b;
+                    glm::ivec3 voxel = cell + VOXEL_CELL_OFFSET;
+                    blocked = isSolid(voxel.x, voxel.y, voxel.z);
+                }
+            }
+            if (blocked) {
+                delta = (delta > 0.0f) ? std::max(0.0f, static_cast<float>(layer) - boxMax[axis] - skin)
+                                       : std::min(0.0f, static_cast<float>(layer + 1) - boxMin[axis] + skin);
+                break;
+            }
+        }
+
+        boxMin[axis] += delta;
+        boxMax[axis] += delta;
+    }
+    return (boxMin + boxMax) * 0.5f;
+}
+
+// World-space centre of a voxel; see VOXEL_CELL_OFFSET.
+// Parameters:
+//   - voxel: World coordinates of the voxel.
+glm::vec3 CaveGenerator::voxelCentre(const glm::ivec3& voxel) {
+    return glm::vec3(voxel - VOXEL_CELL_OFFSET) + glm::vec3(0.5f);
+}
+
+// Builds the vertex data for a chunk by determining which blocks are solid and which of their faces
+// are exposed. Touches only its arguments, so chunks can be meshed on worker threads.
+// Parameters:
+//   - voxels: The chunk's voxel grid, ghost ring included.
+//   - light: Light levels in the voxel grid's layout, as built by gatherLight, or nullptr if the
+//     chunk is dark. Every face is baked with the light of the air voxel in front of it.
+//   - mode: Naive unit faces or greedy merged rectangles.
+//   - render: Face pulling leaves the mesh as face records; otherwise, or if the chunk has more
+//     faces than a buffer texture holds, the records are expanded into vertices.
+//   - occlusion: Bake ambient occlusion into the face corners.
+//   - solidMask: Rebuilt from the voxels.
+//   - floorVoxels: Rebuilt from the solidity mask; see CaveChunk::floorVoxels.
+//   - faceData: Receives the chunk's face records when the chunk is pulled.
+//   - vertexData: Receives the chunk's vertices, relative to the chunk origin, otherwise.
+// Returns the number of exposed voxel faces, which is what the naive mode emits.
+unsigned int CaveGenerator::meshChunk(const PaletteGrid& voxels, const uint8_t* light, MeshingMode mode, RenderMode render, bool occlusion,
+                                      SolidityMask& solidMask, std::vector<uint16_t>& floorVoxels, std::vector<uint64_t>& faceData,
+                                      std::vector<Vertex>& vertexData) const {
+    // Collapse the materials to one bit per voxel so faces can be culled 64 voxels at a time
+    solidMask.build(voxels);
+    collectFloorVoxels(solidMask, floorVoxels);
+    if (voxels.isUniform()) return 0; // Solid or air throughout, ghost ring included: no faces
+    if (mode == MESHING_GREEDY) {
+        meshGreedy(solidMask, light, occlusion, faceData);
+    }
+    const int wordsPerRow = solidMask.getWordsPerRow();
+    int lightOffset[SolidityMask::FACE_COUNT];
+    for (int face = 0; face < SolidityMask::FACE_COUNT; ++face) {
+        lightOffset[face] = voxels.index(faceOffset[face].x, faceOffset[face].y, faceOffset[face].z) - voxels.index(0, 0, 0);
+    }
+    unsigned int unitFaces = 0;
 
-// Constructor for the CaveGenerator class. Initializes the cave with specified dimensions and threshold
-// for determining solid blocks based on Perlin noise.
-// Parameters:
-//   - depth: Depth of the cave (z-axis).
-//   - width: Width of the cave (x-axis).
-//   - height: Height of the cave (y-axis).
-//   - threshold: Noise threshold for determining solid blocks.
-CaveGenerator::CaveGenerator(int depth, int width, int height, float threshold)
-    : depth(depth), width(width), height(height), threshold(threshold) {
-    glGenVertexArrays(1, &vao);
-    glGenBuffers(1, &vbo);
+    for (int z = 0; z < CHUNK_SIZE; ++z) {
+        for (int y = 0; y < CHUNK_SIZE; ++y) {
+            for (int w = 0; w < wordsPerRow; ++w) {
+                // Exposed faces for every voxel in this word, one mask per direction
+                uint64_t interior = solidMask.interiorBits(w);
+                uint64_t exposed[SolidityMask::FACE_COUNT];
+                uint64_t anyExposed = 0;
+                for (int face = 0; face < SolidityMask::FACE_COUNT; ++face) {
+                    exposed[face] = solidMask.exposedFaces(static_cast<SolidityMask::Face>(face), w, y, z) & interior;
+                    anyExposed |= exposed[face];
+                }
 
-    std::vector<glm::vec3> crystalPositions;
+                if (mode == MESHING_GREEDY) {
+                    for (int face = 0; face < SolidityMask::FACE_COUNT; ++face) {
+                        unitFaces += popCount(exposed[face]);
+                    }
+                    continue;
+                }
 
-    // Pre-calculate noise values
-    noiseValues.resize(depth, std::vector<std::vector<float>>(height, std::vector<float>(width)));
-    for (int z = 0; z < depth; ++z) {
-        for (int y = 0; y < height; ++y) {
-            for (int x = 0; x < width; ++x) {
-                noiseValues[z][y][x] = perlinNoise(x, y, z);
+                // Visit only the voxels that have at least one visible face
+                while (anyExposed) {
+                    int bit = SolidityMask::lowestBit(anyExposed);
+                    anyExposed &= anyExposed - 1;
+                    int x = SolidityMask::voxelX(w, bit);
+                    for (int face = 0; face < SolidityMask::FACE_COUNT; ++face) {
+                        if ((exposed[face] >> bit) & 1) {
+                            int level = light ? light[voxels.index(x, y, z) + lightOffset[face]] : 0;
+                            int corners = occlusion ? cornerOcclusion(solidMask, x, y, z, static_cast<SolidityMask::Face>(face)) : UNOCCLUDED;
+                            faceData.push_back(packFace(x, y, z, static_cast<SolidityMask::Face>(face), 1, 1, level, corners));
+                            ++unitFaces;
+                        }
+                    }
+                }
             }
         }
     }
-    // Generate and apply Perlin worm
-    carveCorridor(20, 40, 20, 10, 8, 40);
+
+    if (render == RENDER_VERTEX_BUFFER || faceData.size() > static_cast<size_t>(maxFaceRecords)) {
+        vertexData.reserve(faceData.size() * 4);
+        for (uint64_t faceRecord : faceData) {
+            addFace(vertexData, faceRecord);
+        }
+        faceData.clear();
+    }
+    return unitFaces;
 }
 
-// Destructor for the CaveGenerator class. Cleans up OpenGL resources by deleting the VAO and VBO.
-CaveGenerator::~CaveGenerator() {
-    glDeleteVertexArrays(1, &vao);
-    glDeleteBuffers(1, &vbo);
+// Lists the air voxels of a chunk that rest on rock, the floors crystals and props are placed on.
+// Works on whole words of the solidity mask, so a chunk costs a few thousand word operations plus
+// one entry per floor voxel. The voxels below y = 0 come from the ghost ring.
+// Parameters:
+//   - solidMask: The chunk's solidity mask.
+//   - floorVoxels: Receives the floor voxels as CaveChunk::lightIndex values, in ascending order.
+void CaveGenerator::collectFloorVoxels(const SolidityMask& solidMask, std::vector<uint16_t>& floorVoxels) {
+    floorVoxels.clear();
+    const int wordsPerRow = solidMask.getWordsPerRow();
+    for (int z = 0; z < CHUNK_SIZE; ++z) {
+        for (int y = 0; y < CHUNK_SIZE; ++y) {
+            const uint64_t* row = solidMask.row(y, z);
+            const uint64_t* below = solidMask.row(y - 1, z);
+            for (int w = 0; w < wordsPerRow; ++w) {
+                uint64_t floors = below[w] & ~row[w] & solidMask.interiorBits(w);
+                while (floors) {
+                    int bit = SolidityMask::lowestBit(floors);
+                    floors &= floors - 1;
+                    floorVoxels.push_back(static_cast<uint16_t>(CaveChunk::lightIndex(SolidityMask::voxelX(w, bit), y, z)));
+                }
+            }
+        }
+    }
 }
 
-// Generates the cave geometry by populating vertex data based on Perlin noise and determining
-// which blocks are solid. It also sets up the VAO and VBO with the generated vertex data.
-void CaveGenerator::generateCave() {
-    std::vector<Vertex> vertexData;
-    vertices.clear();
-    normals.clear();
-
-    for (int z = 0; z < depth; ++z) {
-        for (int y = 0; y < height; ++y) {
-            for (int x = 0; x < width; ++x) {
-                if (isSolid(x, y, z)) {
-                    // Check each face for a neighboring block and add face if no neighbor exists
-                    if (!hasNeighbour(x, y, z, glm::vec3(1.0f, 0.0f, 0.0f))) {
-                        addFace(vertexData, x, y, z, glm::vec3(1.0f, 0.0f, 0.0f)); // Right face
-                    }
-                    if (!hasNeighbour(x, y, z, glm::vec3(-1.0f, 0.0f, 0.0f))) {
-                        addFace(vertexData, x, y, z, glm::vec3(-1.0f, 0.0f, 0.0f)); // Left face
-                    }
-                    if (!hasNeighbour(x, y, z, glm::vec3(0.0f, 1.0f, 0.0f))) {
-                        addFace(vertexData, x, y, z, glm::vec3(0.0f, 1.0f, 0.0f)); // Top face
-                    }
-                    if (!hasNeighbour(x, y, z, glm::vec3(0.0f, -1.0f, 0.0f))) {
-                        addFace(vertexData, x, y, z, glm::vec3(0.0f, -1.0f, 0.0f)); // Bottom face
-                    }
-                    if (!hasNeighbour(x, y, z, glm::vec3(0.0f, 0.0f, 1.0f))) {
-                        addFace(vertexData, x, y, z, glm::vec3(0.0f, 0.0f, 1.0f)); // Front face
-                    }
-                    if (!hasNeighbour(x, y, z, glm::vec3(0.0f, 0.0f, -1.0f))) {
-                        addFace(vertexData, x, y, z, glm::vec3(0.0f, 0.0f, -1.0f)); // Back face
+// Greedily merges the set bits of a CHUNK_SIZE x CHUNK_SIZE plane of faces into rectangles,
+// widest run along the bits first, then extended across the rows it fully covers. Clears the plane.
+// Parameters:
+//   - rows: CHUNK_SIZE rows of face bits, bit i being column i.
+//   - emit: Called as emit(column, row, columns, rows) for each rectangle.
+//   - extendColumns, extendRows: Whether rectangles may grow along the bits and across the rows;
+//     a rectangle that may not stays one face wide that way.
+template <typename Emit>
+static void mergePlane(uint64_t* rows, Emit emit, bool extendColumns = true, bool extendRows = true) {
+    for (int r = 0; r < CHUNK_SIZE; ++r) {
+        while (rows[r]) {
+            int column = SolidityMask::lowestBit(rows[r]);
+            int columns = extendColumns ? SolidityMask::lowestBit(~(rows[r] >> column)) : 1;
+            uint64_t run = ((uint64_t(1) << columns) - 1) << column;
+            int height = 1;
+            while (extendRows && r + height < CHUNK_SIZE && (rows[r + height] & run) == run) {
+                rows[r + height] &= ~run;
+                ++height;
+            }
+            rows[r] &= ~run;
+            emit(column, r, columns, height);
+        }
+    }
+}
+
+// The faces of one shading key within a plane being merged by mergeShadedPlane
+struct ShadedPlane {
+    int key;
+    uint64_t rows[CHUNK_SIZE];
+};
+
+// mergePlane for shaded faces: faces only merge with faces of the same shading key (light level
+// and corner occlusion), so the plane is split into one plane per key first. Clears the plane.
+// Parameters:
+//   - rows: CHUNK_SIZE rows of face bits, bit i being column i.
+//   - planes: Scratch space, reused between calls.
+//   - keyOf: Called as keyOf(column, row) for the shading key of each face.
+//   - extend: Called as extend(key, extendColumns, extendRows) to say which ways faces of a key may
+//     merge without changing how they are shaded.
+//   - emit: Called as emit(column, row, columns, rows, key) for each rectangle.
+template <typename Key, typename Extend, typename Emit>
+static void mergeShadedPlane(uint64_t* rows, std::vector<ShadedPlane>& planes, Key keyOf, Extend extend, Emit emit) {
+    planes.clear();
+    size_t last = 0;
+    for (int r = 0; r < CHUNK_SIZE; ++r) {
+        while (rows[r]) {
+            int column = SolidityMask::lowestBit(rows[r]);
+            rows[r] &= rows[r] - 1;
+            int key = keyOf(column, r);
+            // Neighbouring faces mostly share a key
+            if (last >= planes.size() || planes[last].key != key) {
+                last = 0;
+                while (last < planes.size() && planes[last].key != key) ++last;
+                if (last == planes.size()) {
+                    planes.emplace_back();
+                    planes[last].key = key;
+                    std::fill(planes[last].rows, planes[last].rows + CHUNK_SIZE, 0);
+                }
+            }
+            planes[last].rows[r] |= uint64_t(1) << column;
+        }
+    }
+    for (ShadedPlane& plane : planes) {
+        bool extendColumns, extendRows;
+        extend(plane.key, extendColumns, extendRows);
+        mergePlane(plane.rows, [&](int column, int row, int columns, int height) { emit(column, row, columns, height, plane.key); },
+                   extendColumns, extendRows);
+    }
+}
+
+// Emits a chunk's exposed faces as greedy quads: for every face direction and every slice along its
+// normal, the exposed faces are merged into maximal rectangles, one quad each. Faces only merge
+// with faces of the same light, and only along directions in which their corner occlusion doesn't
+// change, so merged quads shade exactly like the unit faces they replace.
+// Parameters:
+//   - solidMask: The chunk's solidity mask, already built.
+//   - light: Light levels in the voxel grid's layout, or nullptr if the chunk is dark.
+//   - occlusion: Bake ambient occlusion into the corners.
+//   - faceData: Receives one face record per quad.
+void CaveGenerator::meshGreedy(const SolidityMask& solidMask, const uint8_t* light, bool occlusion, std::vector<uint64_t>& faceData) const {
+    static_assert(CHUNK_SIZE + 2 <= 64, "greedy meshing expects a chunk row in a single mask word");
+    const int N = CHUNK_SIZE;
+    const uint64_t interior = solidMask.interiorBits(0);
+    const bool shaded = light || occlusion;
+    // Index of the air voxel in front of voxel (x, y, z)'s face in the light grid
+    const int strideY = N + 2;
+    const int strideZ = strideY * (N + 2);
+    auto lightIndex = [&](int x, int y, int z, const glm::ivec3& offset) {
+        return (x + offset.x + 1) + (y + offset.y + 1) * strideY + (z + offset.z + 1) * strideZ;
+    };
+
+    // exposed[(face * N + z) * N + y] holds the exposed faces of row (y, z), bit x for voxel x
+    std::vector<uint64_t> exposed(SolidityMask::FACE_COUNT * N * N);
+    for (int face = 0; face < SolidityMask::FACE_COUNT; ++face) {
+        for (int z = 0; z < N; ++z) {
+            for (int y = 0; y < N; ++y) {
+                exposed[(face * N + z) * N + y] =
+                    (solidMask.exposedFaces(static_cast<SolidityMask::Face>(face), 0, y, z) & interior) >> 1;
+            }
+        }
+    }
+
+    uint64_t plane[CHUNK_SIZE];
+    std::vector<ShadedPlane> shadedPlanes;
+    for (int f = 0; f < SolidityMask::FACE_COUNT; ++f) {
+        const SolidityMask::Face face = static_cast<SolidityMask::Face>(f);
+        const uint64_t* faceRows = &exposed[face * N * N];
+        // X slices have their bits along the faces' up direction, the others along right
+        const bool bitsAlongUp = face == SolidityMask::POS_X || face == SolidityMask::NEG_X;
+
+        // Shading key of the face of voxel (x, y, z): light level, then corner occlusion
+        auto keyOf = [&](int x, int y, int z) {
+            int level = light ? light[lightIndex(x, y, z, faceOffset[face])] : 0;
+            int corners = occlusion ? cornerOcclusion(solidMask, x, y, z, face) : UNOCCLUDED;
+            return level | (corners << 4);
+        };
+        // Occlusion that is the same on both sides of a face (bottom left and bottom right, top left
+        // and top right) lets it merge along right; the same at top and bottom lets it merge along up
+        auto extend = [&](int key, bool& extendColumns, bool& extendRows) {
+            int a[4];
+            for (int corner = 0; corner < 4; ++corner) a[corner] = (key >> (4 + corner * 2)) & 3;
+            bool alongRight = a[0] == a[3] && a[1] == a[2];
+            bool alongUp = a[0] == a[1] && a[3] == a[2];
+            extendColumns = bitsAlongUp ? alongUp : alongRight;
+            extendRows = bitsAlongUp ? alongRight : alongUp;
+        };
+        auto merge = [&](auto keyAt, auto emit) {
+            if (shaded) {
+                mergeShadedPlane(plane, shadedPlanes, keyAt, extend, emit);
+            }
+            else {
+                mergePlane(plane, [&](int column, int row, int columns, int height) {
+                    emit(column, row, columns, height, UNOCCLUDED << 4);
+                });
+            }
+        };
+
+        for (int slice = 0; slice < N; ++slice) {
+            if (bitsAlongUp) {
+                // Slice x: rows are z, bits are y, so transpose out of the x-major rows
+                std::fill(plane, plane + N, 0);
+                for (int z = 0; z < N; ++z) {
+                    for (int y = 0; y < N; ++y) {
+                        plane[z] |= ((faceRows[z * N + y] >> slice) & 1) << y;
                     }
                 }
+                merge([&](int y, int z) { return keyOf(slice, y, z); }, [&](int y, int z, int sizeY, int sizeZ, int key) {
+                    faceData.push_back(packFace(slice, y, z, face, sizeZ, sizeY, key & 15, key >> 4));
+                });
+            }
+            else if (face == SolidityMask::POS_Y || face == SolidityMask::NEG_Y) {
+                // Slice y: rows are z, bits are x
+                for (int z = 0; z < N; ++z) {
+                    plane[z] = faceRows[z * N + slice];
+                }
+                merge([&](int x, int z) { return keyOf(x, slice, z); }, [&](int x, int z, int sizeX, int sizeZ, int key) {
+                    faceData.push_back(packFace(x, slice, z, face, sizeX, sizeZ, key & 15, key >> 4));
+                });
+            }
+            else {
+                // Slice z: rows are y, bits are x
+                std::copy(faceRows + slice * N, faceRows + (slice + 1) * N, plane);
+                merge([&](int x, int y) { return keyOf(x, y, slice); }, [&](int x, int y, int sizeX, int sizeY, int key) {
+                    faceData.push_back(packFace(x, y, slice, face, sizeX, sizeY, key & 15, key >> 4));
+                });
             }
         }
     }
+}
 
-#pragma region VAOs & VBOs
-    // Update VAO and VBO for vertices, normals, and texture coordinates
-    glBindVertexArray(vao);
+// Ambient occlusion of the four corners of a voxel face, from the classic three-neighbour rule:
+// a corner loses one step per solid voxel among the two beside it and the one diagonally across it
+// in the layer in front of the face, and goes fully dark when both voxels beside it are solid.
+// Parameters:
+//   - solidMask: The chunk's solidity mask; the neighbours may lie in its ghost ring.
+//   - x, y, z: Chunk-local coordinates of the voxel.
+//   - face: The exposed face.
+// Returns 2 bits per corner, in Vertex corner order, 3 being unoccluded.
+int CaveGenerator::cornerOcclusion(const SolidityMask& solidMask, int x, int y, int z, SolidityMask::Face face) {
+    const glm::ivec3 front = glm::ivec3(x, y, z) + faceOffset[face];
+    const glm::ivec3& right = faceRight[face];
+    const glm::ivec3& up = faceUp[face];
+    auto solid = [&](const glm::ivec3& p) { return solidMask.isSolid(p.x, p.y, p.z) ? 1 : 0; };
+    const int left = solid(front - right), rightSide = solid(front + right);
+    const int below = solid(front - up), above = solid(front + up);
+
+    // Corners: 0 bottom left, 1 top left, 2 top right, 3 bottom right
+    const int sideU[4] = { left, left, rightSide, rightSide };
+    const int sideV[4] = { below, above, above, below };
+    const int stepU[4] = { -1, -1, 1, 1 };
+    const int stepV[4] = { -1, 1, 1, -1 };
+    int corners = 0;
+    for (int corner = 0; corner < 4; ++corner) {
+        int ao = 0;
+        if (!(sideU[corner] && sideV[corner])) {
+            ao = 3 - sideU[corner] - sideV[corner] - solid(front + right * stepU[corner] + up * stepV[corner]);
+        }
+        corners |= ao << (corner * 2);
+    }
+    return corners;
+}
 
-    GLuint vbo;
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, vertexData.size() * sizeof(Vertex), vertexData.data(), GL_STATIC_DRAW);
+// Grows the shared quad index buffer to cover at least 'quads' quads. The buffer holds the pattern
+// 0 1 2 0 2 3 repeated with a stride of 4 vertices, matching how addFace lays out each quad, and
+// keeps its name when it grows so every chunk VAO stays bound to it. Must run on the GL thread.
+// Parameters:
+//   - quads: Quads in the largest mesh that is about to be drawn.
+void CaveGenerator::reserveQuadIndices(size_t quads) {
+    if (quads <= quadIndexCapacity) return;
+    size_t capacity = std::max<size_t>(quadIndexCapacity, 4096);
+    while (capacity < quads) capacity *= 2;
+
+    std::vector<GLuint> indices(capacity * 6);
+    for (size_t quad = 0; quad < capacity; ++quad) {
+        GLuint first = static_cast<GLuint>(quad * 4);
+        GLuint* out = &indices[quad * 6];
+        out[0] = first;     out[1] = first + 1; out[2] = first + 2; // Bottom left, top left, top right
+        out[3] = first;     out[4] = first + 2; out[5] = first + 3; // Bottom left, top right, bottom right
+    }
+
+    if (quadIndexBuffer == 0) {
+        glGenBuffers(1, &quadIndexBuffer);
+    }
+    // Bind through GL_ARRAY_BUFFER so no VAO's element binding is disturbed
+    glBindBuffer(GL_ARRAY_BUFFER, quadIndexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    quadIndexCapacity = capacity;
+}
+
+// Writes mesh data into the buffer bound to 'target'. A mesh that fits the existing data store is
+// written in place after orphaning the old store, so the driver never stalls on a frame that is
+// still drawing from it; a larger mesh reallocates with headroom for further edits, and the store
+// shrinks again once it is less than a quarter used.
+// Parameters:
+//   - target: GL_ARRAY_BUFFER or GL_TEXTURE_BUFFER, with the chunk's buffer bound to it.
+//   - data, bytes: The new contents.
+//   - allocated: Size of the current data store, 0 for a new buffer; updated on reallocation.
+static void writeMeshBuffer(GLenum target, const void* data, size_t bytes, size_t& allocated) {
+    if (allocated == 0) {
+        // First upload: allocate exactly, most chunks are never edited
+        glBufferData(target, bytes, data, GL_STATIC_DRAW);
+        allocated = bytes;
+    }
+    else if (bytes > allocated || bytes < allocated / 4) {
+        allocated = bytes + bytes / 4;
+        glBufferData(target, allocated, nullptr, GL_DYNAMIC_DRAW);
+        glBufferSubData(target, 0, bytes, data);
+    }
+    else {
+        glBufferData(target, allocated, nullptr, GL_DYNAMIC_DRAW); // Orphan
+        glBufferSubData(target, 0, bytes, data);
+    }
+}
+
+// Uploads a chunk's mesh, creating the GL objects for its path on first use and deleting those of
+// the other path. Remeshes reuse the chunk's buffers through writeMeshBuffer. Must run on the GL thread.
+// Parameters:
+//   - chunk: The chunk that owns the mesh.
+//   - faceData, faceCount: The face records produced by meshChunk, if the chunk is pulled.
+//   - vertexData, vertexCount: The vertices produced by meshChunk otherwise.
+void CaveGenerator::uploadChunkMesh(CaveChunk& chunk, const uint64_t* faceData, size_t faceCount,
+                                    const Vertex* vertexData, size_t vertexCount) {
+    if (faceCount > 0) {
+        if (chunk.vao != 0) {
+            glDeleteVertexArrays(1, &chunk.vao);
+            glDeleteBuffers(1, &chunk.vbo);
+            chunk.vao = chunk.vbo = 0;
+            chunk.gpuBytes = 0;
+        }
+        if (pullVao == 0) {
+            glGenVertexArrays(1, &pullVao); // Core profile draws need a VAO, even without attributes
+        }
+        if (chunk.faceTexture == 0) {
+            glGenBuffers(1, &chunk.faceBuffer);
+            glGenTextures(1, &chunk.faceTexture);
+            glBindBuffer(GL_TEXTURE_BUFFER, chunk.faceBuffer);
+            glBindTexture(GL_TEXTURE_BUFFER, chunk.faceTexture);
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, chunk.faceBuffer);
+            glBindTexture(GL_TEXTURE_BUFFER, 0);
+        }
+
+        glBindBuffer(GL_TEXTURE_BUFFER, chunk.faceBuffer);
+        writeMeshBuffer(GL_TEXTURE_BUFFER, faceData, faceCount * sizeof(uint64_t), chunk.gpuBytes);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        chunk.quadCount = static_cast<unsigned int>(faceCount);
+        return;
+    }
+
+    if (chunk.faceTexture != 0) {
+        glDeleteTextures(1, &chunk.faceTexture);
+        glDeleteBuffers(1, &chunk.faceBuffer);
+        chunk.faceTexture = chunk.faceBuffer = 0;
+        chunk.gpuBytes = 0;
+    }
+
+#pragma region VAOs & VBOs
+    reserveQuadIndices(vertexCount / 4);
+    if (chunk.vao == 0) {
+        glGenVertexArrays(1, &chunk.vao);
+        glGenBuffers(1, &chunk.vbo);
 
-    // After buffering vertexData to the GPU
-    vertexCount = vertexData.size(); // Store the number of vertices
+        // Set up VAO for the packed vertices
+        glBindVertexArray(chunk.vao);
+        glBindBuffer(GL_ARRAY_BUFFER, chunk.vbo);
 
-    // Vertex positions
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-    glEnableVertexAttribArray(0);
+        // Packed position and attributes, read as integers and decoded in the vertex shader
+        glVertexAttribIPointer(0, 2, GL_UNSIGNED_INT, sizeof(Vertex), (void*)0);
+        glEnableVertexAttribArray(0);
 
-    // Vertex normals
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
-    glEnableVertexAttribArray(1);
+        // Every chunk draws through the shared quad index pattern
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadIndexBuffer);
 
-    // Texture coordinates
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoords));
-    glEnableVertexAttribArray(2);
+        glBindVertexArray(0);
+    }
 
-    // Unbind buffer and VAO
+    glBindBuffer(GL_ARRAY_BUFFER, chunk.vbo);
+    writeMeshBuffer(GL_ARRAY_BUFFER, vertexData, vertexCount * sizeof(Vertex), chunk.gpuBytes);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+
+    chunk.quadCount = static_cast<unsigned int>(vertexCount / 4);
 #pragma endregion
 }
 
-// Generates crystal formations within the cave by randomly placing crystals at certain positions
-// based on a probability check.
-void CaveGenerator::generateCrystals() {
-    srand(static_cast<unsigned int>(time(0))); // Seed the random number generator
-
-    float crystalSpawnProbability = 0.01f; // 5% chance to spawn a crystal
-
-    for (int z = 0; z < depth; ++z) {
-        for (int y = 1; y < height; ++y) { // Start from y = 1 to ensure there's a block below
-            for (int x = 0; x < width; ++x) {
-                // Check if the current position is an open space and has a solid block below
-                if (isSolid(x, y - 1, z) && !isSolid(x, y, z)) {
-                    // Generate a random number between 0 and 1
-                    float randomValue = static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
-                    // Check if the random value is less than the probability
-                    if (randomValue < crystalSpawnProbability) {
-                        crystalPositions.push_back(glm::vec3(x, y, z));
-                    }
+// Deletes a chunk's OpenGL objects.
+void CaveGenerator::releaseChunk(CaveChunk& chunk) {
+    if (chunk.vao != 0) {
+        glDeleteVertexArrays(1, &chunk.vao);
+        glDeleteBuffers(1, &chunk.vbo);
+        chunk.vao = chunk.vbo = 0;
+    }
+    if (chunk.faceTexture != 0) {
+        glDeleteTextures(1, &chunk.faceTexture);
+        glDeleteBuffers(1, &chunk.faceBuffer);
+        chunk.faceTexture = chunk.faceBuffer = 0;
+    }
+    chunk.quadCount = 0;
+    chunk.gpuBytes = 0;
+}
+
+// Queues background jobs that generate and mesh chunks. Finished chunks are made resident by
+// processUploads.
+// Parameters:
+//   - coords: Coordinates of the chunks to generate; none of them may be resident or pending.
+void CaveGenerator::submitChunkJobs(const std::vector<glm::ivec3>& coords) {
+    auto submitted = std::chrono::high_resolution_clock::now();
+    for (const glm::ivec3& coord : coords) {
+        if (installCachedChunk(coord)) continue;
+        int64_t key = chunkKey(coord);
+        pendingChunks.insert(key);
+        ++jobsInFlight;
+
+        ChunkEditLog edits;
+        auto recorded = chunkEdits.find(key);
+        if (recorded != chunkEdits.end()) {
+            edits = recorded->second;
+        }
+        MeshingMode mode = meshingMode;
+        RenderMode render = renderMode;
+        bool occlusion = ambientOcclusion;
+        threadPool->enqueue([this, coord, key, edits, mode, render, occlusion, submitted]() {
+            MeshJob job;
+            job.key = key;
+            job.editCount = edits.count;
+            job.submitted = submitted;
+            if (!cancelJobs) {
+                job.chunk.reset(new CaveChunk(coord));
+                generateChunkVoxels(*job.chunk, edits);
+                job.unitFaces = meshChunk(job.chunk->voxels, nullptr, mode, render, occlusion, job.solidMask, job.floorVoxels,
+                                          job.faceData, job.vertexData);
+            }
+            finishJob(std::move(job));
+        });
+    }
+}
+
+// Hands a finished job to the GL thread. Called on the worker threads.
+void CaveGenerator::finishJob(MeshJob job) {
+    {
+        std::lock_guard<std::mutex> lock(uploadMutex);
+        uploadQueue.push_back(std::move(job));
+    }
+    jobFinished.notify_one();
+}
+
+// Drains the upload queue on the GL thread until the byte or time budget for this call is spent.
+// At least one job is uploaded per call so a single large mesh can't stall the queue.
+// Parameters:
+//   - byteBudget: Mesh bytes to upload before stopping.
+//   - millisBudget: Milliseconds to spend before stopping.
+void CaveGenerator::processUploads(size_t byteBudget, double millisBudget) {
+    auto start = std::chrono::high_resolution_clock::now();
+    stats.uploadsLastFrame = 0;
+    stats.bytesUploadedLastFrame = 0;
+
+    for (;;) {
+        MeshJob job;
+        {
+            std::lock_guard<std::mutex> lock(uploadMutex);
+            if (uploadQueue.empty()) break;
+            job = std::move(uploadQueue.front());
+            uploadQueue.pop_front();
+        }
+        --jobsInFlight;
+        installJob(job);
+
+        auto now = std::chrono::high_resolution_clock::now();
+        double latency = std::chrono::duration<double, std::milli>(now - job.submitted).count();
+        stats.lastUploadLatencyMs = latency;
+        stats.maxUploadLatencyMs = std::max(stats.maxUploadLatencyMs, latency);
+        stats.averageUploadLatencyMs += (latency - stats.averageUploadLatencyMs) / static_cast<double>(++stats.totalUploads);
+        ++stats.uploadsLastFrame;
+        stats.bytesUploadedLastFrame += job.faceData.size() * sizeof(uint64_t) + job.vertexData.size() * sizeof(Vertex);
+
+        if (stats.bytesUploadedLastFrame >= byteBudget ||
+            std::chrono::duration<double, std::milli>(now - start).count() >= millisBudget) {
+            break;
+        }
+    }
+}
+
+// Uploads a finished job's mesh and makes a newly generated chunk resident. Remeshes of chunks
+// that were evicted in the meantime are dropped.
+// Parameters:
+//   - job: The finished job.
+void CaveGenerator::installJob(MeshJob& job) {
+    if (job.chunk) {
+        pendingChunks.erase(job.key);
+        std::unique_ptr<CaveChunk> chunk = std::move(job.chunk);
+        chunk->solidMask = std::move(job.solidMask);
+        chunk->floorVoxels = std::move(job.floorVoxels);
+        chunk->unitFaceCount = job.unitFaces;
+        uploadChunkMesh(*chunk, job.faceData.data(), job.faceData.size(), job.vertexData.data(), job.vertexData.size());
+        keepMeshForCache(job.key, job.faceData, job.vertexData);
+        ++stats.chunksGenerated;
+        makeResident(job.key, std::move(chunk), job.editCount);
+    }
+    else if (!cancelJobs) {
+        auto it = chunks.find(job.key);
+        if (it == chunks.end() || it->second->id != job.chunkId) return;
+        CaveChunk& chunk = *it->second;
+        chunk.remeshPending = false;
+        if (job.meshRevision != chunk.meshRevision) return; // Remeshed on the GL thread since
+        chunk.solidMask = std::move(job.solidMask);
+        chunk.floorVoxels = std::move(job.floorVoxels);
+        chunk.occupancy.build(chunk.solidMask);
+        chunk.unitFaceCount = job.unitFaces;
+        uploadChunkMesh(chunk, job.faceData.data(), job.faceData.size(), job.vertexData.data(), job.vertexData.size());
+        keepMeshForCache(job.key, job.faceData, job.vertexData);
+    }
+}
+
+// Makes a chunk with an uploaded mesh resident: replays the edits recorded since its voxels were
+// made, adds it to the LRU list, spawns its crystals and queues its light.
+// Parameters:
+//   - key: The chunk's key.
+//   - chunk: The chunk, with its noise grid, solidity mask and mesh in place.
+//   - editCount: Recorded edits the chunk's voxels already include.
+void CaveGenerator::makeResident(int64_t key, std::unique_ptr<CaveChunk> chunk, size_t editCount) {
+    chunk->id = nextChunkId++;
+    chunk->occupancy.build(chunk->solidMask);
+
+    // Catch up with edits made since the chunk was generated
+    auto recorded = chunkEdits.find(key);
+    if (recorded != chunkEdits.end() && recorded->second.count > editCount) {
+        replayEdits(*chunk, recorded->second, editCount);
+        chunk->meshDirty = true;
+    }
+
+    lruOrder.push_front(key);
+    chunk->lruPosition = lruOrder.begin();
+    chunk->lastUsedFrame = frameCounter;
+    CaveChunk& installed = *chunk;
+    chunks[key] = std::move(chunk);
+    if (crystalsEnabled) {
+        spawnCrystals(installed);
+    }
+    lightNewChunk(installed);
+}
+
+// Holds on to a finished mesh while generateCave is collecting meshes for the cache file; GPU
+// buffers can't be read back cheaply afterwards.
+// Parameters:
+//   - key: The chunk's key.
+//   - faceData, vertexData: The mesh as uploaded.
+void CaveGenerator::keepMeshForCache(int64_t key, const std::vector<uint64_t>& faceData, const std::vector<Vertex>& vertexData) {
+    if (!collectingCacheMeshes) return;
+    CachedMesh& mesh = meshesToCache[key];
+    mesh.faceData = faceData;
+    mesh.vertexData = vertexData;
+}
+
+// Makes a chunk resident straight from the mapped cache file if the file has it and its meshes were
+// built with the current modes. The voxel palette and indices are copied out of the mapped pages and
+// the mesh is uploaded from them directly, so nothing is parsed or generated. Must run on the GL thread.
+// Parameters:
+//   - coord: Chunk coordinates.
+// Returns false if the chunk has to be generated.
+bool CaveGenerator::installCachedChunk(const glm::ivec3& coord) {
+    if (!cache.isOpen() || meshingMode != cacheMeshingMode || renderMode != cacheRenderMode ||
+        ambientOcclusion != cacheAmbientOcclusion) return false;
+    const CaveCache::ChunkRecord* record = cache.find(coord);
+    if (!record) return false;
+
+    std::unique_ptr<CaveChunk> chunk(new CaveChunk(coord));
+    PaletteGrid& voxels = chunk->voxels;
+    voxels.resize(CHUNK_SIZE, CHUNK_SIZE, CHUNK_SIZE, MATERIAL_AIR);
+    int bits = static_cast<int>(record->indexBits);
+    bool widthValid = (bits == 0 || bits == 1 || bits == 2 || bits == 4 || bits == 8) && record->paletteSize >= 1 &&
+                      record->paletteSize <= (size_t(1) << bits) && record->paletteSize <= 256;
+    if (!widthValid || cache.indexWordCount(*record) != (voxels.getVoxelCount() * bits + 63) / 64) return false;
+    voxels.load(cache.palette(*record), record->paletteSize, bits, cache.indices(*record));
+    chunk->solidMask.build(voxels);
+    collectFloorVoxels(chunk->solidMask, chunk->floorVoxels);
+    chunk->unitFaceCount = record->unitFaces;
+    const uint64_t* faces = cache.faces(*record);
+    const Vertex* vertices = static_cast<const Vertex*>(cache.vertices(*record));
+    size_t vertexCount = static_cast<size_t>(record->vertexBytes / sizeof(Vertex));
+    uploadChunkMesh(*chunk, faces, record->faceCount, vertices, vertexCount);
+    // Light baked into the cached mesh may be gone; the chunk is remeshed if it is lit now anyway
+    bool baked = std::any_of(faces, faces + record->faceCount, [](uint64_t face) { return ((face >> 28) & 15u) != 0; }) ||
+                 std::any_of(vertices, vertices + vertexCount, [](const Vertex& vertex) { return ((vertex.packedAttributes >> 17) & 15u) != 0; });
+    chunk->meshDirty = baked;
+    ++stats.chunksFromCache;
+    makeResident(chunkKey(coord), std::move(chunk), record->editCount);
+    return true;
+}
+
+// Hash of everything a cached chunk depends on: the format, the cave bounds, threshold and seed,
+// the noise layers and the instruction set evaluating them, the materials, the meshing setup and
+// every recorded edit.
+uint64_t CaveGenerator::cacheKey() const {
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+    };
+    auto mixInt = [&mix](int64_t value) { mix(&value, sizeof(value)); };
+    auto mixFloat = [&mix](float value) { mix(&value, sizeof(value)); };
+
+    mixInt(CaveCache::VERSION);
+    mixInt(CHUNK_SIZE);
+    mixInt(static_cast<int64_t>(sizeof(Vertex)));
+    mixInt(bounded);
+    mixInt(width);
+    mixInt(height);
+    mixInt(depth);
+    mixFloat(threshold);
+    mixInt(static_cast<int64_t>(seed));
+    mixFloat(ORE_VALUE);
+    mixInt(MATERIAL_COUNT);
+    mixInt(biomeChangeYLevel);
+    for (int y : { biomeChangeYLevel - 1, biomeChangeYLevel }) {
+        NoiseSettings settings = noiseSettingsAt(y);
+        mixFloat(settings.scaleX);
+        mixFloat(settings.scaleY);
+        mixFloat(settings.scaleZ);
+        mixFloat(settings.persistence);
+        mixInt(settings.octaves);
+    }
+    mixInt(getNoiseISA());
+    mixInt(meshingMode);
+    mixInt(renderMode);
+    mixInt(ambientOcclusion);
+    mixInt(maxFaceRecords);
+
+    std::vector<int64_t> keys;
+    for (const auto& entry : chunkEdits) {
+        keys.push_back(entry.first);
+    }
+    std::sort(keys.begin(), keys.end());
+    for (int64_t key : keys) {
+        const ChunkEditLog& edits = chunkEdits.at(key);
+        mixInt(key);
+        mixInt(static_cast<int64_t>(edits.count));
+        const PaletteGrid& merged = edits.merged;
+        mix(merged.getPalette().data(), merged.getPalette().size());
+        mix(merged.getIndexWords().data(), merged.getIndexWords().size() * sizeof(uint64_t));
+        for (const VoxelEdit& edit : edits.recent) {
+            mix(&edit.min, sizeof(edit.min));
+            mix(&edit.max, sizeof(edit.max));
+            mixInt(edit.sphere);
+            mix(&edit.centre, sizeof(edit.centre));
+            mixFloat(edit.radius);
+            mixInt(edit.material);
+        }
+    }
+    return hash;
+}
+
+// Writes the resident chunks whose meshes are known, plus the chunks of the current cache file that
+// are no longer resident, to a new cache file and swaps it in for the old one.
+void CaveGenerator::writeCache() {
+    auto start = std::chrono::high_resolution_clock::now();
+    uint64_t key = cacheKey();
+    std::vector<CaveCache::ChunkData> data;
+    std::unordered_set<int64_t> written;
+    bool carryOver = cache.isOpen() && meshingMode == cacheMeshingMode && renderMode == cacheRenderMode &&
+                     ambientOcclusion == cacheAmbientOcclusion;
+
+    for (const auto& entry : chunks) {
+        const CaveChunk& chunk = *entry.second;
+        if (chunk.meshDirty || chunk.editDirty || chunk.remeshPending) continue; // Mesh is behind the voxels
+
+        CaveCache::ChunkData chunkData;
+        chunkData.coord = chunk.coord;
+        auto recorded = chunkEdits.find(entry.first);
+        chunkData.editCount = static_cast<uint32_t>((recorded != chunkEdits.end()) ? recorded->second.count : 0);
+        chunkData.unitFaces = chunk.unitFaceCount;
+        chunkData.palette = chunk.voxels.getPalette().data();
+        chunkData.paletteSize = chunk.voxels.getPalette().size();
+        chunkData.indexBits = chunk.voxels.getBitsPerIndex();
+        chunkData.indices = chunk.voxels.getIndexWords().data();
+        chunkData.indexWords = chunk.voxels.getIndexWords().size();
+
+        auto mesh = meshesToCache.find(entry.first);
+        const CaveCache::ChunkRecord* record = carryOver ? cache.find(chunk.coord) : nullptr;
+        if (mesh != meshesToCache.end()) {
+            chunkData.faces = mesh->second.faceData.data();
+            chunkData.faceCount = mesh->second.faceData.size();
+            chunkData.vertices = mesh->second.vertexData.data();
+            chunkData.vertexBytes = mesh->second.vertexData.size() * sizeof(Vertex);
+        }
+        else if (record && record->editCount == chunkData.editCount) {
+            chunkData.faces = cache.faces(*record);
+            chunkData.faceCount = record->faceCount;
+            chunkData.vertices = cache.vertices(*record);
+            chunkData.vertexBytes = record->vertexBytes;
+        }
+        else {
+            continue; // The mesh only exists on the GPU
+        }
+        data.push_back(chunkData);
+        written.insert(entry.first);
+    }
+
+    if (carryOver) {
+        for (const CaveCache::ChunkRecord* record : cache.getRecords()) {
+            glm::ivec3 coord(record->x, record->y, record->z);
+            if (written.count(chunkKey(coord))) continue;
+            CaveCache::ChunkData chunkData;
+            chunkData.coord = coord;
+            chunkData.editCount = record->editCount;
+            chunkData.unitFaces = record->unitFaces;
+            chunkData.palette = cache.palette(*record);
+            chunkData.paletteSize = record->paletteSize;
+            chunkData.indexBits = record->indexBits;
+            chunkData.indices = cache.indices(*record);
+            chunkData.indexWords = cache.indexWordCount(*record);
+            chunkData.faces = cache.faces(*record);
+            chunkData.faceCount = record->faceCount;
+            chunkData.vertices = cache.vertices(*record);
+            chunkData.vertexBytes = record->vertexBytes;
+            data.push_back(chunkData);
+        }
+    }
+
+    // Write beside the old file, which stays mapped until the new one is complete
+    std::string temporaryPath = cachePath + ".tmp";
+    bool saved = CaveCache::write(temporaryPath, key, data);
+    cache.close();
+    if (saved) {
+        std::remove(cachePath.c_str());
+        if (std::rename(temporaryPath.c_str(), cachePath.c_str()) != 0) {
+            std::cerr << "Failed to replace cave cache " << cachePath << std::endl;
+            saved = false;
+        }
+    }
+    if (cache.open(cachePath, key)) {
+        cacheMeshingMode = meshingMode;
+        cacheRenderMode = renderMode;
+        cacheAmbientOcclusion = ambientOcclusion;
+    }
+
+    if (saved) {
+        auto end = std::chrono::high_resolution_clock::now();
+        std::cout << "Cave cache written in " << std::chrono::duration<double, std::milli>(end - start).count()
+                  << " ms (" << data.size() << " chunks to " << cachePath << ")" << std::endl;
+    }
+}
+
+// Queues background remesh jobs for resident chunks whose voxels changed. Each job meshes a copy
+// of the chunk's voxel grid, so the chunk can keep being edited while the job runs.
+void CaveGenerator::remeshDirtyChunks() {
+    auto submitted = std::chrono::high_resolution_clock::now();
+    for (auto& entry : chunks) {
+        CaveChunk& chunk = *entry.second;
+        if (!chunk.meshDirty || chunk.remeshPending) continue;
+        chunk.meshDirty = false;
+        chunk.remeshPending = true;
+        chunk.voxels.compact(); // Edits only add palette entries
+        ++jobsInFlight;
+
+        int64_t key = entry.first;
+        uint64_t chunkId = chunk.id;
+        uint64_t meshRevision = ++chunk.meshRevision;
+        std::shared_ptr<PaletteGrid> voxels(new PaletteGrid(chunk.voxels));
+        std::shared_ptr<std::vector<uint8_t>> light(new std::vector<uint8_t>());
+        gatherLight(chunk, *light);
+        MeshingMode mode = meshingMode;
+        RenderMode render = renderMode;
+        bool occlusion = ambientOcclusion;
+        threadPool->enqueue([this, key, chunkId, meshRevision, voxels, light, mode, render, occlusion, submitted]() {
+            MeshJob job;
+            job.key = key;
+            job.chunkId = chunkId;
+            job.meshRevision = meshRevision;
+            job.submitted = submitted;
+            if (!cancelJobs) {
+                job.unitFaces = meshChunk(*voxels, light->empty() ? nullptr : light->data(), mode, render, occlusion,
+                                          job.solidMask, job.floorVoxels, job.faceData, job.vertexData);
+            }
+            finishJob(std::move(job));
+        });
+    }
+}
+
+// Remeshes edited chunks on the GL thread and uploads them straight away, so an edit is visible in
+// the frame it was made. An edit only dirties the chunks whose voxels or ghost rings it touched,
+// and meshing one chunk costs the same however large the cave is. Chunks beyond maxChunks are
+// handed to the workers instead. Any remesh job still running for a chunk remeshed here is dropped
+// when it finishes.
+// Parameters:
+//   - maxChunks: Upper bound on chunks remeshed by this call.
+void CaveGenerator::remeshEditedChunks(int maxChunks) {
+    auto start = std::chrono::high_resolution_clock::now();
+    int remeshed = 0;
+    std::vector<uint64_t> faceData;
+    std::vector<Vertex> vertexData;
+    std::vector<uint8_t> light;
+    for (auto& entry : chunks) {
+        CaveChunk& chunk = *entry.second;
+        if (!chunk.editDirty) continue;
+        chunk.editDirty = false;
+        if (remeshed >= maxChunks) {
+            chunk.meshDirty = true;
+            continue;
+        }
+
+        faceData.clear();
+        vertexData.clear();
+        chunk.voxels.compact(); // Edits only add palette entries
+        bool lit = gatherLight(chunk, light);
+        chunk.unitFaceCount = meshChunk(chunk.voxels, lit ? light.data() : nullptr, meshingMode, renderMode, ambientOcclusion,
+                                        chunk.solidMask, chunk.floorVoxels, faceData, vertexData);
+        chunk.occupancy.build(chunk.solidMask);
+        uploadChunkMesh(chunk, faceData.data(), faceData.size(), vertexData.data(), vertexData.size());
+        chunk.meshDirty = false;
+        ++chunk.meshRevision;
+        ++remeshed;
+    }
+
+    stats.immediateRemeshesLastFrame = remeshed;
+    stats.immediateRemeshMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// Marks chunks around the streaming centre as used and loads up to maxChunks missing ones.
+// Chunks within the view radius are wanted, plus a prefetch shell one chunk further out in the
+// direction of travel. Missing chunks are loaded nearest first, with distance scaled down for
+// chunks ahead of the camera and up for chunks behind it.
+// Parameters:
+//   - maxChunks: Upper bound on jobs submitted by this call; update() also respects maxPendingJobs.
+void CaveGenerator::streamChunks(int maxChunks) {
+    const int radius = streaming.viewRadius;
+    const float viewDistance = static_cast<float>(radius * CHUNK_SIZE);
+    const float prefetchDistance = static_cast<float>((radius + 1) * CHUNK_SIZE);
+    glm::ivec3 centre = chunkCoordOf(glm::ivec3(static_cast<int>(std::floor(streamingCentre.x)),
+                                                static_cast<int>(std::floor(streamingCentre.y)),
+                                                static_cast<int>(std::floor(streamingCentre.z))));
+
+    std::vector<std::pair<float, glm::ivec3>> missing;
+    for (int dz = -radius - 1; dz <= radius + 1; ++dz) {
+        for (int dy = -radius - 1; dy <= radius + 1; ++dy) {
+            for (int dx = -radius - 1; dx <= radius + 1; ++dx) {
+                glm::ivec3 coord = centre + glm::ivec3(dx, dy, dz);
+                if (!chunkInBounds(coord)) continue;
+
+                glm::vec3 chunkCentre = glm::vec3(coord * CHUNK_SIZE) + glm::vec3(CHUNK_SIZE * 0.5f);
+                glm::vec3 toChunk = chunkCentre - streamingCentre;
+                float distance = glm::length(toChunk);
+                float ahead = (distance > 0.0f) ? glm::dot(toChunk / distance, travelDirection) : 1.0f;
+                bool wanted = distance <= viewDistance || (distance <= prefetchDistance && ahead > 0.7f);
+                if (!wanted) continue;
+
+                CaveChunk* chunk = findChunk(coord);
+                if (!chunk && pendingChunks.count(chunkKey(coord))) continue;
+                if (chunk) {
+                    // Touch: move to the front of the LRU list
+                    chunk->lastUsedFrame = frameCounter;
+                    lruOrder.splice(lruOrder.begin(), lruOrder, chunk->lruPosition);
+                }
+                else {
+                    missing.push_back(std::make_pair(distance * (1.5f - ahead), coord));
                 }
             }
         }
     }
+
+    std::sort(missing.begin(), missing.end(),
+              [](const std::pair<float, glm::ivec3>& a, const std::pair<float, glm::ivec3>& b) { return a.first < b.first; });
+    std::vector<glm::ivec3> toLoad;
+    for (size_t i = 0; i < missing.size() && static_cast<int>(i) < maxChunks; ++i) {
+        toLoad.push_back(missing[i].second);
+    }
+    submitChunkJobs(toLoad);
+}
+
+// Evicts least recently used chunks until resident memory fits the budget. Chunks wanted during
+// the current update are never evicted, so a budget smaller than the view radius only stops eviction.
+void CaveGenerator::evictChunks() {
+    size_t usage = getMemoryUsage();
+    while (usage > streaming.memoryBudget && !lruOrder.empty()) {
+        auto it = chunks.find(lruOrder.back());
+        CaveChunk& chunk = *it->second;
+        if (chunk.lastUsedFrame == frameCounter) break;
+
+        usage -= chunk.memoryBytes();
+        if (!chunk.crystalPositions.empty()) {
+            crystalListDirty = true;
+        }
+        for (const glm::vec3& crystal : chunk.crystalPositions) {
+            crystalIndex.remove(crystal, 0);
+        }
+        unlightChunk(chunk);
+        releaseChunk(chunk);
+        lruOrder.pop_back();
+        chunks.erase(it);
+    }
 }
 
-// Renders the cave geometry by binding the VAO and drawing the vertices as triangles.
-void CaveGenerator::render() {
-    glBindVertexArray(vao);
-    glDrawArrays(GL_TRIANGLES, 0, vertexCount);
-    glBindVertexArray(0);
+// Returns the noise parameters for a layer of the cave. Layers below biomeChangeYLevel
+// use a different scale and persistence to form a separate biome.
+// Parameters:
+//   - y: The y coordinate of the layer.
+CaveGenerator::NoiseSettings CaveGenerator::noiseSettingsAt(int y) const {
+    NoiseSettings settings;
+    settings.scaleX = 0.05f; // Scale for x-axis
+    settings.scaleY = 0.05f; // Scale for y-axis
+    settings.scaleZ = 0.05f; // Scale for z-axis
+    settings.persistence = 0.5f;
+    settings.octaves = noiseOctaves;
+
+    // Modify parameters for the new biome below the biome change level
+    if (y < biomeChangeYLevel) {
+        settings.scaleX = 0.1f; // Larger scale for larger features
+        settings.scaleY = 0.1f;
+        settings.persistence = 0.7f; // Change in persistence for variation
+    }
+    return settings;
 }
 
 // Generates Perlin noise value for a given block position in the cave.
-// This noise is used to determine the solidity of blocks.
+// This is the scalar reference for perlinNoiseRow, which is what the volume is filled with.
 // Parameters:
 //   - x, y, z: The x, y, z coordinates of the block in the cave.
-float CaveGenerator::perlinNoise(int x, int y, int z) {
-    // Noise parameters
-    float scaleX = 0.05f; // Scale for x-axis
-    float scaleY = 0.05f; // Scale for y-axis
-    float scaleZ = 0.05f; // Scale for z-axis
+float CaveGenerator::perlinNoise(int x, int y, int z) const {
+    NoiseSettings settings = noiseSettingsAt(y);
     float noise = 0.0f;
     float amplitude = 1.0f;
     float frequency = 1.0f;
-    float persistence = 0.5f;
-    int octaves = 3;
-
-    // Modify parameters for the new biome below the biome change level
-    if (y < biomeChangeYLevel) {
-        scaleX = 0.1f; // Larger scale for larger features
-        scaleY = 0.1f;
-        persistence = 0.7f; // Change in persistence for variation
-    }
 
     // Generate noise using Perlin noise function
-    for (int i = 0; i < octaves; i++) {
-        glm::vec3 pos = glm::vec3(x * scaleX * frequency, y * scaleY * frequency, z * scaleZ * frequency);
+    for (int i = 0; i < settings.octaves; i++) {
+        glm::vec3 pos = glm::vec3(x * settings.scaleX * frequency, y * settings.scaleY * frequency, z * settings.scaleZ * frequency);
         noise += amplitude * glm::perlin(pos);
-        amplitude *= persistence;
+        amplitude *= settings.persistence;
         frequency *= 2.0f;
     }
 
     return noise;
 }
 
-// Determines if a given block at position (x, y, z) has a neighboring solid block in the specified direction.
+// Generates the Perlin noise values for a run of voxels along x at a given y and z using the
+// batched SIMD kernel. Matches perlinNoise to within the tolerance in NoiseKernel.h.
 // Parameters:
-//   - x, y, z: The x, y, z coordinates of the block in the cave.
-//   - direction: A glm::vec3 vector indicating the direction to check for a neighbor.
-bool CaveGenerator::hasNeighbour(int x, int y, int z, glm::vec3 direction) {
-    // Check for boundaries
-    if (x + direction.x < 0 || x + direction.x >= width ||
-        y + direction.y < 0 || y + direction.y >= height ||
-        z + direction.z < 0 || z + direction.z >= depth) {
-        return false;
+//   - startX: World x coordinate of the first voxel.
+//   - y, z: The y and z coordinates of the row.
+//   - count: Number of voxels in the run.
+//   - out: Destination for 'count' noise values.
+void CaveGenerator::perlinNoiseRow(int startX, int y, int z, int count, float* out) const {
+    NoiseSettings settings = noiseSettingsAt(y);
+    const int blockSize = 256;
+    float px[blockSize];
+
+    std::fill(out, out + count, 0.0f);
+    for (int start = 0; start < count; start += blockSize) {
+        int blockCount = std::min(blockSize, count - start);
+        float amplitude = 1.0f;
+        float frequency = 1.0f;
+
+        for (int i = 0; i < settings.octaves; i++) {
+            // Same expressions as perlinNoise so every lane sees identical inputs
+            for (int j = 0; j < blockCount; ++j) {
+                px[j] = (startX + start + j) * settings.scaleX * frequency;
+            }
+            accumulatePerlinRow(px, y * settings.scaleY * frequency, z * settings.scaleZ * frequency,
+                                amplitude, out + start, blockCount);
+            amplitude *= settings.persistence;
+            frequency *= 2.0f;
+        }
     }
-    return isSolid(x + direction.x, y + direction.y, z + direction.z);
 }
 
-// Checks if a block at a given position is solid based on the noise value and threshold.
+// Fills in the noise of a chunk's runs of voxels. With exactNoise each run is summed over all its
+// octaves by perlinNoiseRow. Otherwise a voxel only gets the octaves that could still change its
+// material band, each of the ones left being bounded by PERLIN_VALUE_BOUND (derived, not measured)
+// times its amplitude; the voxels decided early keep partial sums, which lie in the same band as the full ones. Octaves
+// are evaluated over whole runs until a good share of the voxels is decided, then only over the
+// undecided voxels of all the runs, gathered so the kernel still sees full registers.
 // Parameters:
-//   - x, y, z: The x, y, z coordinates of the block in the cave.
-bool CaveGenerator::isSolid(int x, int y, int z) {
-    return noiseValues[z][y][x] < threshold;
+//   - runs: The runs to evaluate.
+void CaveGenerator::evaluateNoise(const std::vector<NoiseRun>& runs) const {
+    if (exactNoise) {
+        uint64_t evaluated = 0;
+        for (const NoiseRun& run : runs) {
+            perlinNoiseRow(run.startX, run.y, run.z, run.count, run.out);
+            evaluated += static_cast<uint64_t>(run.count) * noiseSettingsAt(run.y).octaves;
+        }
+        noiseOctavesEvaluated += evaluated;
+        return;
+    }
+
+    // Whether a band edge of materialAt (ORE_VALUE or the threshold) lies within reach of a
+    // partial sum. Written without branches, as it is close to a coin flip per voxel.
+    const float oreEdge = ORE_VALUE;
+    const float airEdge = threshold;
+    auto undecided = [oreEdge, airEdge](float noise, float reach) {
+        float low = noise - reach;
+        float high = noise + reach;
+        return static_cast<size_t>(((low < oreEdge) & (high >= oreEdge)) | ((low < airEdge) & (high >= airEdge)));
+    };
+
+    // Voxel whose remaining octaves are still to be added
+    struct Pending {
+        int x, y, z;
+        float* out;
+    };
+    const int batchSize = 256;
+    float px[batchSize], py[batchSize], pz[batchSize], partial[batchSize];
+    std::vector<Pending> pending;
+    uint64_t evaluated = 0, skipped = 0;
+
+    // The biomes differ in persistence, so each is summed on its own
+    for (int lowerBiome = 0; lowerBiome < 2; ++lowerBiome) {
+        auto inBiome = [&](const NoiseRun& run) { return (run.y < biomeChangeYLevel) == (lowerBiome == 1); };
+        NoiseSettings settings = noiseSettingsAt(lowerBiome ? biomeChangeYLevel - 1 : biomeChangeYLevel);
+        size_t voxelCount = 0;
+        for (const NoiseRun& run : runs) {
+            if (inBiome(run)) voxelCount += run.count;
+        }
+        if (voxelCount == 0) continue;
+
+        float remainingAmplitude = 0.0f;
+        float amplitude = 1.0f;
+        for (int i = 0; i < settings.octaves; i++) {
+            remainingAmplitude += amplitude;
+            amplitude *= settings.persistence;
+        }
+
+        // Whole runs while gathering would cost more than the voxels it leaves out save
+        amplitude = 1.0f;
+        float frequency = 1.0f;
+        float reach = 0.0f;
+        size_t undecidedCount = voxelCount;
+        int octave = 0;
+        while (octave < settings.octaves && undecidedCount * 4 > voxelCount * 3) {
+            remainingAmplitude -= amplitude;
+            reach = PERLIN_VALUE_BOUND * remainingAmplitude;
+            undecidedCount = 0;
+            for (const NoiseRun& run : runs) {
+                if (!inBiome(run)) continue;
+                for (int start = 0; start < run.count; start += batchSize) {
+                    int count = std::min(batchSize, run.count - start);
+                    float* out = run.out + start;
+                    // Same expressions as perlinNoise so every lane sees identical inputs
+                    for (int j = 0; j < count; ++j) {
+                        px[j] = (run.startX + start + j) * settings.scaleX * frequency;
+                    }
+                    if (octave == 0) std::fill(out, out + count, 0.0f);
+                    accumulatePerlinRow(px, run.y * settings.scaleY * frequency, run.z * settings.scaleZ * frequency,
+                                        amplitude, out, count);
+                    for (int j = 0; j < count; ++j) {
+                        undecidedCount += undecided(out[j], reach);
+                    }
+                }
+            }
+            evaluated += voxelCount;
+            amplitude *= settings.persistence;
+            frequency *= 2.0f;
+            ++octave;
+        }
+        if (octave == settings.octaves) continue;
+        skipped += static_cast<uint64_t>(voxelCount - undecidedCount) * (settings.octaves - octave);
+
+        pending.resize(undecidedCount + 1);
+        size_t kept = 0;
+        for (const NoiseRun& run : runs) {
+            if (!inBiome(run)) continue;
+            for (int j = 0; j < run.count; ++j) {
+                Pending voxel = { run.startX + j, run.y, run.z, run.out + j };
+                pending[kept] = voxel;
+                kept += undecided(run.out[j], reach);
+            }
+        }
+        pending.resize(kept);
+
+        // The remaining octaves over the gathered voxels, dropping each one once it is decided
+        for (; octave < settings.octaves && !pending.empty(); ++octave) {
+            remainingAmplitude -= amplitude;
+            reach = PERLIN_VALUE_BOUND * remainingAmplitude;
+            kept = 0;
+            for (size_t start = 0; start < pending.size(); start += batchSize) {
+                int count = static_cast<int>(std::min<size_t>(batchSize, pending.size() - start));
+                for (int j = 0; j < count; ++j) {
+                    const Pending& voxel = pending[start + j];
+                    px[j] = voxel.x * settings.scaleX * frequency;
+                    py[j] = voxel.y * settings.scaleY * frequency;
+                    pz[j] = voxel.z * settings.scaleZ * frequency;
+                    partial[j] = *voxel.out;
+                }
+                // Pad to whole registers, which costs less than the kernel's scalar tail
+                int paddedCount = std::min((count + NOISE_MAX_WIDTH - 1) / NOISE_MAX_WIDTH * NOISE_MAX_WIDTH, batchSize);
+                std::fill(px + count, px + paddedCount, px[0]);
+                std::fill(py + count, py + paddedCount, py[0]);
+                std::fill(pz + count, pz + paddedCount, pz[0]);
+                accumulatePerlinPoints(px, py, pz, amplitude, partial, paddedCount);
+                for (int j = 0; j < count; ++j) {
+                    Pending voxel = pending[start + j];
+                    *voxel.out = partial[j];
+                    pending[kept] = voxel;
+                    kept += undecided(partial[j], reach);
+                }
+                evaluated += count;
+            }
+            skipped += static_cast<uint64_t>(pending.size() - kept) * (settings.octaves - 1 - octave);
+            pending.resize(kept);
+            amplitude *= settings.persistence;
+            frequency *= 2.0f;
+        }
+    }
+    noiseOctavesEvaluated += evaluated;
+    noiseOctavesSkipped += skipped;
 }
 
-// Adds the vertices for a block face to the vertex data if the block at position (x, y, z) is solid
-// and doesn't have a neighboring block in the direction of the normal.
+// Adds the four vertices of a face record to the vertex data, laid out the same way
+// cave_pull_vertex_shader.vs expands the record.
 // Parameters:
 //   - vertexData: A reference to the vector of Vertex structs where the vertex data will be added.
-//   - x, y, z: The x, y, z coordinates of the block in the cave.
-//   - normal: A glm::vec3 vector indicating the normal direction of the face to be added.
-void CaveGenerator::addFace(std::vector<Vertex>& vertexData, int x, int y, int z, glm::vec3 normal) {
-    const float blockSize = 1.0f;
-
-    // Determine the starting corner based on the normal
-    glm::vec3 startCorner = glm::vec3(x, y, z);
-
-    // Calculate direction vectors based on the face normal
-    glm::vec3 right, up;
-    if (normal.x > 0) { // Right face
-        startCorner += glm::vec3(blockSize, 0, 0);
-        right = glm::vec3(0, 0, -blockSize);
-        up = glm::vec3(0, blockSize, 0);
-    }
-    else if (normal.x < 0) { // Left face
-        startCorner -= glm::vec3(0, 0, blockSize);
-        right = glm::vec3(0, 0, blockSize);
-        up = glm::vec3(0, blockSize, 0);
-    }
-    else if (normal.y > 0) { // Top face
-        startCorner += glm::vec3(0, blockSize, -blockSize);
-        right = glm::vec3(blockSize, 0, 0);
-        up = glm::vec3(0, 0, blockSize);
-    }
-    else if (normal.y < 0) { // Bottom face
-        startCorner -= glm::vec3(0, 0, 0);
-        right = glm::vec3(blockSize, 0, 0);
-        up = glm::vec3(0, 0, -blockSize);
-    }
-    else if (normal.z > 0) { // Front face
-        startCorner += glm::vec3(0, 0, 0);
-        right = glm::vec3(blockSize, 0, 0);
-        up = glm::vec3(0, blockSize, 0);
-    }
-    else if (normal.z < 0) { // Back face
-        startCorner -= glm::vec3(-blockSize, 0, blockSize);
-        right = glm::vec3(-blockSize, 0, 0);
-        up = glm::vec3(0, blockSize, 0);
-    }
-
-    // Compute the other three corners
-    glm::vec3 bottomLeft = startCorner;
-    glm::vec3 bottomRight = startCorner + right;
-    glm::vec3 topLeft = startCorner + up;
-    glm::vec3 topRight = startCorner + up + right;
-
-    // Add vertices for two triangles
-    vertices.insert(vertices.end(), { bottomLeft.x, bottomLeft.y, bottomLeft.z,
-                                      topLeft.x, topLeft.y, topLeft.z,
-                                      topRight.x, topRight.y, topRight.z,
-                                      bottomLeft.x, bottomLeft.y, bottomLeft.z,
-                                      topRight.x, topRight.y, topRight.z,
-                                      bottomRight.x, bottomRight.y, bottomRight.z });
-
-    // Add normals for the vertices
-    for (int i = 0; i < 6; ++i) {
-        normals.insert(normals.end(), { normal.x, normal.y, normal.z });
-    }
-
-    // Texture coordinates for each vertex of the face
-    std::vector<glm::vec2> texCoords = {
-        glm::vec2(0.0f, 0.0f), // Bottom left
-        glm::vec2(0.0f, 1.0f), // Top left
-        glm::vec2(1.0f, 1.0f), // Top right
-        glm::vec2(0.0f, 0.0f), // Bottom left
-        glm::vec2(1.0f, 1.0f), // Top right
-        glm::vec2(1.0f, 0.0f)  // Bottom right
+//   - faceRecord: The face to add, as packed by packFace. The texture repeats once per block, so
+//     merged faces look the same as the unit faces they replace.
+void CaveGenerator::addFace(std::vector<Vertex>& vertexData, uint64_t faceRecord) {
+    glm::ivec3 block(static_cast<int>(faceRecord & 31u), static_cast<int>((faceRecord >> 5) & 31u),
+                     static_cast<int>((faceRecord >> 10) & 31u));
+    int face = static_cast<int>((faceRecord >> 15) & 7u);
+    int columns = static_cast<int>((faceRecord >> 18) & 31u) + 1;
+    int rows = static_cast<int>((faceRecord >> 23) & 31u) + 1;
+    int light = static_cast<int>((faceRecord >> 28) & 15u);
+    int occlusion[4];
+    for (int corner = 0; corner < 4; ++corner) {
+        occlusion[corner] = static_cast<int>((faceRecord >> (32 + corner * 2)) & 3u);
+    }
+
+    // Start from the far block along any direction that points down its axis
+    const glm::ivec3& right = faceRight[face];
+    const glm::ivec3& up = faceUp[face];
+    glm::ivec3 startCorner = block + faceStart[face]
+        + glm::ivec3(std::max(-right.x, 0), std::max(-right.y, 0), std::max(-right.z, 0)) * (columns - 1)
+        + glm::ivec3(std::max(-up.x, 0), std::max(-up.y, 0), std::max(-up.z, 0)) * (rows - 1);
+
+    // One vertex per corner; the shared quad index buffer turns them into two triangles.
+    // Normals and texture coordinates are rebuilt from the face, corner and size in the shader.
+    glm::ivec3 corners[4] = {
+        startCorner,                                          // Bottom left
+        startCorner + up * rows,                              // Top left
+        startCorner + up * rows + right * columns,            // Top right
+        startCorner + right * columns                         // Bottom right
     };
+    // The index buffer splits every quad along the diagonal from its first vertex. Starting from the
+    // top left instead moves the split to the other diagonal, which is needed when that one joins
+    // the darker corners; otherwise the occlusion is interpolated unevenly across the quad.
+    int first = (occlusion[0] + occlusion[2] > occlusion[1] + occlusion[3]) ? 1 : 0;
+    for (int i = 0; i < 4; ++i) {
+        int corner = (first + i) & 3;
+        vertexData.push_back(Vertex::pack(corners[corner], face, corner, columns, rows, light, occlusion[corner]));
+    }
+}
+
+// Packs a face record; see packFace in CaveGenerator.h for the layout.
+// Parameters:
+//   - x, y, z: Block position within the chunk (the lowest corner block of a merged face).
+//   - face: The direction the face points in.
+//   - columns, rows: Blocks the face covers along its right and up directions.
+//   - light: Baked light level of the face.
+//   - occlusion: Ambient occlusion of the four corners, as returned by cornerOcclusion.
+uint64_t CaveGenerator::packFace(int x, int y, int z, SolidityMask::Face face, int columns, int rows, int light, int occlusion) {
+    static_assert(CHUNK_SIZE <= 32, "face records hold 5-bit block coordinates and sizes");
+    static_assert(MAX_LIGHT_LEVEL < 16, "face records hold 4-bit light levels");
+    return static_cast<uint64_t>(x) | (static_cast<uint64_t>(y) << 5) | (static_cast<uint64_t>(z) << 10)
+         | (static_cast<uint64_t>(face) << 15) | (static_cast<uint64_t>(columns - 1) << 18)
+         | (static_cast<uint64_t>(rows - 1) << 23) | (static_cast<uint64_t>(light) << 28)
+         | (static_cast<uint64_t>(occlusion) << 32);
+}
+
+// Decodes one vertex of a face record the same way cave_pull_vertex_shader.vs does.
+// Parameters:
+//   - faceRecord: The face, as packed by packFace.
+//   - vertex: Which of the quad's six vertices, as gl_VertexID % 6 in the shader.
+//   - origin: World coordinates of the chunk's first voxel.
+//   - position, normal, texCoords: Receive the decoded world-space vertex.
+//   - light, occlusion: Receive the baked light and the corner's ambient occlusion, from 0 to 1.
+void CaveGenerator::unpackFace(uint64_t faceRecord, int vertex, const glm::ivec3& origin, glm::vec3& position, glm::vec3& normal,
+                               glm::vec2& texCoords, float& light, float& occlusion) {
+    // Corner (u, v) of the six vertices, in the shared index buffer's order and split along the other diagonal
+    static const int quadCorners[6][2] = { { 0, 0 }, { 0, 1 }, { 1, 1 }, { 0, 0 }, { 1, 1 }, { 1, 0 } };
+    static const int flippedQuadCorners[6][2] = { { 0, 1 }, { 1, 1 }, { 1, 0 }, { 0, 1 }, { 1, 0 }, { 0, 0 } };
+    glm::ivec3 block(static_cast<int>(faceRecord & 31u), static_cast<int>((faceRecord >> 5) & 31u),
+                     static_cast<int>((faceRecord >> 10) & 31u));
+    int face = static_cast<int>((faceRecord >> 15) & 7u);
+    int columns = static_cast<int>((faceRecord >> 18) & 31u) + 1;
+    int rows = static_cast<int>((faceRecord >> 23) & 31u) + 1;
+    light = static_cast<float>((faceRecord >> 28) & 15u) / 15.0f;
 
-    for (int i = 0; i < 6; ++i) {
-        Vertex vertex;
-        // Assign positions based on the order of vertices for two triangles
-        glm::vec3 positions[6] = { bottomLeft, topLeft, topRight, bottomLeft, topRight, bottomRight };
-        vertex.position = positions[i];
-        vertex.normal = normal;
-        vertex.texCoords = texCoords[i];
-        vertexData.push_back(vertex);
+    int cornerOcclusion[4];
+    for (int corner = 0; corner < 4; ++corner) {
+        cornerOcclusion[corner] = static_cast<int>((faceRecord >> (32 + corner * 2)) & 3u);
     }
+    bool flip = cornerOcclusion[0] + cornerOcclusion[2] > cornerOcclusion[1] + cornerOcclusion[3];
+    int u = flip ? flippedQuadCorners[vertex][0] : quadCorners[vertex][0];
+    int v = flip ? flippedQuadCorners[vertex][1] : quadCorners[vertex][1];
+    int cornerIndex = (u == 0) ? (v == 0 ? 0 : 1) : (v == 0 ? 3 : 2);
+    occlusion = static_cast<float>(cornerOcclusion[cornerIndex]) / 3.0f;
+
+    const glm::ivec3& right = faceRight[face];
+    const glm::ivec3& up = faceUp[face];
+    glm::ivec3 start = block + faceStart[face]
+        + glm::ivec3(std::max(-right.x, 0), std::max(-right.y, 0), std::max(-right.z, 0)) * (columns - 1)
+        + glm::ivec3(std::max(-up.x, 0), std::max(-up.y, 0), std::max(-up.z, 0)) * (rows - 1);
+    position = glm::vec3(origin + start + right * (columns * u) + up * (rows * v));
+    normal = faceNormals[face];
+    texCoords = glm::vec2(static_cast<float>(columns * u), static_cast<float>(rows * v));
+}
+
+// Packs a cave vertex; see CaveGenerator::Vertex for the layout.
+// Parameters:
+//   - local: Corner position relative to the chunk origin, from -1 to CHUNK_SIZE + 1.
+//   - face: SolidityMask::Face of the quad.
+//   - corner: 0 bottom left, 1 top left, 2 top right, 3 bottom right.
+//   - columns, rows: Blocks the quad covers along its right and up directions.
+//   - light: Baked light level of the quad.
+//   - occlusion: Ambient occlusion of the corner, 3 being unoccluded.
+CaveGenerator::Vertex CaveGenerator::Vertex::pack(const glm::ivec3& local, int face, int corner, int columns, int rows, int light,
+                                                  int occlusion) {
+    Vertex vertex;
+    vertex.packedPosition = static_cast<uint32_t>(local.x + 1) | (static_cast<uint32_t>(local.y + 1) << 10)
+                          | (static_cast<uint32_t>(local.z + 1) << 20);
+    vertex.packedAttributes = static_cast<uint32_t>(face) | (static_cast<uint32_t>(corner) << 3)
+                            | (static_cast<uint32_t>(columns - 1) << 5) | (static_cast<uint32_t>(rows - 1) << 11)
+                            | (static_cast<uint32_t>(light) << 17) | (static_cast<uint32_t>(occlusion) << 21);
+    return vertex;
+}
+
+// Decodes a packed cave vertex the same way cave_vertex_shader.vs does.
+// Parameters:
+//   - origin: World coordinates of the chunk's first voxel.
+//   - position, normal, texCoords: Receive the decoded world-space vertex.
+//   - light, occlusion: Receive the baked light and the corner's ambient occlusion, from 0 to 1.
+void CaveGenerator::Vertex::unpack(const glm::ivec3& origin, glm::vec3& position, glm::vec3& normal, glm::vec2& texCoords, float& light,
+                                   float& occlusion) const {
+    glm::ivec3 local(static_cast<int>(packedPosition & 1023u), static_cast<int>((packedPosition >> 10) & 1023u),
+                     static_cast<int>((packedPosition >> 20) & 1023u));
+    position = glm::vec3(origin + local - glm::ivec3(1));
+    normal = faceNormals[packedAttributes & 7u];
+
+    int corner = (packedAttributes >> 3) & 3u;
+    float columns = static_cast<float>(((packedAttributes >> 5) & 63u) + 1);
+    float rows = static_cast<float>(((packedAttributes >> 11) & 63u) + 1);
+    texCoords = glm::vec2((corner >= 2) ? columns : 0.0f, (corner == 1 || corner == 2) ? rows : 0.0f);
+    light = static_cast<float>((packedAttributes >> 17) & 15u) / 15.0f;
+    occlusion = static_cast<float>((packedAttributes >> 21) & 3u) / 3.0f;
 }
 
 // Carves out a corridor in the cave by marking blocks as non-solid within the specified range.
+// The carve is applied to resident chunks now and recorded so chunks generated later include it.
 // Parameters:
 //   - startX, startY, startZ: Starting x, y, z coordinates of the corridor.
 //   - corridorWidth, corridorHeight, corridorDepth: Width, height, and depth of the corridor to carve out.
 void CaveGenerator::carveCorridor(int startX, int startY, int startZ, int corridorWidth, int corridorHeight, int corridorDepth) {
-    int endX = std::min(width, startX + corridorWidth);
-    int endY = std::min(height, startY + corridorHeight);
-    int endZ = std::min(depth, startZ + corridorDepth);
-
-    for (int x = startX; x < endX; ++x) {
-        for (int y = startY; y < endY; ++y) {
-            for (int z = startZ; z < endZ; ++z) {
-                // Mark the block as non-solid (or remove it) to create the corridor
-                noiseValues[z][y][x] = 1.0f; // Assuming higher noise value means non-solid
-            }
-        }
-    }
-}
\ No newline at end of file
+    glm::ivec3 start(startX, startY, startZ);
+    carveBox(start, start + glm::ivec3(corridorWidth, corridorHeight, corridorDepth));
+}
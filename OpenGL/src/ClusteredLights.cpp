@@ -0,0 +1,190 @@
+#include "../headers/ClusteredLights.h"
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+
+ClusteredLights::ClusteredLights(unsigned int threadCount)
+    : threadPool(new ThreadPool(threadCount)), fovY(0.0f), aspect(0.0f), nearPlane(0.0f), farPlane(0.0f),
+      sliceLights(SLICES), clusterLights(SLICES, std::vector<std::vector<uint32_t>>(TILES_X * TILES_Y)) {
+    std::fill(buffers, buffers + 3, 0);
+    std::fill(textures, textures + 3, 0);
+}
+
+ClusteredLights::~ClusteredLights() {
+    if (textures[0] != 0) {
+        glDeleteTextures(3, textures);
+        glDeleteBuffers(3, buffers);
+    }
+}
+
+// Assigns the lights to the clusters they reach and uploads the lights, the per-cluster ranges and
+// the light indices. Each light is a sphere in view space: it goes into every slice its depth range
+// overlaps, and within a slice into the clusters whose bounds it touches. Only the tile columns and
+// rows its bounds overlap are tested, so a light costs about as much as the clusters it lands in.
+// Parameters:
+//   - lights: Every light in the scene; those outside the frustum cost one transform each.
+//   - view: The camera's view matrix.
+//   - fovY: Vertical field of view of the projection, in radians.
+//   - aspect: Width over height of the projection.
+//   - nearPlane, farPlane: Clip plane distances of the projection.
+void ClusteredLights::update(const std::vector<PointLight>& lights, const glm::mat4& view, float fovY, float aspect,
+                             float nearPlane, float farPlane) {
+    auto start = std::chrono::high_resolution_clock::now();
+    if (clusterBounds.empty() || fovY != this->fovY || aspect != this->aspect || nearPlane != this->nearPlane || farPlane != this->farPlane) {
+        this->fovY = fovY;
+        this->aspect = aspect;
+        this->nearPlane = nearPlane;
+        this->farPlane = farPlane;
+        buildClusterBounds();
+    }
+
+    // Bin the lights by depth slice; view space looks down -z
+    viewLights.resize(lights.size());
+    for (std::vector<int>& slice : sliceLights) {
+        slice.clear();
+    }
+    for (size_t i = 0; i < lights.size(); ++i) {
+        glm::vec3 centre = glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+        float radius = lights[i].radius;
+        viewLights[i] = glm::vec4(centre, radius);
+        float depth = -centre.z;
+        if (depth + radius < nearPlane || depth - radius > farPlane) continue;
+        int first = sliceOf(std::max(depth - radius, nearPlane));
+        int last = sliceOf(std::min(depth + radius, farPlane));
+        for (int slice = first; slice <= last; ++slice) {
+            sliceLights[slice].push_back(static_cast<int>(i));
+        }
+    }
+
+    threadPool->parallelFor(0, SLICES, [&](int slice) {
+        std::vector<std::vector<uint32_t>>& tiles = clusterLights[slice];
+        for (std::vector<uint32_t>& tile : tiles) {
+            tile.clear();
+        }
+        const Bounds* bounds = &clusterBounds[slice * TILES_X * TILES_Y];
+        for (int light : sliceLights[slice]) {
+            glm::vec3 centre(viewLights[light]);
+            float radius = viewLights[light].w;
+            // Cluster x bounds only depend on the column and y bounds on the row
+            int firstX = 0, lastX = TILES_X - 1, firstY = 0, lastY = TILES_Y - 1;
+            while (firstX <= lastX && bounds[firstX].max.x < centre.x - radius) ++firstX;
+            while (lastX >= firstX && bounds[lastX].min.x > centre.x + radius) --lastX;
+            while (firstY <= lastY && bounds[firstY * TILES_X].max.y < centre.y - radius) ++firstY;
+            while (lastY >= firstY && bounds[lastY * TILES_X].min.y > centre.y + radius) --lastY;
+            for (int y = firstY; y <= lastY; ++y) {
+                for (int x = firstX; x <= lastX; ++x) {
+                    const Bounds& cluster = bounds[y * TILES_X + x];
+                    glm::vec3 nearest = glm::clamp(centre, cluster.min, cluster.max);
+                    if (glm::dot(nearest - centre, nearest - centre) <= radius * radius) {
+                        tiles[y * TILES_X + x].push_back(static_cast<uint32_t>(light));
+                    }
+                }
+            }
+        }
+    });
+
+    // Lay the clusters' lists out one after another
+    rangeData.resize(CLUSTER_COUNT * 2);
+    indexData.clear();
+    stats.maxClusterLights = 0;
+    for (int slice = 0; slice < SLICES; ++slice) {
+        for (int tile = 0; tile < TILES_X * TILES_Y; ++tile) {
+            const std::vector<uint32_t>& list = clusterLights[slice][tile];
+            int cluster = slice * TILES_X * TILES_Y + tile;
+            rangeData[cluster * 2] = static_cast<uint32_t>(indexData.size());
+            rangeData[cluster * 2 + 1] = static_cast<uint32_t>(list.size());
+            indexData.insert(indexData.end(), list.begin(), list.end());
+            stats.maxClusterLights = std::max(stats.maxClusterLights, static_cast<int>(list.size()));
+        }
+    }
+    std::vector<bool> visible(lights.size(), false);
+    for (uint32_t light : indexData) {
+        visible[light] = true;
+    }
+    stats.lights = static_cast<int>(lights.size());
+    stats.visibleLights = static_cast<int>(std::count(visible.begin(), visible.end(), true));
+    stats.indices = indexData.size();
+
+    lightData.resize(std::max<size_t>(lights.size(), 1) * 2, glm::vec4(0.0f));
+    for (size_t i = 0; i < lights.size(); ++i) {
+        lightData[i * 2] = glm::vec4(lights[i].position, lights[i].radius);
+        lightData[i * 2 + 1] = glm::vec4(lights[i].color, 0.0f);
+    }
+    if (indexData.empty()) {
+        indexData.push_back(0); // Buffer textures need some storage; every count is 0 anyway
+    }
+    auto assigned = std::chrono::high_resolution_clock::now();
+    stats.assignMs = std::chrono::duration<double, std::milli>(assigned - start).count();
+
+    if (textures[0] == 0) {
+        const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+        glGenBuffers(3, buffers);
+        glGenTextures(3, textures);
+        for (int i = 0; i < 3; ++i) {
+            glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+        }
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+    // Every frame replaces the whole contents, so each buffer is orphaned rather than overwritten
+    const void* data[3] = { lightData.data(), rangeData.data(), indexData.data() };
+    const size_t bytes[3] = { lightData.size() * sizeof(glm::vec4), rangeData.size() * sizeof(uint32_t), indexData.size() * sizeof(uint32_t) };
+    for (int i = 0; i < 3; ++i) {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+        glBufferData(GL_TEXTURE_BUFFER, bytes[i], data[i], GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    stats.uploadMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - assigned).count();
+}
+
+void ClusteredLights::bind(const Shader& shader, int screenWidth, int screenHeight) const {
+    const int units[3] = { LIGHT_TEXTURE_UNIT, RANGE_TEXTURE_UNIT, INDEX_TEXTURE_UNIT };
+    for (int i = 0; i < 3; ++i) {
+        glActiveTexture(GL_TEXTURE0 + units[i]);
+        glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+    }
+    glActiveTexture(GL_TEXTURE0);
+    shader.setInt("clusterLights", LIGHT_TEXTURE_UNIT);
+    shader.setInt("clusterRanges", RANGE_TEXTURE_UNIT);
+    shader.setInt("clusterIndices", INDEX_TEXTURE_UNIT);
+    shader.setInt("clusterTilesX", TILES_X);
+    shader.setInt("clusterTilesY", TILES_Y);
+    shader.setInt("clusterSlices", SLICES);
+    shader.setVec2("clusterTileScale", glm::vec2(static_cast<float>(TILES_X) / std::max(screenWidth, 1),
+                                                 static_cast<float>(TILES_Y) / std::max(screenHeight, 1)));
+    shader.setFloat("clusterNear", nearPlane);
+    shader.setFloat("clusterFar", farPlane);
+    shader.setFloat("clusterSliceScale", static_cast<float>(SLICES) / std::log(farPlane / nearPlane));
+}
+
+// Rebuilds the view-space bounds of every cluster for the current projection. Slice k covers depths
+// nearPlane * (farPlane / nearPlane)^(k / SLICES) up to the next slice; a cluster's bounds enclose
+// its tile's frustum section between the two.
+void ClusteredLights::buildClusterBounds() {
+    clusterBounds.resize(CLUSTER_COUNT);
+    const float tanHalfY = std::tan(fovY * 0.5f);
+    const float tanHalfX = tanHalfY * aspect;
+    for (int slice = 0; slice < SLICES; ++slice) {
+        float nearDepth = nearPlane * std::pow(farPlane / nearPlane, static_cast<float>(slice) / SLICES);
+        float farDepth = nearPlane * std::pow(farPlane / nearPlane, static_cast<float>(slice + 1) / SLICES);
+        for (int y = 0; y < TILES_Y; ++y) {
+            for (int x = 0; x < TILES_X; ++x) {
+                // Tile edges in normalized device coordinates, scaled out to each depth
+                float left = (-1.0f + 2.0f * x / TILES_X) * tanHalfX;
+                float right = (-1.0f + 2.0f * (x + 1) / TILES_X) * tanHalfX;
+                float bottom = (-1.0f + 2.0f * y / TILES_Y) * tanHalfY;
+                float top = (-1.0f + 2.0f * (y + 1) / TILES_Y) * tanHalfY;
+                Bounds& bounds = clusterBounds[(slice * TILES_Y + y) * TILES_X + x];
+                bounds.min = glm::vec3(std::min(left * nearDepth, left * farDepth), std::min(bottom * nearDepth, bottom * farDepth), -farDepth);
+                bounds.max = glm::vec3(std::max(right * nearDepth, right * farDepth), std::max(top * nearDepth, top * farDepth), -nearDepth);
+            }
+        }
+    }
+}
+
+// Depth slice holding a view depth between the clip planes.
+int ClusteredLights::sliceOf(float depth) const {
+    int slice = static_cast<int>(std::floor(std::log(depth / nearPlane) / std::log(farPlane / nearPlane) * SLICES));
+    return std::min(std::max(slice, 0), SLICES - 1);
+}
@@ -0,0 +1,324 @@
+#include "../headers/NoiseKernel.h"
+#include <cmath>
+#include <atomic>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define NOISE_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC accepts every intrinsic regardless of /arch, so all paths are always compiled in.
+// Other compilers only get the wide paths when the translation unit is built for them.
+#if defined(NOISE_X86) && (defined(_MSC_VER) || defined(__AVX2__))
+#define NOISE_HAS_AVX2 1
+#endif
+#if defined(NOISE_X86) && (defined(_MSC_VER) || defined(__AVX512F__))
+#define NOISE_HAS_AVX512 1
+#endif
+
+#pragma region Lane operations
+// Each Ops struct wraps one register width so the noise function below is written once.
+// step(edge, x) follows GLSL/glm: 0 where x < edge, 1 otherwise.
+
+struct ScalarOps {
+    typedef float V;
+    static const int WIDTH = 1;
+    static V set1(float a) { return a; }
+    static V load(const float* p) { return *p; }
+    static void store(float* p, V a) { *p = a; }
+    static V add(V a, V b) { return a + b; }
+    static V sub(V a, V b) { return a - b; }
+    static V mul(V a, V b) { return a * b; }
+    static V floor(V a) { return std::floor(a); }
+    static V abs(V a) { return std::fabs(a); }
+    static V step(V edge, V x) { return x < edge ? 0.0f : 1.0f; }
+};
+
+#ifdef NOISE_X86
+struct Sse2Ops {
+    typedef __m128 V;
+    static const int WIDTH = 4;
+    static V set1(float a) { return _mm_set1_ps(a); }
+    static V load(const float* p) { return _mm_loadu_ps(p); }
+    static void store(float* p, V a) { _mm_storeu_ps(p, a); }
+    static V add(V a, V b) { return _mm_add_ps(a, b); }
+    static V sub(V a, V b) { return _mm_sub_ps(a, b); }
+    static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+    static V floor(V a) {
+        // SSE2 has no round instruction: truncate, then step down where truncation rounded up.
+        // Exact for |a| < 2^31, far beyond any coordinate or lattice hash used here.
+        V t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+        return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a), _mm_set1_ps(1.0f)));
+    }
+    static V abs(V a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+    static V step(V edge, V x) { return _mm_andnot_ps(_mm_cmplt_ps(x, edge), _mm_set1_ps(1.0f)); }
+};
+#endif
+
+#ifdef NOISE_HAS_AVX2
+struct Avx2Ops {
+    typedef __m256 V;
+    static const int WIDTH = 8;
+    static V set1(float a) { return _mm256_set1_ps(a); }
+    static V load(const float* p) { return _mm256_loadu_ps(p); }
+    static void store(float* p, V a) { _mm256_storeu_ps(p, a); }
+    static V add(V a, V b) { return _mm256_add_ps(a, b); }
+    static V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+    static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+    static V floor(V a) { return _mm256_floor_ps(a); }
+    static V abs(V a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+    static V step(V edge, V x) {
+        return _mm256_andnot_ps(_mm256_cmp_ps(x, edge, _CMP_LT_OQ), _mm256_set1_ps(1.0f));
+    }
+};
+#endif
+
+#ifdef NOISE_HAS_AVX512
+struct Avx512Ops {
+    typedef __m512 V;
+    static const int WIDTH = 16;
+    static V set1(float a) { return _mm512_set1_ps(a); }
+    static V load(const float* p) { return _mm512_loadu_ps(p); }
+    static void store(float* p, V a) { _mm512_storeu_ps(p, a); }
+    static V add(V a, V b) { return _mm512_add_ps(a, b); }
+    static V sub(V a, V b) { return _mm512_sub_ps(a, b); }
+    static V mul(V a, V b) { return _mm512_mul_ps(a, b); }
+    static V floor(V a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+    static V abs(V a) { return _mm512_abs_ps(a); }
+    static V step(V edge, V x) {
+        return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, edge, _CMP_LT_OQ), _mm512_set1_ps(1.0f), _mm512_setzero_ps());
+    }
+};
+#endif
+#pragma endregion
+
+#pragma region Noise function
+// Helpers mirroring glm's detail:: functions used by glm::perlin.
+template <class Ops>
+static typename Ops::V fract(typename Ops::V a) {
+    return Ops::sub(a, Ops::floor(a));
+}
+
+template <class Ops>
+static typename Ops::V mod289(typename Ops::V a) {
+    return Ops::sub(a, Ops::mul(Ops::floor(Ops::mul(a, Ops::set1(1.0f / 289.0f))), Ops::set1(289.0f)));
+}
+
+template <class Ops>
+static typename Ops::V permute(typename Ops::V a) {
+    return mod289<Ops>(Ops::mul(Ops::add(Ops::mul(a, Ops::set1(34.0f)), Ops::set1(1.0f)), a));
+}
+
+template <class Ops>
+static typename Ops::V fade(typename Ops::V t) {
+    typedef typename Ops::V V;
+    V t3 = Ops::mul(Ops::mul(t, t), t);
+    V inner = Ops::add(Ops::mul(t, Ops::sub(Ops::mul(t, Ops::set1(6.0f)), Ops::set1(15.0f))), Ops::set1(10.0f));
+    return Ops::mul(t3, inner);
+}
+
+template <class Ops>
+static typename Ops::V mix(typename Ops::V a, typename Ops::V b, typename Ops::V t) {
+    return Ops::add(a, Ops::mul(t, Ops::sub(b, a)));
+}
+
+// Gradient for one lattice corner from its hash, dotted with the offset (px, py, pz) to that corner.
+template <class Ops>
+static typename Ops::V gradientDot(typename Ops::V hash, typename Ops::V px, typename Ops::V py, typename Ops::V pz) {
+    typedef typename Ops::V V;
+    const V zero = Ops::set1(0.0f);
+    const V half = Ops::set1(0.5f);
+    const V oneSeventh = Ops::set1(1.0f / 7.0f);
+
+    V gx = Ops::mul(hash, oneSeventh);
+    V gy = Ops::sub(fract<Ops>(Ops::mul(Ops::floor(gx), oneSeventh)), half);
+    gx = fract<Ops>(gx);
+    V gz = Ops::sub(Ops::sub(half, Ops::abs(gx)), Ops::abs(gy));
+    V sz = Ops::step(gz, zero);
+    gx = Ops::sub(gx, Ops::mul(sz, Ops::sub(Ops::step(zero, gx), half)));
+    gy = Ops::sub(gy, Ops::mul(sz, Ops::sub(Ops::step(zero, gy), half)));
+
+    // taylorInvSqrt normalisation
+    V lengthSq = Ops::add(Ops::add(Ops::mul(gx, gx), Ops::mul(gy, gy)), Ops::mul(gz, gz));
+    V norm = Ops::sub(Ops::set1(1.79284291400159f), Ops::mul(Ops::set1(0.85373472095314f), lengthSq));
+    gx = Ops::mul(gx, norm);
+    gy = Ops::mul(gy, norm);
+    gz = Ops::mul(gz, norm);
+
+    return Ops::add(Ops::add(Ops::mul(gx, px), Ops::mul(gy, py)), Ops::mul(gz, pz));
+}
+
+// Classic Perlin noise, one point per lane, following glm::perlin(vec3) step by step.
+template <class Ops>
+static typename Ops::V perlin(typename Ops::V x, typename Ops::V y, typename Ops::V z) {
+    typedef typename Ops::V V;
+    const V one = Ops::set1(1.0f);
+
+    V floorX = Ops::floor(x), floorY = Ops::floor(y), floorZ = Ops::floor(z);
+    V ix0 = mod289<Ops>(floorX), ix1 = mod289<Ops>(Ops::add(floorX, one));
+    V iy0 = mod289<Ops>(floorY), iy1 = mod289<Ops>(Ops::add(floorY, one));
+    V iz0 = mod289<Ops>(floorZ), iz1 = mod289<Ops>(Ops::add(floorZ, one));
+    V fx0 = Ops::sub(x, floorX), fy0 = Ops::sub(y, floorY), fz0 = Ops::sub(z, floorZ);
+    V fx1 = Ops::sub(fx0, one), fy1 = Ops::sub(fy0, one), fz1 = Ops::sub(fz0, one);
+
+    // Hash the four (x, y) columns, then each column at both z layers
+    V px0 = permute<Ops>(ix0), px1 = permute<Ops>(ix1);
+    V h00 = permute<Ops>(Ops::add(px0, iy0));
+    V h10 = permute<Ops>(Ops::add(px1, iy0));
+    V h01 = permute<Ops>(Ops::add(px0, iy1));
+    V h11 = permute<Ops>(Ops::add(px1, iy1));
+
+    V n000 = gradientDot<Ops>(permute<Ops>(Ops::add(h00, iz0)), fx0, fy0, fz0);
+    V n100 = gradientDot<Ops>(permute<Ops>(Ops::add(h10, iz0)), fx1, fy0, fz0);
+    V n010 = gradientDot<Ops>(permute<Ops>(Ops::add(h01, iz0)), fx0, fy1, fz0);
+    V n110 = gradientDot<Ops>(permute<Ops>(Ops::add(h11, iz0)), fx1, fy1, fz0);
+    V n001 = gradientDot<Ops>(permute<Ops>(Ops::add(h00, iz1)), fx0, fy0, fz1);
+    V n101 = gradientDot<Ops>(permute<Ops>(Ops::add(h10, iz1)), fx1, fy0, fz1);
+    V n011 = gradientDot<Ops>(permute<Ops>(Ops::add(h01, iz1)), fx0, fy1, fz1);
+    V n111 = gradientDot<Ops>(permute<Ops>(Ops::add(h11, iz1)), fx1, fy1, fz1);
+
+    // Trilinear blend with the quintic fade curve: z, then y, then x
+    V u = fade<Ops>(fx0), v = fade<Ops>(fy0), w = fade<Ops>(fz0);
+    V nz00 = mix<Ops>(n000, n001, w);
+    V nz10 = mix<Ops>(n100, n101, w);
+    V nz01 = mix<Ops>(n010, n011, w);
+    V nz11 = mix<Ops>(n110, n111, w);
+    V ny0 = mix<Ops>(nz00, nz01, v);
+    V ny1 = mix<Ops>(nz10, nz11, v);
+    return Ops::mul(Ops::set1(2.2f), mix<Ops>(ny0, ny1, u));
+}
+
+template <class Ops>
+static void accumulateRow(const float* px, float py, float pz, float amplitude, float* out, int count) {
+    typedef typename Ops::V V;
+    const V y = Ops::set1(py);
+    const V z = Ops::set1(pz);
+    const V amp = Ops::set1(amplitude);
+
+    int i = 0;
+    for (; i + Ops::WIDTH <= count; i += Ops::WIDTH) {
+        V n = perlin<Ops>(Ops::load(px + i), y, z);
+        Ops::store(out + i, Ops::add(Ops::load(out + i), Ops::mul(amp, n)));
+    }
+    // Remainder of the row that doesn't fill a whole register
+    for (; i < count; ++i) {
+        out[i] += amplitude * perlin<ScalarOps>(px[i], py, pz);
+    }
+}
+
+template <class Ops>
+static void accumulatePoints(const float* px, const float* py, const float* pz, float amplitude, float* out, int count) {
+    typedef typename Ops::V V;
+    const V amp = Ops::set1(amplitude);
+
+    int i = 0;
+    for (; i + Ops::WIDTH <= count; i += Ops::WIDTH) {
+        V n = perlin<Ops>(Ops::load(px + i), Ops::load(py + i), Ops::load(pz + i));
+        Ops::store(out + i, Ops::add(Ops::load(out + i), Ops::mul(amp, n)));
+    }
+    for (; i < count; ++i) {
+        out[i] += amplitude * perlin<ScalarOps>(px[i], py[i], pz[i]);
+    }
+}
+#pragma endregion
+
+#pragma region Dispatch
+// Selected instruction set, or -1 until first use. Atomic so worker threads can share it.
+static std::atomic<int> activeISA(-1);
+
+NoiseISA detectNoiseISA() {
+#if defined(NOISE_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool sse2 = (info[3] & (1 << 26)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    bool avx2 = false, avx512 = false;
+    if (osxsave && avx && maxLeaf >= 7) {
+        unsigned long long xcr0 = _xgetbv(0);
+        __cpuidex(info, 7, 0);
+        // The OS must save YMM state for AVX2, and opmask/ZMM state as well for AVX-512
+        avx2 = (xcr0 & 0x6) == 0x6 && (info[1] & (1 << 5)) != 0;
+        avx512 = (xcr0 & 0xE6) == 0xE6 && (info[1] & (1 << 16)) != 0;
+    }
+#ifdef NOISE_HAS_AVX512
+    if (avx512) return NOISE_ISA_AVX512;
+#endif
+#ifdef NOISE_HAS_AVX2
+    if (avx2) return NOISE_ISA_AVX2;
+#endif
+    if (sse2) return NOISE_ISA_SSE2;
+#elif defined(NOISE_X86)
+#ifdef NOISE_HAS_AVX512
+    if (__builtin_cpu_supports("avx512f")) return NOISE_ISA_AVX512;
+#endif
+#ifdef NOISE_HAS_AVX2
+    if (__builtin_cpu_supports("avx2")) return NOISE_ISA_AVX2;
+#endif
+    if (__builtin_cpu_supports("sse2")) return NOISE_ISA_SSE2;
+#endif
+    return NOISE_ISA_SCALAR;
+}
+
+NoiseISA getNoiseISA() {
+    int isa = activeISA.load();
+    if (isa < 0) {
+        isa = detectNoiseISA();
+        activeISA.store(isa);
+    }
+    return static_cast<NoiseISA>(isa);
+}
+
+void setNoiseISA(NoiseISA isa) {
+    NoiseISA supported = detectNoiseISA();
+    activeISA.store((isa > supported) ? supported : isa);
+}
+
+const char* noiseISAName(NoiseISA isa) {
+    switch (isa) {
+    case NOISE_ISA_SSE2: return "SSE2";
+    case NOISE_ISA_AVX2: return "AVX2";
+    case NOISE_ISA_AVX512: return "AVX-512";
+    default: return "scalar";
+    }
+}
+
+float perlinNoiseScalar(float x, float y, float z) {
+    return perlin<ScalarOps>(x, y, z);
+}
+
+void accumulatePerlinRow(const float* px, float py, float pz, float amplitude, float* out, int count) {
+    switch (getNoiseISA()) {
+#ifdef NOISE_HAS_AVX512
+    case NOISE_ISA_AVX512: accumulateRow<Avx512Ops>(px, py, pz, amplitude, out, count); break;
+#endif
+#ifdef NOISE_HAS_AVX2
+    case NOISE_ISA_AVX2: accumulateRow<Avx2Ops>(px, py, pz, amplitude, out, count); break;
+#endif
+#ifdef NOISE_X86
+    case NOISE_ISA_SSE2: accumulateRow<Sse2Ops>(px, py, pz, amplitude, out, count); break;
+#endif
+    default: accumulateRow<ScalarOps>(px, py, pz, amplitude, out, count); break;
+    }
+}
+
+void accumulatePerlinPoints(const float* px, const float* py, const float* pz, float amplitude, float* out, int count) {
+    switch (getNoiseISA()) {
+#ifdef NOISE_HAS_AVX512
+    case NOISE_ISA_AVX512: accumulatePoints<Avx512Ops>(px, py, pz, amplitude, out, count); break;
+#endif
+#ifdef NOISE_HAS_AVX2
+    case NOISE_ISA_AVX2: accumulatePoints<Avx2Ops>(px, py, pz, amplitude, out, count); break;
+#endif
+#ifdef NOISE_X86
+    case NOISE_ISA_SSE2: accumulatePoints<Sse2Ops>(px, py, pz, amplitude, out, count); break;
+#endif
+    default: accumulatePoints<ScalarOps>(px, py, pz, amplitude, out, count); break;
+    }
+}
+#pragma endregion
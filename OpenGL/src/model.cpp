@@ -3,7 +3,7 @@
 #include <iostream>
 
 // Constructor
-Model::Model(std::string const& path, bool gamma, bool isLightSource) : gammaCorrection(gamma), isLightSource(isLightSource) {
+Model::Model(std::string const& path, bool gamma, bool isLightSource) : gammaCorrection(gamma), isLightSource(isLightSource), instanceVBO(0), instanceCount(0) {
     loadModel(path);
 }
 
@@ -15,6 +15,36 @@ void Model::Draw(Shader& shader, glm::mat4& modelMatrix) {
         meshes[i].Draw(shader);
 }
 
+// Uploads the instance data of every instance. The buffer is created and attached to the meshes the
+// first time; after that it is refilled in place.
+// Parameters:
+//   - transforms: Model matrix of each instance.
+//   - tints: Colour of each instance, or empty for white.
+void Model::setInstances(const std::vector<glm::mat4>& transforms, const std::vector<glm::vec4>& tints) {
+    std::vector<InstanceData> instances(transforms.size());
+    for (size_t i = 0; i < transforms.size(); i++) {
+        instances[i].Transform = transforms[i];
+        instances[i].Tint = i < tints.size() ? tints[i] : glm::vec4(1.0f);
+    }
+    if (instanceVBO == 0) {
+        glGenBuffers(1, &instanceVBO);
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].setInstanceBuffer(instanceVBO);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(InstanceData), instances.empty() ? nullptr : instances.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    instanceCount = static_cast<unsigned int>(instances.size());
+}
+
+// Draws every instance set by setInstances
+void Model::DrawInstanced(Shader& shader) {
+    if (instanceCount == 0) return;
+    shader.use();
+    for (unsigned int i = 0; i < meshes.size(); i++)
+        meshes[i].DrawInstanced(shader, instanceCount);
+}
+
 // loadModel implementation
 void Model::loadModel(std::string const& path) {
     // read file via ASSIMP